@@ -80,12 +80,26 @@ ADIF_P(adif_esp_i2s_dsm_write)(const void *buff, unsigned size, int opaque)
   WS_UNUSED(opaque);
 }
 
+unsigned
+ADIF_P(adif_esp_i2s_dsm_write_block)(const short *pcm, unsigned frames, unsigned channels, int opaque)
+{
+  unsigned i, n = frames * channels;
+  for (i=0; i<n; i++)
+    {
+      i2sPushSample(samp_to_delta_sigma(pcm[i]));
+    }
+  return frames;
+  WS_UNUSED(opaque);
+}
+
 adif_t adif_esp_i2s_dsm = {
   ADIF_ESP_I2S_DSM,
   &adif_esp_i2s_dsm_init,
   &adif_esp_i2s_dsm_uninit,
   &adif_esp_i2s_dsm_config,
-  &adif_esp_i2s_dsm_write
+  &adif_esp_i2s_dsm_write,
+  &adif_esp_i2s_dsm_write_block,
+  { 24000, 16, 1 } /* one pin, and each sample costs a 32 bit modulation */
 };
 
 #endif /* USING(ADIF_ESP_I2S_DSM) */
@@ -97,7 +97,8 @@ static int rt_read_samples( void *voutputBuffer, void *inputBuffer, unsigned int
   if ( status )
     trace_warning(("buffer underflow!\n"));
 
-  int len = nBufferFrames * channels * 2;
+  int want = nBufferFrames * channels * 2;
+  int len = want;
   int first_len = m_buffersize/*BUFFSIZE*/ - read_pos;
   int buffered = buf_used();
   if (len > buffered) len = buffered;
@@ -111,6 +112,9 @@ static int rt_read_samples( void *voutputBuffer, void *inputBuffer, unsigned int
       ws_memcpy (&outputBuffer[first_len], buffer, len - first_len); /* remaining part from beginning of buffer */
     }
   read_pos = (read_pos + len) % m_buffersize/*BUFFSIZE*/;
+
+  if (len < want) /* play silence rather than whatever the device buffer held */
+    ws_memset (&outputBuffer[len], 0, want - len);
   return 0;
 }
 
@@ -165,10 +169,21 @@ ADIF_P(adif_rt_write)(const void *buff, unsigned size, int opaque)
   return len;
 }
 
+extern "C" unsigned
+ADIF_P(adif_rt_write_block)(const short *pcm, unsigned frames, unsigned channels, int opaque)
+{
+  unsigned frame_size = channels * sizeof(*pcm);
+  unsigned room = (unsigned)buf_free() / frame_size; /* whole frames only, or the channels slip */
+  if (frames > room) frames = room;
+  return adif_rt_write(pcm, frames * frame_size, opaque) / frame_size;
+}
+
 adif_t adif_rt = {
   ADIF_RT,
   &adif_rt_init,
   &adif_rt_uninit,
   &adif_rt_config,
-  &adif_rt_write
+  &adif_rt_write,
+  &adif_rt_write_block,
+  { 0, 16, 2 }
 };
@@ -15,63 +15,374 @@
 #include "util-task.h"
 #include "af-buffer.h"
 
-static int buf_read_pos;
-static int buf_write_pos;
-static int buf_fill;
 static util_semaphore_t sem_read;
 static util_semaphore_t sem_write;
-static util_mutex_t mux;
 static long buf_overflow_count, buf_underflow_count;
 
-/* Low watermark where we restart the reading task. */
-#define FIFO_LOWMARK (112*1024)
+/*
+ * Jitter buffer control. The writer times each write against the rate the
+ * reader consumes the stream at and keeps the interarrival jitter, as
+ * RFC 3550 does for RTP. The reader starts a rebuffer whenever it runs dry
+ * and audio_buffer_ready() then holds it off till the FIFO is back at the
+ * target: JB_JITTER_K times the jitter, plus a margin which every rebuffer
+ * adds to and which decays while none happen.
+ * A steady link thus keeps a short buffer, a bad one a long one.
+ */
+#define JB_MIN_MS 60        /* target with neither jitter nor rebuffers */
+#define JB_JITTER_K 4       /* the target covers this many times the jitter */
+#define JB_STEP_MS 100      /* margin added by a rebuffer */
+#define JB_WINDOW_MS 1000   /* the consumption rate is measured over this */
+#define JB_RATE_GUESS 16000 /* bytes/s till it is, 128 kbps */
+
+static unsigned int jb_jitter;      /* ms x16, owned by the writer */
+static unsigned long jb_last_ms;    /* time of the last write */
+static int jb_last_len;             /* and its length */
+static unsigned int jb_rate;        /* bytes/s consumed, owned by the reader */
+static unsigned long jb_window_ms;  /* start of the rate window */
+static unsigned int jb_window_bytes;
+static unsigned int jb_margin;      /* ms */
+static char jb_rebuffering, jb_rebuffered; /* rebuffered in this window */
+static long jb_rebuffers;
 
 #if ENABLE(INNER_SRAM_BUFF)
 #undef SPIRAMSIZE
 
 #define SPIRAMSIZE 4096
+# if defined(AF_BUFFER_ZEROCOPY)
+  static char buffer[SPIRAMSIZE + AF_BUFFER_MIRROR]; /* Utilize SRAM built in SoC */
+# else
   static char buffer[SPIRAMSIZE]; /* Utilize SRAM built in SoC */
+# endif
 # define spi_ram_init() while(0)
 # define spi_ram_test() 1
 # define spi_ram_write(pos, buf, n) memcpy(&buffer[pos], buf, n)
 # define spi_ram_read(pos, buf, n) memcpy(buf, &buffer[pos], n)
+# define FIFO_SLICE (SPIRAMSIZE) /* memcpy has no transfer limit */
+#else
+# define FIFO_SLICE SPIREADSIZE /* one SPI RAM transaction */
 #endif
 
+#if ENABLE(AF_BUFFER_SPSC)
+/*
+ * Exactly one writer (the HTTP task) and one reader (the decoder) use the
+ * FIFO. Each index is advanced only by its owner and runs freely over the
+ * unsigned range, so the fill level is head - tail without any lock.
+ * SPIRAMSIZE must be a power of two.
+ */
+static unsigned int buf_head; /* bytes ever written, owned by the writer */
+static unsigned int buf_tail; /* bytes ever read, owned by the reader */
+static int reader_waiting, writer_waiting;
+
+# define FIFO_POS(idx) ((int)((idx) & ((SPIRAMSIZE) - 1)))
+#else
+static int buf_read_pos;
+static int buf_write_pos;
+static int buf_fill;
+static util_mutex_t mux;
+#endif
+
+static void
+NC_P(jb_reset)(void)
+{
+  jb_jitter = 0;
+  jb_last_len = 0;
+  jb_rate = 0;
+  jb_window_bytes = 0;
+  jb_margin = 0;
+  jb_rebuffering = 0;
+  jb_rebuffered = 0;
+  jb_rebuffers = 0;
+}
+
+/* Writer side, time a write of 'len' bytes. */
+static void
+NC_P(jb_arrival)(int len)
+{
+  unsigned long now = util_task_get_ms();
+  unsigned int rate = util_atomic_load(&jb_rate);
+  long d;
+
+  if( jb_last_len )
+    {
+      /* the time since the last write less the time it lasts for */
+      d = (long)(now - jb_last_ms) - (long)((unsigned long)jb_last_len * 1000 / (rate ? rate : JB_RATE_GUESS));
+      if( d < 0 ) d = -d;
+      util_atomic_store(&jb_jitter, jb_jitter + (unsigned int)d - (jb_jitter >> 4));
+    }
+  jb_last_ms = now;
+  jb_last_len = len;
+}
+
+/* Reader side, count 'len' bytes consumed towards the rate. Windows with
+ * a rebuffer in them do not count, the reader was held off for part of them. */
+static void
+NC_P(jb_consumed)(int len)
+{
+  unsigned long now = util_task_get_ms(), span;
+  unsigned int rate;
+
+  if( !jb_window_bytes )
+    jb_window_ms = now;
+  jb_window_bytes += len;
+
+  span = now - jb_window_ms;
+  if( span >= JB_WINDOW_MS )
+    {
+      if( !jb_rebuffered )
+        {
+          rate = (unsigned int)((unsigned long long)jb_window_bytes * 1000 / span);
+          util_atomic_store(&jb_rate, jb_rate ? (3 * jb_rate + rate) / 4 : rate);
+          jb_margin -= jb_margin / 8;
+        }
+      jb_rebuffered = 0;
+      jb_window_bytes = 0;
+    }
+}
+
+/* Fill level to rebuffer to, in bytes */
+static int
+NC_P(jb_target)(void)
+{
+  unsigned int rate = util_atomic_load(&jb_rate);
+  unsigned long ms = JB_MIN_MS + JB_JITTER_K * (util_atomic_load(&jb_jitter) >> 4) + jb_margin;
+  unsigned long bytes = ms * (rate ? rate : JB_RATE_GUESS) / 1000;
+
+  if( bytes > (SPIRAMSIZE) / 4 * 3 ) /* the writer has to be able to get there */
+    bytes = (SPIRAMSIZE) / 4 * 3;
+  return (int)bytes;
+}
+
+#if ENABLE(AF_BUFFER_SPSC)
+
 int
 NC_P(audio_buffer_init)(void)
 {
-  buf_read_pos = 0;
-  buf_write_pos = 0;
-  buf_fill = 0;
+  buf_head = 0;
+  buf_tail = 0;
+  reader_waiting = 0;
+  writer_waiting = 0;
   buf_overflow_count = 0;
   buf_underflow_count = 0;
-  
+  jb_reset();
+
   sem_read = util_create_semaphore(0);
   sem_write = util_create_semaphore(0);
-  mux = util_create_mutex();
-  
+
   spi_ram_init();
   return spi_ram_test();
 }
 
 void
-NC_P(audio_buffer_reset)(void)
+NC_P(audio_buffer_read)(char *buff, int len)
+{
+  unsigned int tail = buf_tail;
+  int n, avail, starved = 0;
+  while (len > 0)
+    {
+      avail = (int)(util_atomic_load(&buf_head) - tail);
+      if (avail == 0)
+        {
+          /* FIFO is empty. Wait till there's some written and try again.
+           * A wake left over from an earlier wait only brings us back here,
+           * so the underflow is counted once until data comes in. */
+          if (!starved) buf_underflow_count++;
+          starved = 1;
+          util_index_wait(&reader_waiting, &buf_head, tail, sem_read);
+          continue;
+        }
+      starved = 0;
+
+      n = len;
+      if (n > avail) n = avail;
+      if (n > FIFO_SLICE) n = FIFO_SLICE;
+      if (n > (SPIRAMSIZE) - FIFO_POS(tail))
+        {
+          n = (SPIRAMSIZE) - FIFO_POS(tail);  /* don't read past end of buffer */
+        }
+
+      spi_ram_read(FIFO_POS(tail), buff, n);
+      buff += n;
+      len -= n;
+      tail += n;
+      util_atomic_store(&buf_tail, tail);
+      util_index_wake(&writer_waiting, sem_write); /* Indicate writer thread there's some free room in the fifo */
+      jb_consumed(n);
+    }
+}
+
+#if defined(AF_BUFFER_ZEROCOPY)
+
+/* Return the contiguous free span at the head of the FIFO, blocking while it is full. */
+char *
+NC_P(audio_buffer_reserve_write)(int *len)
+{
+  unsigned int head = buf_head;
+  int room;
+  if ((room = (SPIRAMSIZE) - (int)(head - util_atomic_load(&buf_tail))) == 0)
+    {
+      buf_overflow_count++; /* once, however often a stale wake brings us back */
+      do
+        util_index_wait(&writer_waiting, &buf_tail, head - (SPIRAMSIZE), sem_write);
+      while ((room = (SPIRAMSIZE) - (int)(head - util_atomic_load(&buf_tail))) == 0);
+    }
+  if (room > (SPIRAMSIZE) - FIFO_POS(head))
+    room = (SPIRAMSIZE) - FIFO_POS(head);
+  *len = room;
+  return &buffer[FIFO_POS(head)];
+}
+
+/* Hand 'len' bytes at the head over to the reader */
+static void
+NC_P(publish_write)(int len)
+{
+  unsigned int head = buf_head;
+  int pos = FIFO_POS(head);
+  if (pos < AF_BUFFER_MIRROR) /* keep the mirrored tail in step with the ring */
+    {
+      memcpy(&buffer[(SPIRAMSIZE) + pos], &buffer[pos],
+             len < AF_BUFFER_MIRROR - pos ? len : AF_BUFFER_MIRROR - pos);
+    }
+  util_atomic_store(&buf_head, head + len);
+  util_index_wake(&reader_waiting, sem_read);
+}
+
+/* Publish 'len' bytes filled in after audio_buffer_reserve_write(), as one
+ * arrival to the jitter buffer. */
+void
+NC_P(audio_buffer_commit_write)(int len)
+{
+  jb_arrival(len);
+  publish_write(len);
+}
+
+/* Return the contiguous data span at the tail of the FIFO, blocking until
+ * at least 'min' bytes (at most AF_BUFFER_MIRROR) are available. */
+const char *
+NC_P(audio_buffer_peek_read)(int min, int *len)
+{
+  unsigned int tail = buf_tail;
+  int avail, span;
+  if (min < 1) min = 1;
+  if (min > AF_BUFFER_MIRROR) min = AF_BUFFER_MIRROR;
+  if ((avail = (int)(util_atomic_load(&buf_head) - tail)) < min)
+    {
+      buf_underflow_count++; /* once, however often a stale wake brings us back */
+      do
+        util_index_wait(&reader_waiting, &buf_head, tail + avail, sem_read);
+      while ((avail = (int)(util_atomic_load(&buf_head) - tail)) < min);
+    }
+  span = (SPIRAMSIZE) + AF_BUFFER_MIRROR - FIFO_POS(tail);
+  *len = avail < span ? avail : span;
+  return &buffer[FIFO_POS(tail)];
+}
+
+/* Release 'len' bytes obtained by audio_buffer_peek_read(). */
+void
+NC_P(audio_buffer_consume_read)(int len)
+{
+  util_atomic_store(&buf_tail, buf_tail + len);
+  util_index_wake(&writer_waiting, sem_write);
+  jb_consumed(len);
+}
+
+void
+NC_P(audio_buffer_write)(const char *buff, int buffLen)
+{
+  char *at;
+  int n;
+  jb_arrival(buffLen);
+  while (buffLen > 0)
+    {
+      at = audio_buffer_reserve_write(&n);
+      if (n > buffLen) n = buffLen;
+      memcpy(at, buff, n);
+      publish_write(n);
+      buff += n;
+      buffLen -= n;
+    }
+}
+
+#else /* AF_BUFFER_ZEROCOPY */
+
+void
+NC_P(audio_buffer_write)(const char *buff, int buffLen)
+{
+  unsigned int head = buf_head;
+  int n, room, blocked = 0;
+  jb_arrival(buffLen);
+  while (buffLen > 0)
+    {
+      room = (SPIRAMSIZE) - (int)(head - util_atomic_load(&buf_tail));
+      if (room == 0)
+        {
+          /* FIFO is full. Wait till there's some read and try again,
+           * counting the overflow once until there is room. */
+          if (!blocked) buf_overflow_count++;
+          blocked = 1;
+          util_index_wait(&writer_waiting, &buf_tail, head - (SPIRAMSIZE), sem_write);
+          continue;
+        }
+      blocked = 0;
+
+      n = buffLen;
+      if (n > room) n = room;
+      if (n > FIFO_SLICE) n = FIFO_SLICE;
+      if (n > (SPIRAMSIZE) - FIFO_POS(head)) /* don't write past end of buffer */
+        {
+          n = (SPIRAMSIZE) - FIFO_POS(head);
+        }
+
+      spi_ram_write(FIFO_POS(head), buff, n);
+      buff += n;
+      buffLen -= n;
+      head += n;
+      util_atomic_store(&buf_head, head);
+      util_index_wake(&reader_waiting, sem_read); /* Tell reader thread there's some data in the fifo. */
+    }
+}
+
+#endif /* AF_BUFFER_ZEROCOPY */
+
+/* get amount of bytes in use */
+int
+NC_P(audio_buffer_fill)(void)
+{
+  unsigned int tail = util_atomic_load(&buf_tail);
+  return (int)(util_atomic_load(&buf_head) - tail);
+}
+
+long
+NC_P(audio_buffer_get_overflow)(void)
+{ return buf_overflow_count; }
+
+long
+NC_P(audio_buffer_get_underflow)(void)
+{ return buf_underflow_count; }
+
+#else /* ENABLE(AF_BUFFER_SPSC) */
+
+int
+NC_P(audio_buffer_init)(void)
 {
-  util_mutex_take(mux);
   buf_read_pos = 0;
   buf_write_pos = 0;
   buf_fill = 0;
   buf_overflow_count = 0;
   buf_underflow_count = 0;
-  util_semaphore_give(sem_write);
-  util_semaphore_take(sem_read);
-  util_mutex_give(mux);
+  jb_reset();
+  
+  sem_read = util_create_semaphore(0);
+  sem_write = util_create_semaphore(0);
+  mux = util_create_mutex();
+  
+  spi_ram_init();
+  return spi_ram_test();
 }
 
 void
 NC_P(audio_buffer_read)(char *buff, int len)
 {
-  int n;
+  int n, starved = 0;
   while (len > 0)
     {
       n = len;
@@ -84,10 +395,12 @@ NC_P(audio_buffer_read)(char *buff, int len)
       util_mutex_take(mux);
       if (buf_fill < n)
         {
-          /* not enough data in FIFO. Wait till there's some written and try again. */
-          buf_underflow_count++;
+          /* not enough data in FIFO. Wait till there's some written and try again.
+           * Every write gives sem_read, so count the underflow only once. */
+          if (!starved) buf_underflow_count++;
+          starved = 1;
           util_mutex_give(mux);
-          if (buf_fill < FIFO_LOWMARK) util_semaphore_take(sem_read);
+          util_semaphore_take(sem_read);
         }
       else
         {
@@ -97,8 +410,10 @@ NC_P(audio_buffer_read)(char *buff, int len)
           buf_fill -= n;
           buf_read_pos += n;
           if( buf_read_pos >= SPIRAMSIZE ) buf_read_pos=0;
+          starved = 0;
           util_mutex_give(mux);
           util_semaphore_give(sem_write); /* Indicate writer thread there's some free room in the fifo */
+          jb_consumed(n);
         }
     }
 }
@@ -106,7 +421,8 @@ NC_P(audio_buffer_read)(char *buff, int len)
 void
 NC_P(audio_buffer_write)(const char *buff, int buffLen)
 {
-  int n;
+  int n, blocked = 0;
+  jb_arrival(buffLen);
   while (buffLen > 0)
     {
       n = buffLen;
@@ -121,7 +437,8 @@ NC_P(audio_buffer_write)(const char *buff, int buffLen)
       if ((SPIRAMSIZE - buf_fill) < n)
         {
           /* not enough free room in FIFO. Wait till there's some read and try again. */
-          buf_overflow_count++;
+          if (!blocked) buf_overflow_count++;
+          blocked = 1;
           util_mutex_give(mux);
           util_semaphore_take(sem_write);
           util_task_yield();
@@ -134,6 +451,7 @@ NC_P(audio_buffer_write)(const char *buff, int buffLen)
           buf_fill += n;
           buf_write_pos += n;
           if (buf_write_pos >= SPIRAMSIZE) buf_write_pos = 0;
+          blocked = 0;
           util_mutex_give(mux);
           util_semaphore_give(sem_read); /* Tell reader thread there's some data in the fifo. */
         }
@@ -151,22 +469,13 @@ NC_P(audio_buffer_fill)(void)
   return ret;
 }
 
-/* get amount of bytes free */
-int
-NC_P(audio_buffer_free)(void)
-{ return (SPIRAMSIZE-audio_buffer_fill()); }
-
-int
-NC_P(audio_buffer_size)(void)
-{ return SPIRAMSIZE; }
-
 long
 NC_P(audio_buffer_get_overflow)(void)
 {
   long ret;
   util_mutex_take(mux);
   ret = buf_overflow_count;
-  util_mutex_take(mux);
+  util_mutex_give(mux);
   return ret;
 }
 
@@ -176,6 +485,59 @@ NC_P(audio_buffer_get_underflow)(void)
   long ret;
   util_mutex_take(mux);
   ret = buf_underflow_count;
-  util_mutex_take(mux);
+  util_mutex_give(mux);
   return ret;
 }
+
+#endif /* ENABLE(AF_BUFFER_SPSC) */
+
+/* The reader ran dry, have it wait for the target before it goes on. */
+void
+NC_P(audio_buffer_underrun)(void)
+{
+  if( jb_rebuffering )
+    return;
+  jb_rebuffering = 1;
+  jb_rebuffered = 1;
+  jb_rebuffers++;
+  jb_margin += JB_STEP_MS;
+}
+
+/* Bytes the reader may take now, none while it rebuffers and the FIFO
+ * has not filled back to the target. Reader side only. */
+int
+NC_P(audio_buffer_ready)(void)
+{
+  int fill = audio_buffer_fill();
+
+  if( jb_rebuffering )
+    {
+      if( fill < jb_target() )
+        return 0;
+      jb_rebuffering = 0;
+    }
+  return fill;
+}
+
+/* get the fill level rebuffers go to */
+int
+NC_P(audio_buffer_get_target)(void)
+{ return jb_target(); }
+
+/* get the arrival jitter in ms */
+int
+NC_P(audio_buffer_get_jitter)(void)
+{ return (int)(util_atomic_load(&jb_jitter) >> 4); }
+
+long
+NC_P(audio_buffer_get_rebuffers)(void)
+{ return jb_rebuffers; }
+
+/* get amount of bytes free */
+int
+NC_P(audio_buffer_free)(void)
+{ return (SPIRAMSIZE-audio_buffer_fill()); }
+
+int
+NC_P(audio_buffer_size)(void)
+{ return SPIRAMSIZE; }
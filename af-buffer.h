@@ -2,7 +2,6 @@
 #define AUDIO_BUFFER_H_
 
 extern int NC_P(audio_buffer_init)(void);
-extern void NC_P(audio_buffer_reset)(void);
 extern void NC_P(audio_buffer_read)(char *buff, int len);
 extern void NC_P(audio_buffer_write)(const char *buff, int buffLen);
 extern int NC_P(audio_buffer_fill)(void);
@@ -11,4 +10,28 @@ extern int NC_P(audio_buffer_size)(void);
 extern long NC_P(audio_buffer_get_overflow)(void);
 extern long NC_P(audio_buffer_get_underflow)(void);
 
+/* Adaptive jitter buffer, see af-buffer.c */
+extern void NC_P(audio_buffer_underrun)(void);
+extern int NC_P(audio_buffer_ready)(void);
+extern int NC_P(audio_buffer_get_target)(void);
+extern int NC_P(audio_buffer_get_jitter)(void);
+extern long NC_P(audio_buffer_get_rebuffers)(void);
+
+/*
+ * Zero-copy access, only when the FIFO lives in addressable SRAM.
+ * The first AF_BUFFER_MIRROR bytes of the ring are mirrored past its end,
+ * so a peeked span of up to AF_BUFFER_MIRROR bytes is always contiguous
+ * even when it wraps. That covers the largest Layer III frame (1441 bytes)
+ * plus MAD_BUFFER_GUARD.
+ */
+#if ENABLE(INNER_SRAM_BUFF) && ENABLE(AF_BUFFER_SPSC)
+# define AF_BUFFER_ZEROCOPY 1
+# define AF_BUFFER_MIRROR 1536
+
+extern char *NC_P(audio_buffer_reserve_write)(int *len);
+extern void NC_P(audio_buffer_commit_write)(int len);
+extern const char *NC_P(audio_buffer_peek_read)(int min, int *len);
+extern void NC_P(audio_buffer_consume_read)(int len);
+#endif
+
 #endif
@@ -79,3 +79,30 @@ NC_P(adif_write)(const adif_t *adif, const void *buff, unsigned size)
 {
   return adif->write(buff, size, 0);
 }
+
+/* Blocks until all 'frames' interleaved frames have been taken by the device. */
+void
+NC_P(adif_write_block)(const adif_t *adif, const short *pcm, unsigned frames, unsigned channels)
+{
+  unsigned n;
+  if( adif->write_block )
+    {
+      while( frames )
+        {
+          n = adif->write_block(pcm, frames, channels, 0);
+          pcm += n * channels;
+          frames -= n;
+        }
+    }
+  else
+    {
+      const char *buff = (const char *)pcm;
+      unsigned size = frames * channels * sizeof(*pcm);
+      while( size )
+        {
+          n = adif->write(buff, size, 0);
+          buff += n;
+          size -= n;
+        }
+    }
+}
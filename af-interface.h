@@ -18,6 +18,10 @@ typedef struct {
   void ADIF_CB((*uninit))(int opaque);
   int ADIF_CB((*config))(const adif_format_t *format, int opaque);
   unsigned ADIF_CB((*write))(const void *buff, unsigned size, int opaque);
+  /* interleaved 16-bit frames, returns the number of frames consumed */
+  unsigned ADIF_CB((*write_block))(const short *pcm, unsigned frames, unsigned channels, int opaque);
+  /* the most the device plays, 0 where it takes any */
+  adif_format_t caps;
 } adif_t;
 
 #define ADIF_RT 1           /* RtAudio */
@@ -28,6 +32,7 @@ extern const adif_t *NC_P(adif_init)(int adif_index);
 extern void NC_P(adif_uninit)(const adif_t *adif);
 extern int NC_P(adif_config)(const adif_t *adif, const adif_format_t *format);
 extern unsigned NC_P(adif_write)(const adif_t *adif, const void *buff, unsigned size);
+extern void NC_P(adif_write_block)(const adif_t *adif, const short *pcm, unsigned frames, unsigned channels);
 
 extern const adif_t *adif_instance;
 
@@ -0,0 +1,98 @@
+/*
+ *  NanoRadio (Open source IoT hardware)
+ *
+ *  This project is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License(GPL)
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This project is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+#include "portable.h"
+#include "util-task.h"
+#include "bench-util.h"
+
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+typedef struct
+{
+  int listen_fd;
+  pfn_util_task_callback task_conn;
+} serve_t;
+
+/* Seconds on the monotonic clock */
+double
+NC_P(bench_now)(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Listen on a free port of the loopback address. Return the socket and the
+ * port in *port, or -1. */
+int
+NC_P(bench_listen_local)(int *port, int backlog)
+{
+  struct sockaddr_in addr;
+  socklen_t len = sizeof(addr);
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+  if( fd < 0 )
+    return -1;
+  ws_bzero(&addr, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = 0; /* any free port */
+  if( bind(fd, (struct sockaddr *)&addr, sizeof(addr)) || listen(fd, backlog) ||
+      getsockname(fd, (struct sockaddr *)&addr, &len) )
+    {
+      close(fd);
+      return -1;
+    }
+  *port = ntohs(addr.sin_port);
+  return fd;
+}
+
+static void
+NC_P(task_serve)(void *opaque)
+{
+  serve_t *serve = (serve_t *)opaque;
+  int fd;
+
+  while( (fd = accept(serve->listen_fd, NULL, NULL)) >= 0 )
+    {
+      if( util_create_task(serve->task_conn, "conn", 0, CORE_STREAM, (void *)(intptr_t)fd) )
+        close(fd);
+    }
+  ws_free(serve);
+  util_task_exit();
+}
+
+/* Accept the connections to listen_fd on a task of their own, and run
+ * task_conn on a new task for each, with the socket as its opaque. The
+ * task ends with the listening socket. */
+int
+NC_P(bench_serve)(int listen_fd, pfn_util_task_callback task_conn)
+{
+  serve_t *serve = ws_malloc(sizeof(*serve));
+
+  if( !serve )
+    return -WERR_NO_MEMORY;
+  serve->listen_fd = listen_fd;
+  serve->task_conn = task_conn;
+  if( util_create_task(task_serve, "srv", 0, CORE_STREAM, serve) )
+    {
+      ws_free(serve);
+      return -WERR_FAILED;
+    }
+  return 0;
+}
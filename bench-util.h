@@ -0,0 +1,26 @@
+/*
+ *  NanoRadio (Open source IoT hardware)
+ *
+ *  This project is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License(GPL)
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This project is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+#ifndef BENCH_UTIL_H_
+#define BENCH_UTIL_H_
+
+#include "portable.h"
+#include "util-task.h"
+
+/* What the host benchmarks share: a clock and a local stand-in server. */
+
+double NC_P(bench_now)(void);
+int NC_P(bench_listen_local)(int *port, int backlog);
+int NC_P(bench_serve)(int listen_fd, pfn_util_task_callback task_conn);
+
+#endif
@@ -0,0 +1,312 @@
+/*
+ *  NanoRadio (Open source IoT hardware)
+ *
+ *  This project is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License(GPL)
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This project is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+/*
+ * Bitstream reader check and benchmark. This file is built twice, once
+ * against the word reader of codec-mpeg/bit.c and, with BIT_BENCH_BYTE
+ * and the mad_bit_* names renamed, against the byte reader the ESP8266
+ * build uses. Both run the same random script of reads, peeks, skips,
+ * lengths and CRCs over a random buffer, ending reads right at its last
+ * byte, and every result is checked against a bit by bit reference.
+ * The timed rounds then read the whole buffer in fields of 1 to 19 bits,
+ * and with peeks of 16 bits followed by shorter skips as the Huffman
+ * decoder does, and report ns per field for each reader.
+ * Exits with 1 if either reader gave a wrong result.
+ *
+ *   bit-bench [-s bytes] [-n ops] [-t timed_rounds] [-r seed]
+ */
+
+#include "portable.h"
+#include "codec-mpeg/stream.h"
+#include "codec-mpeg/bit.h"
+#include "bench-util.h"
+
+#if defined(BIT_BENCH_BYTE)
+# define READER(name)  name##_byte
+#else
+# define READER(name)  name##_word
+#endif
+
+typedef enum
+{
+  OP_READ = 0,
+  OP_PEEK,
+  OP_SKIP,
+  OP_LENGTH,
+  OP_NEXTBYTE,
+  OP_BITSLEFT,
+  OP_CRC,
+  OP_COUNT
+} op_kind_t;
+
+typedef struct
+{
+  op_kind_t kind;
+  unsigned int len;
+} op_t;
+
+extern int bit_script_word(const unsigned char *data, const op_t *ops, int n, unsigned long *log);
+extern int bit_script_byte(const unsigned char *data, const op_t *ops, int n, unsigned long *log);
+extern double bit_time_word(const unsigned char *data, long size, int rounds, int huffman, double *fields);
+extern double bit_time_byte(const unsigned char *data, long size, int rounds, int huffman, double *fields);
+
+/* Run ops over data, logging the result of each */
+int
+READER(bit_script)(const unsigned char *data, const op_t *ops, int n, unsigned long *log)
+{
+  struct mad_bitptr ptr, start;
+  int i;
+
+  mad_bit_init(&ptr, data);
+  start = ptr;
+
+  for(i = 0; i < n; i++)
+    switch( ops[i].kind )
+      {
+      case OP_READ:
+        log[i] = mad_bit_read(&ptr, ops[i].len);
+        break;
+      case OP_PEEK:
+        log[i] = mad_bit_peek(&ptr, ops[i].len);
+        break;
+      case OP_SKIP:
+        mad_bit_skip(&ptr, ops[i].len);
+        log[i] = 0;
+        break;
+      case OP_LENGTH:
+        log[i] = mad_bit_length(&start, &ptr);
+        break;
+      case OP_NEXTBYTE:
+        log[i] = (unsigned long)(mad_bit_nextbyte(&ptr) - data);
+        break;
+      case OP_BITSLEFT:
+        /* the byte reader may leave 0 bits of a byte for 8 of the next */
+        log[i] = mad_bit_bitsleft(&ptr) & 7;
+        break;
+      default:
+        log[i] = mad_bit_crc(ptr, ops[i].len, 0xffff);
+        break;
+      }
+  return n;
+}
+
+/* Seconds taken to read the first size bytes of data 'rounds' times, in
+ * fields of 1 to 19 bits, or as the Huffman decoder does */
+double
+READER(bit_time)(const unsigned char *data, long size, int rounds, int huffman, double *fields)
+{
+  struct mad_bitptr ptr;
+  unsigned long sum = 0, bits, left, n = 0;
+  volatile unsigned long sink;
+  double t;
+  int r;
+
+  t = bench_now();
+  for(r = 0; r < rounds; r++)
+    {
+      mad_bit_init(&ptr, data);
+      left = (unsigned long)size * 8 - 32;
+      for(bits = 0; left >= 19; left -= bits, n++)
+        if( huffman )
+          {
+            /* a 16 bit lookup, then the code length it gives */
+            sum += mad_bit_peek(&ptr, 16);
+            bits = 1 + (sum & 15);
+            mad_bit_skip(&ptr, (unsigned int)bits);
+          }
+        else
+          {
+            bits = 1 + (bits * 7 + 3) % 19;
+            sum += mad_bit_read(&ptr, (unsigned int)bits);
+          }
+    }
+  t = bench_now() - t;
+
+  sink = sum;
+  (void)sink;
+  *fields = (double)n;
+  return t;
+}
+
+#if !defined(BIT_BENCH_BYTE)
+
+static unsigned long
+rnd(unsigned long *seed)
+{
+  *seed = (*seed * 1103515245UL + 12345UL) & 0xffffffffUL;
+  return *seed >> 8;
+}
+
+static unsigned int
+bit_at(const unsigned char *data, unsigned long pos)
+{
+  return (data[pos >> 3] >> (7 - (pos & 7))) & 1;
+}
+
+/* The bit by bit reference of each op, advancing *pos as it goes */
+static unsigned long
+ref_op(const unsigned char *data, const op_t *op, unsigned long *pos)
+{
+  unsigned long v = 0, i;
+  unsigned int crc = 0xffff, msb;
+
+  switch( op->kind )
+    {
+    case OP_READ:
+    case OP_PEEK:
+      for(i = 0; i < op->len; i++)
+        v = (v << 1) | bit_at(data, *pos + i);
+      if( op->kind == OP_READ )
+        *pos += op->len;
+      return v;
+    case OP_SKIP:
+      *pos += op->len;
+      return 0;
+    case OP_LENGTH:
+      return *pos;
+    case OP_NEXTBYTE:
+      return (*pos + 7) >> 3;
+    case OP_BITSLEFT:
+      return (8 - (*pos & 7)) & 7;
+    default:
+      for(i = 0; i < op->len; i++)
+        {
+          msb = bit_at(data, *pos + i) ^ (crc >> 15);
+          crc = (crc << 1) & 0xffff;
+          if( msb )
+            crc ^= 0x8005;
+        }
+      return crc;
+    }
+}
+
+/* A random script over 'bits' bits: ops that would pass the end are cut
+ * to end right at it, so the last reads touch the last byte */
+static int
+NC_P(make_script)(op_t *ops, int n, unsigned long bits, unsigned long *seed)
+{
+  unsigned long pos = 0, len;
+  int i;
+
+  for(i = 0; i < n && pos < bits; i++)
+    {
+      ops[i].kind = (op_kind_t)(rnd(seed) % OP_COUNT);
+      switch( ops[i].kind )
+        {
+        case OP_READ:
+        case OP_PEEK:
+          len = rnd(seed) % 33;
+          break;
+        case OP_SKIP:
+          len = rnd(seed) % 4 ? rnd(seed) % 33 : rnd(seed) % 400;
+          break;
+        case OP_CRC:
+          len = rnd(seed) % 300;
+          break;
+        default:
+          len = 0;
+          break;
+        }
+      if( len > bits - pos )
+        len = bits - pos;
+      ops[i].len = (unsigned int)len;
+      if( ops[i].kind == OP_READ || ops[i].kind == OP_SKIP )
+        pos += len;
+    }
+  return i;
+}
+
+int
+main(int argc, char **argv)
+{
+  long size = 1 << 20;
+  int nops = 1 << 20, rounds = 20, n, i, k, wrong[2] = { 0, 0 };
+  unsigned long seed = 1, pos, ref, *log[2];
+  unsigned char *data;
+  op_t *ops;
+  double t[2][2], fields[2][2];
+  static const char *const names[2] = { "word", "byte" };
+
+  for(i = 1; i < argc; i++)
+    {
+      if( !strcmp(argv[i], "-s") && i + 1 < argc )
+        size = atol(argv[++i]);
+      else if( !strcmp(argv[i], "-n") && i + 1 < argc )
+        nops = atoi(argv[++i]);
+      else if( !strcmp(argv[i], "-t") && i + 1 < argc )
+        rounds = atoi(argv[++i]);
+      else if( !strcmp(argv[i], "-r") && i + 1 < argc )
+        seed = strtoul(argv[++i], NULL, 0);
+      else
+        {
+          fprintf(stderr, "usage: %s [-s bytes] [-n ops] [-t timed_rounds] [-r seed]\n", argv[0]);
+          return 1;
+        }
+    }
+  if( size < 64 || nops < 1 )
+    return 1;
+
+  /* the readers may look MAD_BUFFER_GUARD bytes past the end, as in a stream buffer */
+  data = ws_malloc(size + MAD_BUFFER_GUARD);
+  ops = ws_malloc(nops * sizeof(*ops));
+  log[0] = ws_malloc(nops * sizeof(unsigned long));
+  log[1] = ws_malloc(nops * sizeof(unsigned long));
+  if( !data || !ops || !log[0] || !log[1] )
+    {
+      fprintf(stderr, "out of memory\n");
+      return 1;
+    }
+  for(i = 0; i < size; i++)
+    data[i] = (unsigned char)rnd(&seed);
+  ws_bzero(data + size, MAD_BUFFER_GUARD);
+
+  n = make_script(ops, nops, (unsigned long)size * 8, &seed);
+  bit_script_word(data, ops, n, log[0]);
+  bit_script_byte(data, ops, n, log[1]);
+
+  for(i = 0, pos = 0; i < n; i++)
+    {
+      ref = ref_op(data, &ops[i], &pos);
+      for(k = 0; k < 2; k++)
+        if( log[k][i] != ref && !wrong[k]++ )
+          printf("%s reader: op %d (%d, %u bits) at bit %lu gave %lx, not %lx\n",
+                 names[k], i, ops[i].kind, ops[i].len, pos, log[k][i], ref);
+    }
+  printf("%d ops over %ld bytes: %d wrong in the word reader, %d in the byte reader\n",
+         n, size, wrong[0], wrong[1]);
+
+  if( rounds > 0 )
+    {
+      for(k = 0; k < 2; k++)
+        {
+          t[0][k] = bit_time_word(data, size, rounds, k, &fields[0][k]);
+          t[1][k] = bit_time_byte(data, size, rounds, k, &fields[1][k]);
+        }
+      printf("%-8s %12s %12s\n", "", "read ns", "peek+skip ns");
+      for(i = 0; i < 2; i++)
+        printf("%-8s %12.2f %12.2f\n", names[i],
+               fields[i][0] > 0 ? t[i][0] / fields[i][0] * 1e9 : 0.0,
+               fields[i][1] > 0 ? t[i][1] / fields[i][1] * 1e9 : 0.0);
+      printf("word reader %.2fx on reads, %.2fx on peek+skip\n",
+             t[0][0] > 0 ? t[1][0] / t[0][0] : 0.0, t[0][1] > 0 ? t[1][1] / t[0][1] : 0.0);
+    }
+
+  ws_free(log[1]);
+  ws_free(log[0]);
+  ws_free(ops);
+  ws_free(data);
+  return wrong[0] || wrong[1];
+}
+
+#endif /* BIT_BENCH_BYTE */
@@ -0,0 +1,25 @@
+/*
+ *  NanoRadio (Open source IoT hardware)
+ *
+ *  This project is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License(GPL)
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This project is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+/*
+ * codec-mpeg configuration of host builds. The sample arithmetic (FPM_*)
+ * is chosen by Makefile.unix.
+ */
+#ifndef HOST_CONFIG_H_
+#define HOST_CONFIG_H_
+
+#define HAVE_LIMITS_H 1
+#define SIZEOF_INT 4
+
+#endif
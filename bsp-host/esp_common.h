@@ -0,0 +1,36 @@
+/*
+ *  NanoRadio (Open source IoT hardware)
+ *
+ *  This project is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License(GPL)
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This project is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+/*
+ * Stand-in for the esp_common.h of the ESP8266 SDK in host builds, the C
+ * library and no flash placement.
+ */
+#ifndef HOST_ESP_COMMON_H_
+#define HOST_ESP_COMMON_H_
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#ifndef ICACHE_FLASH_ATTR
+# define ICACHE_FLASH_ATTR
+#endif
+#ifndef ICACHE_RODATA_ATTR
+# define ICACHE_RODATA_ATTR
+#endif
+
+#endif
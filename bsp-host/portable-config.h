@@ -0,0 +1,31 @@
+/*
+ *  NanoRadio (Open source IoT hardware)
+ *
+ *  This project is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License(GPL)
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This project is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+/*
+ * Configuration definitions of host builds (Makefile.unix), in place of
+ * those of portable.h for the ESP8266. POSIX threads and BSD sockets,
+ * plain HTTP only.
+ */
+#define USING_PORT_POSIX 1
+#undef USING_PORT_ESP8266
+#define USING_PORT_SOCKET 1
+#undef USING_PORT_LWIP
+#undef USING_PORT_WINSOCK2
+#undef USING_MBEDTLS
+#undef USING_SSL
+#undef USING_PORT_FREE_RTOS
+#undef USING_ADIF_ESP_I2S_DSM
+
+/* the C library, which the SDK headers bring on the ESP8266 */
+#include "esp_common.h"
@@ -31,6 +31,9 @@
 #  define CHAR_BIT  8
 # endif
 
+# include <string.h>
+
+# include "align.h"
 # include "bit.h"
 
 /*
@@ -81,6 +84,131 @@ unsigned short const ICACHE_RODATA_ATTR crc_table[256] = {
 
 # define CRC_POLY  0x8005
 
+# if ENABLE(BIT_WORD_READ)
+/*
+ * Word-at-a-time reader. The unread bits sit MSB first in a 64-bit
+ * reservoir which is topped up to at least 56 bits with a single unaligned
+ * big-endian load, so fields are extracted with shifts only. The reservoir
+ * may hold bits up to 8 bytes ahead and the load touches 8 more; the extra
+ * MAD_BUFFER_GUARD slack covers this at the end of the stream buffer and
+ * of the main_data reservoir.
+ */
+
+static inline
+unsigned long long bit_load(unsigned char const *byte)
+{
+  unsigned long long word;
+
+  memcpy(&word, byte, sizeof(word));
+
+#  if defined(WORDS_BIGENDIAN)
+  return word;
+#  elif defined(__GNUC__)
+  return __builtin_bswap64(word);
+#  else
+  word = ((word & 0x00ff00ff00ff00ffULL) <<  8) |
+	 ((word >>  8) & 0x00ff00ff00ff00ffULL);
+  word = ((word & 0x0000ffff0000ffffULL) << 16) |
+	 ((word >> 16) & 0x0000ffff0000ffffULL);
+  return (word << 32) | (word >> 32);
+#  endif
+}
+
+/*
+ * Bits below `left' are either zero or the true stream bits, so OR-ing a
+ * fresh load never disturbs them; only whole bytes are accounted for.
+ */
+static inline
+void bit_refill(struct mad_bitptr *bitptr)
+{
+  bitptr->cache |= bit_load(bitptr->byte) >> bitptr->left;
+  bitptr->byte  += (63 - bitptr->left) >> 3;
+  bitptr->left  |= 56;
+}
+
+/*
+ * NAME:	bit->init()
+ * DESCRIPTION:	initialize bit pointer struct
+ */
+void mad_bit_init(struct mad_bitptr *bitptr, unsigned char const *byte)
+{
+  bitptr->byte  = byte;
+  bitptr->cache = 0;
+  bitptr->left  = 0;
+}
+
+/*
+ * NAME:	bit->length()
+ * DESCRIPTION:	return number of bits between start and end points
+ */
+unsigned int mad_bit_length(struct mad_bitptr const *begin,
+			    struct mad_bitptr const *end)
+{
+  return CHAR_BIT * (end->byte - begin->byte) + begin->left - end->left;
+}
+
+/*
+ * NAME:	bit->nextbyte()
+ * DESCRIPTION:	return pointer to next unprocessed byte
+ */
+unsigned char const *mad_bit_nextbyte(struct mad_bitptr const *bitptr)
+{
+  return bitptr->byte - bitptr->left / CHAR_BIT;
+}
+
+/*
+ * NAME:	bit->skip()
+ * DESCRIPTION:	advance bit pointer
+ */
+void mad_bit_skip(struct mad_bitptr *bitptr, unsigned int len)
+{
+  if (len < bitptr->left) {
+    bitptr->cache <<= len;
+    bitptr->left   -= len;
+    return;
+  }
+
+  len -= bitptr->left;
+
+  bitptr->byte += len / CHAR_BIT;
+  bitptr->cache = 0;
+  bitptr->left  = 0;
+
+  bit_refill(bitptr);
+
+  bitptr->cache <<= len % CHAR_BIT;
+  bitptr->left   -= len % CHAR_BIT;
+}
+
+/*
+ * NAME:	bit->peek()
+ * DESCRIPTION:	return the next len (<= 32) bits without consuming them
+ */
+unsigned long mad_bit_peek(struct mad_bitptr *bitptr, unsigned int len)
+{
+  if (bitptr->left < 32)
+    bit_refill(bitptr);
+
+  /* the split shift keeps len == 0 defined */
+  return (bitptr->cache >> 1) >> (63 - len);
+}
+
+/*
+ * NAME:	bit->read()
+ * DESCRIPTION:	read an arbitrary number of bits and return their UIMSBF value
+ */
+unsigned long mad_bit_read(struct mad_bitptr *bitptr, unsigned int len)
+{
+  unsigned long value;
+
+  value = mad_bit_peek(bitptr, len);
+
+  bitptr->cache <<= len;
+  bitptr->left   -= len;
+
+  return value;
+}
+# else
 /*
  * NAME:	bit->init()
  * DESCRIPTION:	initialize bit pointer struct
@@ -130,6 +258,17 @@ void mad_bit_skip(struct mad_bitptr *bitptr, unsigned int len)
     bitptr->cache = *bitptr->byte;
 }
 
+/*
+ * NAME:	bit->peek()
+ * DESCRIPTION:	return the next len (<= 32) bits without consuming them
+ */
+unsigned long mad_bit_peek(struct mad_bitptr *bitptr, unsigned int len)
+{
+  struct mad_bitptr copy = *bitptr;
+
+  return mad_bit_read(&copy, len);
+}
+
 /*
  * NAME:	bit->read()
  * DESCRIPTION:	read an arbitrary number of bits and return their UIMSBF value
@@ -174,6 +313,8 @@ unsigned long mad_bit_read(struct mad_bitptr *bitptr, unsigned int len)
   return value;
 }
 
+# endif
+
 # if 0
 /*
  * NAME:	bit->write()
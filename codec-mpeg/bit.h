@@ -22,11 +22,21 @@
 # ifndef LIBMAD_BIT_H
 # define LIBMAD_BIT_H
 
+# include "portable.h"
+
+# if ENABLE(BIT_WORD_READ)
+struct mad_bitptr {
+  unsigned char const *byte;		/* next byte to enter the reservoir */
+  unsigned long long cache;		/* unread bits, MSB first */
+  unsigned short left;			/* valid bits in cache */
+};
+# else
 struct mad_bitptr {
   unsigned char const *byte;
   unsigned short cache;
   unsigned short left;
 };
+# endif
 
 void mad_bit_init(struct mad_bitptr *, unsigned char const *);
 
@@ -35,10 +45,15 @@ void mad_bit_init(struct mad_bitptr *, unsigned char const *);
 unsigned int mad_bit_length(struct mad_bitptr const *,
 			    struct mad_bitptr const *);
 
-# define mad_bit_bitsleft(bitptr)  ((bitptr)->left)
+# if ENABLE(BIT_WORD_READ)
+#  define mad_bit_bitsleft(bitptr)  ((((bitptr)->left - 1) & 7) + 1)
+# else
+#  define mad_bit_bitsleft(bitptr)  ((bitptr)->left)
+# endif
 unsigned char const *mad_bit_nextbyte(struct mad_bitptr const *);
 
 void mad_bit_skip(struct mad_bitptr *, unsigned int);
+unsigned long mad_bit_peek(struct mad_bitptr *, unsigned int);
 unsigned long mad_bit_read(struct mad_bitptr *, unsigned int);
 void mad_bit_write(struct mad_bitptr *, unsigned int, unsigned long);
 
@@ -15,6 +15,7 @@
 #define TRACE_UNIT "cdmpg"
 
 #include "util-logtrace.h"
+#include "util-task.h"
 #include "af-interface.h"
 #include "af-codec.h"
 #include "af-buffer.h"
@@ -23,23 +24,203 @@
 #include "stream.h"
 #include "frame.h"
 #include "synth.h"
+#include "xing.h"
+#include "index.h"
+#include "codec-mpeg.h"
 
 /* The theoretical maximum frame size is 2881 bytes,
-   MPEG 2.5 Layer II, 8000 Hz @ 160 kbps, with a padding slot plus 8 byte MAD_BUFFER_GUARD. */
-#define MAX_FRAME_SIZE (2889)
+   MPEG 2.5 Layer II, 8000 Hz @ 160 kbps, with a padding slot plus MAD_BUFFER_GUARD. */
+#define MAX_FRAME_SIZE (2881 + MAD_BUFFER_GUARD)
 
-/* The theoretical minimum frame size of 24 plus 8 byte MAD_BUFFER_GUARD. */
-#define MIN_FRAME_SIZE (32)
+/* The theoretical minimum frame size of 24 plus MAD_BUFFER_GUARD. */
+#define MIN_FRAME_SIZE (24 + MAD_BUFFER_GUARD)
 
-static char mpg_buf[8192];
-static size_t mpg_buf_size;
+/* compressed bytes buffered for mpeg_io_t.read() */
+#define INPUT_SIZE 8192
 
-static adif_format_t buffer_fmt =
-  {
-    .sample_rate = 0,
-    .bit_depth = 16,
-    .channels = 2
-  };
+/* Poll interval while the pre-roll waits for input past the input buffer */
+#define PREROLL_POLL_MS 10
+
+#if ENABLE(MPEG_CONCEAL)
+/* Conceal a frame once the audio handed on ahead of the input drops to this */
+#define CONCEAL_AHEAD_MS 30
+/* Poll interval while the input is short but the output is not */
+#define CONCEAL_POLL_MS 10
+/* Concealed frames in a row that fade out before the rest go silent */
+#define CONCEAL_FADE 4
+#endif
+
+#if ENABLE(MPEG_PIPELINE)
+/*
+ * Two stage decoding. The decoder task runs everything up to the subband
+ * samples (header, Huffman, requantization, stereo, IMDCT) into a ring of
+ * frames, and a synth task renders them to PCM, so the synthesis of frame N
+ * overlaps the decoding of frame N+1. As in the audio FIFO each index is
+ * advanced by its owner only. The Layer III overlap and main_data state is
+ * touched by the decoder task alone, so the PCM is the same as decoding on
+ * one task.
+ */
+#define PIPE_DEPTH 4 /* frames in flight, power of two */
+
+typedef struct
+{
+  struct mad_frame frame[PIPE_DEPTH];
+  struct mad_synth *synth;
+  unsigned int head; /* frames ever decoded, owned by the decoder task */
+  unsigned int tail; /* frames ever synthesized, owned by the synth task */
+  unsigned int last; /* index of the end marker, valid once 'stop' is set */
+  int stop;
+  int reader_waiting, writer_waiting;
+  util_semaphore_t sem_read, sem_write, sem_done;
+} mpeg_pipe_t;
+
+#define PIPE_FRAME(pipe, idx) (&(pipe)->frame[(idx) & (PIPE_DEPTH - 1)])
+#endif
+
+/*
+ * Everything one decoder instance touches, so instances can run on as
+ * many tasks at once as there are streams.
+ */
+struct mpeg_decoder
+{
+  struct mad_stream stream;
+  struct mad_frame frame;
+  struct mad_synth synth;
+  main_data_t main_data;          /* Layer III bit reservoir */
+  mad_fixed_t overlap[2][32][18]; /* Layer III block overlap */
+
+  mpeg_io_t io;
+  char *input;                    /* INPUT_SIZE bytes for io.read() */
+  char eof;                       /* io.read() ended, guard appended */
+  unsigned long input_end;        /* input bytes up to stream.bufend */
+  unsigned long bias;             /* stream offset less input position */
+
+  struct mad_header first;        /* first frame, what seeking is based on */
+  struct mad_xing xing;           /* its seek index, if it had a tag */
+  unsigned long start;            /* its stream offset */
+  unsigned long audio;            /* stream offset of the first audio frame */
+  char indexed;                   /* first, xing and start are valid */
+  const struct mad_index *index;  /* frame index of the whole stream, or NULL */
+
+  unsigned int preroll;           /* ms of audio validated before the first frame */
+  int options;                    /* MAD_OPTION_*CHANNEL of mpeg_decoder_set_channels() */
+  adif_format_t caps;             /* the most the sink takes, 0 for no limit */
+  char scalar;                    /* decode without the SIMD paths */
+
+  int resync;                     /* set by mpeg_decoder_resync(), cleared here */
+  unsigned long resync_mark;      /* input position the new stream starts at */
+  unsigned long resync_offset;    /* its stream offset */
+
+  adif_format_t fmt;              /* last format passed to io.config() */
+  char fmt_changed;
+#if ENABLE(MPEG_CONCEAL)
+  struct mad_header last;         /* header of the last frame decoded */
+  unsigned int last_len;          /* and its length in bytes */
+  char concealable;               /* 'last' is valid, since the (re)start */
+  unsigned int concealing;        /* frames concealed in a row */
+  mad_timer_t output;             /* audio handed on since 'base' */
+  unsigned long base;             /* util_task_get_ms() the output is timed from */
+  mpeg_conceal_stats_t conceal;
+#endif
+#if ENABLE(MPEG_PIPELINE)
+  mpeg_pipe_t *pipe;
+#endif
+};
+
+#if ENABLE(MPEG_PIPELINE)
+static void
+NC_P(task_mpeg_synth)(void *opaque)
+{
+  mpeg_pipe_t *pipe = (mpeg_pipe_t *)opaque;
+  unsigned int tail = pipe->tail;
+
+  for(;;)
+    {
+      if( util_atomic_load(&pipe->head) == tail )
+        {
+          util_index_wait(&pipe->reader_waiting, &pipe->head, tail, pipe->sem_read);
+          continue;
+        }
+      if( util_atomic_load(&pipe->stop) && tail == pipe->last )
+        break;
+
+      mad_synth_frame(pipe->synth, PIPE_FRAME(pipe, tail));
+
+      util_atomic_store(&pipe->tail, ++tail);
+      util_index_wake(&pipe->writer_waiting, pipe->sem_write);
+    }
+
+  util_semaphore_give(pipe->sem_done); /* last access, the decoder frees 'pipe' */
+  util_task_exit();
+}
+
+/* Return the frame at the head of the ring, blocking while it is full. */
+static struct mad_frame *
+NC_P(pipe_reserve)(mpeg_pipe_t *pipe)
+{
+  unsigned int head = pipe->head;
+  while( head - util_atomic_load(&pipe->tail) == PIPE_DEPTH )
+    util_index_wait(&pipe->writer_waiting, &pipe->tail, head - PIPE_DEPTH, pipe->sem_write);
+  return PIPE_FRAME(pipe, head);
+}
+
+/* Hand the frame obtained by pipe_reserve() to the synth task. */
+static void
+NC_P(pipe_commit)(mpeg_pipe_t *pipe)
+{
+  util_atomic_store(&pipe->head, pipe->head + 1);
+  util_index_wake(&pipe->reader_waiting, pipe->sem_read);
+}
+
+static mpeg_pipe_t *
+NC_P(pipe_open)(mpeg_decoder_t *dec)
+{
+  mpeg_pipe_t *pipe = ws_calloc(1, sizeof(*pipe));
+  int i;
+
+  if( !pipe )
+    return NULL;
+
+  for(i = 0; i < PIPE_DEPTH; i++)
+    {
+      mad_frame_init(&pipe->frame[i]);
+      pipe->frame[i].overlap = &dec->overlap;
+    }
+  pipe->synth = &dec->synth;
+  pipe->sem_read = util_create_semaphore(0);
+  pipe->sem_write = util_create_semaphore(0);
+  pipe->sem_done = util_create_semaphore(0);
+
+  if( !pipe->sem_read || !pipe->sem_write || !pipe->sem_done ||
+      util_create_task(task_mpeg_synth, "aud_syn", 2100, CORE_CODEC, pipe) )
+    {
+      if( pipe->sem_read ) util_destroy_semaphore(pipe->sem_read);
+      if( pipe->sem_write ) util_destroy_semaphore(pipe->sem_write);
+      if( pipe->sem_done ) util_destroy_semaphore(pipe->sem_done);
+      ws_free(pipe);
+      return NULL;
+    }
+  return pipe;
+}
+
+/* Queue the end marker, then wait till the synth task has rendered every
+ * frame before it and let go of the ring. */
+static void
+NC_P(pipe_close)(mpeg_pipe_t *pipe)
+{
+  pipe_reserve(pipe);
+  pipe->last = pipe->head;
+  util_atomic_store(&pipe->stop, 1);
+  pipe_commit(pipe);
+
+  util_semaphore_take(pipe->sem_done);
+
+  util_destroy_semaphore(pipe->sem_read);
+  util_destroy_semaphore(pipe->sem_write);
+  util_destroy_semaphore(pipe->sem_done);
+  ws_free(pipe);
+}
+#endif
 
 /* Routine to print out an error */
 static enum mad_flow
@@ -49,64 +230,543 @@ error(void *data, struct mad_stream *stream, struct mad_frame *frame)
   return MAD_FLOW_CONTINUE;
 }
 
+/* Stream offset of a byte in the input buffer. */
+static unsigned long
+NC_P(stream_offset)(mpeg_decoder_t *dec, const unsigned char *ptr)
+{
+  return dec->bias + dec->input_end - (unsigned long)(dec->stream.bufend - ptr);
+}
+
+static int NC_P(fifo_avail)(void *opaque);
+
+/* Input bytes available without blocking, or -1 if reading never blocks
+ * or this is unknown. The audio FIFO reports none while it rebuffers. */
+static int
+NC_P(input_avail)(mpeg_decoder_t *dec)
+{
+#if defined(AF_BUFFER_ZEROCOPY)
+  if( !dec->input ) /* the FIFO still holds the buffer libmad works on */
+    {
+      int avail = audio_buffer_ready() - (int)(dec->stream.bufend - dec->stream.buffer);
+      return audio_running ? (avail > 0 ? avail : 0) : -1;
+    }
+#endif
+  return dec->io.avail ? dec->io.avail(dec->io.opaque) : -1;
+}
+
+#if ENABLE(MPEG_CONCEAL)
+/* Tell the audio FIFO, if that is the input, that the decoder ran dry. */
+static void
+NC_P(input_underrun)(mpeg_decoder_t *dec)
+{
+#if defined(AF_BUFFER_ZEROCOPY)
+  if( !dec->input )
+    {
+      audio_buffer_underrun();
+      return;
+    }
+#endif
+  if( dec->io.avail == fifo_avail )
+    audio_buffer_underrun();
+}
+#endif
+
+/* Keep what seeking needs from the first decoded frame. Return 1 if it
+ * was the tag frame of a Xing/Info or VBRI stream, which holds no audio.
+ * The seeking task reads the index, so 'indexed' is published last. */
+static int
+NC_P(index_stream)(mpeg_decoder_t *dec, const struct mad_header *header)
+{
+  struct mad_stream *stream = &dec->stream;
+  int tag;
+
+  dec->first = *header;
+  dec->start = dec->audio = stream_offset(dec, stream->this_frame);
+
+  tag = !mad_xing_parse(&dec->xing, header, stream->this_frame, stream->next_frame - stream->this_frame);
+  if( tag )
+    dec->audio = stream_offset(dec, stream->next_frame);
+
+  util_atomic_store(&dec->indexed, 1);
+
+  if( tag )
+    trace_debug(("xing 0x%x, %lu frames, %lu bytes\n", dec->xing.flags, dec->xing.frames, dec->xing.bytes));
+  return tag;
+}
+
+/* Begin the stream anew at the resync mark. Neither the bit reservoir nor
+ * the block overlap of the old position carries over. */
+static void
+NC_P(decode_restart)(mpeg_decoder_t *dec)
+{
+  dec->stream.md_len = 0;
+  dec->stream.skiplen = 0;
+  mad_frame_mute(&dec->frame);
+
+  dec->bias = dec->resync_offset - dec->resync_mark;
+  util_atomic_store(&dec->resync, 0);
+#if ENABLE(MPEG_CONCEAL)
+  dec->concealable = 0;
+#endif
+}
+
+/* Decode the next frame, reduced to what the sink takes. Its header is
+ * decoded first, since that depends on the sample rate of the frame. */
+static int
+NC_P(frame_decode)(mpeg_decoder_t *dec, struct mad_frame *out)
+{
+  struct mad_stream *stream = &dec->stream;
+  int options = dec->options;
+
+  if( !(out->header.flags & MAD_FLAG_INCOMPLETE) && mad_header_decode(&out->header, stream) == -1 )
+    return -1;
+
+  if( dec->caps.sample_rate && out->header.samplerate > (unsigned int)dec->caps.sample_rate )
+    options |= MAD_OPTION_HALFSAMPLERATE;
+  if( dec->caps.channels == 1 && !(options & MAD_OPTION_SINGLECHANNEL) )
+    options |= MAD_OPTION_SINGLECHANNEL; /* mix down */
+  if( dec->scalar )
+    options |= MAD_OPTION_NOSIMD;
+
+  mad_stream_options(stream, options);
+  return mad_frame_decode(out, stream);
+}
+
+/* Pass a decoded or concealed frame on to the synthesis, timing the output. */
+static void
+NC_P(frame_out)(mpeg_decoder_t *dec, struct mad_frame *out)
+{
+#if ENABLE(MPEG_CONCEAL)
+  unsigned long now = util_task_get_ms();
+  unsigned long ms = (unsigned long)mad_timer_count(dec->output, MAD_UNITS_MILLISECONDS);
+
+  if( (long)(ms - (now - dec->base)) < 0 )
+    dec->base = now - ms; /* the output ran dry, time it from here */
+  if( dec->output.seconds >= 3600 )
+    {
+      dec->output.seconds -= 3600; /* keep the count of ms in range */
+      dec->base += 3600000UL;
+    }
+  mad_timer_add(&dec->output, out->header.duration);
+#endif
+#if ENABLE(MPEG_PIPELINE)
+  if( dec->pipe )
+    {
+      pipe_commit(dec->pipe);
+      return;
+    }
+#endif
+  mad_synth_frame(&dec->synth, out);
+}
+
+#if ENABLE(MPEG_CONCEAL)
+/* Stand in for a lost frame with the last granule of the frame before,
+ * at half its level, so each frame in a row is 6 dB down on the last one.
+ * After CONCEAL_FADE of them the output stays silent but paced. */
+static void
+NC_P(conceal_frame)(mpeg_decoder_t *dec, struct mad_frame *out)
+{
+  const struct mad_frame *prev = &dec->frame;
+  mad_fixed_t gain = dec->concealing < CONCEAL_FADE ? MAD_F(0x08000000) : 0;
+  unsigned int ns, ch, s, sb, from;
+
+#if ENABLE(MPEG_PIPELINE)
+  if( dec->pipe )
+    prev = PIPE_FRAME(dec->pipe, dec->pipe->head - 1); /* the synth task only reads it */
+#endif
+  out->header = dec->last;
+  out->options = dec->stream.options;
+  ns = MAD_NSBSAMPLES(&out->header);
+  from = ns - 18; /* the last granule, read ahead of the writes if in place */
+
+  for(ch = 0; ch < MAD_NSBCHANNELS(out); ch++)
+    for(s = 0; s < ns; s++)
+      for(sb = 0; sb < 32; sb++)
+        out->sbsample[ch][s][sb] = mad_f_mul(prev->sbsample[ch][from + s % 18][sb], gain);
+
+  dec->concealing++;
+  dec->conceal.concealed++;
+  frame_out(dec, out);
+}
+
+/* Wait for the input to hold the next frame, concealing frames meanwhile
+ * whenever the audio handed on is about to run out. */
+static void
+NC_P(wait_input)(mpeg_decoder_t *dec)
+{
+  struct mad_stream *stream = &dec->stream;
+  int need, avail;
+  long ahead;
+
+  if( !dec->concealable )
+    return; /* nothing to conceal with yet */
+
+  need = (int)(dec->last_len + MAD_BUFFER_GUARD);
+  if( stream->next_frame )
+    need -= (int)(stream->bufend - stream->next_frame);
+
+#if defined(AF_BUFFER_ZEROCOPY)
+  if( !dec->input && (int)(stream->bufend - stream->buffer) + need > audio_buffer_size() )
+    return; /* the FIFO is full, fifo_input() has to release what libmad is done with */
+#endif
+
+  while( (avail = input_avail(dec)) >= 0 && avail < need && !util_atomic_load(&dec->resync) )
+    {
+      ahead = mad_timer_count(dec->output, MAD_UNITS_MILLISECONDS) - (long)(util_task_get_ms() - dec->base);
+      if( ahead > CONCEAL_AHEAD_MS )
+        {
+          util_task_sleep(CONCEAL_POLL_MS);
+          continue;
+        }
+      input_underrun(dec); /* rebuffer, concealing meanwhile */
+      dec->conceal.late++;
+#if ENABLE(MPEG_PIPELINE)
+      conceal_frame(dec, dec->pipe ? pipe_reserve(dec->pipe) : &dec->frame);
+#else
+      conceal_frame(dec, &dec->frame);
+#endif
+    }
+}
+#endif
+
+/*
+ * Default I/O, the audio FIFO filled by the HTTP task and the audio device.
+ */
+static int
+NC_P(fifo_read)(void *opaque, char *buf, int len)
+{
+  int avail;
+
+  while( audio_status == AUDIO_STALLED )
+    util_task_yield();
+
+  /* take what has arrived rather than wait for all of 'len', and when
+   * nothing has, no more than the smallest frame */
+  avail = audio_buffer_fill();
+  if( avail < MIN_FRAME_SIZE )
+    avail = MIN_FRAME_SIZE;
+  if( len > avail )
+    len = avail;
+
+  audio_buffer_read(buf, len);
+  return audio_running ? len : 0;
+}
+
+static int
+NC_P(fifo_avail)(void *opaque)
+{
+  return audio_running ? audio_buffer_ready() : -1;
+}
+
+static void
+NC_P(adif_sink_config)(void *opaque, const adif_format_t *format)
+{
+  adif_config(adif_instance, format);
+}
+
+static void
+NC_P(adif_sink_write)(void *opaque, const short *pcm, unsigned frames, unsigned channels)
+{
+  adif_write_block(adif_instance, pcm, frames, channels);
+}
+
+#if defined(AF_BUFFER_ZEROCOPY)
+/* libmad decodes straight out of the audio FIFO. Frames it has finished
+ * with are released, and the tail it could not use stays in the FIFO and
+ * is handed back together with the newly arrived data. */
 static enum mad_flow
-NC_P(decode_input)(struct mad_stream *stream){
-  size_t remaining = 0;
-  
+NC_P(fifo_input)(mpeg_decoder_t *dec){
+  struct mad_stream *stream = &dec->stream;
+  size_t remaining = 0, used = 0;
+  unsigned long pos = dec->input_end;
+  const char *at;
+  int len;
+
+  while( audio_status == AUDIO_STALLED )
+    util_task_yield();
+
   if (stream->next_frame != 0)
     {
-      remaining  = stream->bufend - stream->next_frame;
-      
-      if (remaining != 0)
+      remaining = stream->bufend - stream->next_frame;
+      used = stream->next_frame - stream->buffer;
+      pos -= stream->bufend - stream->buffer;
+
+      if (remaining >= AF_BUFFER_MIRROR)
         {
-          memmove(mpg_buf, stream->next_frame, remaining);
+          /* can never become contiguous, drop it and resync */
+          used += remaining;
+          remaining = 0;
         }
     }
-  
-  size_t len = sizeof mpg_buf - remaining;
-  audio_buffer_read(mpg_buf + remaining, len);
+
+  if( util_atomic_load(&dec->resync) )
+    {
+      long skip = (long)(dec->resync_mark - (pos + used));
+
+      if( skip > 0 && (size_t)skip < remaining )
+        {
+          used += skip;
+          remaining -= skip;
+        }
+      else if( skip > 0 )
+        {
+          /* the rest of the old stream may still be arriving */
+          used += remaining;
+          skip -= remaining;
+          remaining = 0;
+          audio_buffer_consume_read(used);
+          pos += used;
+          used = 0;
+          while( skip > 0 && audio_running )
+            {
+              audio_buffer_peek_read(1, &len);
+              if( len > skip ) len = skip;
+              audio_buffer_consume_read(len);
+              pos += len;
+              skip -= len;
+            }
+        }
+      decode_restart(dec);
+    }
+
+  audio_buffer_consume_read(used);
+  pos += used;
+
+  at = audio_buffer_peek_read(remaining + 1, &len);
   if(!audio_running)
     {
       return MAD_FLOW_STOP;
     }
 
-  mpg_buf_size = len + remaining;
+  dec->input_end = pos + len;
+  mad_stream_buffer(stream, (const unsigned char *)at, len);
+  return MAD_FLOW_CONTINUE;
+}
+#endif
+
+/* Refill the input buffer through io.read(), keeping the tail of the
+ * previous buffer libmad could not use yet. */
+static enum mad_flow
+NC_P(decode_input)(mpeg_decoder_t *dec){
+  struct mad_stream *stream = &dec->stream;
+  size_t remaining = 0;
+  int len;
+
+#if defined(AF_BUFFER_ZEROCOPY)
+  if( !dec->input )
+    return fifo_input(dec);
+#endif
+
+  if( dec->eof )
+    return MAD_FLOW_STOP;
+
+  if (stream->next_frame != 0)
+    remaining  = stream->bufend - stream->next_frame;
+
+  if( util_atomic_load(&dec->resync) )
+    {
+      /* keep only what lies past the mark, reading up to it if need be */
+      long ahead = (long)(dec->input_end - dec->resync_mark);
+
+      if( ahead < (long)remaining )
+        remaining = ahead > 0 ? ahead : 0;
+      while( (long)(dec->resync_mark - dec->input_end) > 0 )
+        {
+          len = (int)(dec->resync_mark - dec->input_end);
+          if( len > INPUT_SIZE - MAD_BUFFER_GUARD )
+            len = INPUT_SIZE - MAD_BUFFER_GUARD;
+          if( (len = dec->io.read(dec->io.opaque, dec->input, len)) <= 0 )
+            break;
+          dec->input_end += len;
+        }
+      decode_restart(dec);
+    }
+
+  if (remaining != 0)
+    {
+      memmove(dec->input, stream->bufend - remaining, remaining);
+    }
   
-  mad_stream_buffer(stream, (const unsigned char *)mpg_buf, mpg_buf_size);
+  len = dec->io.read(dec->io.opaque, dec->input + remaining, INPUT_SIZE - MAD_BUFFER_GUARD - remaining);
+  if( len <= 0 )
+    {
+      /* libmad needs MAD_BUFFER_GUARD bytes past the last frame to decode it */
+      ws_bzero(dec->input + remaining, MAD_BUFFER_GUARD);
+      len = MAD_BUFFER_GUARD;
+      dec->eof = 1;
+    }
+  dec->input_end += len;
+  
+  mad_stream_buffer(stream, (const unsigned char *)dec->input, remaining + len);
   return MAD_FLOW_CONTINUE;
 }
 
-void
-NC_P(task_mpeg_decode)(void *opaque)
+/* Fill the input for the first time, then go on filling it until the
+ * frames validated in it hold dec->preroll ms of audio, so decoding starts
+ * as soon as that much is at hand and not at some byte count. What the
+ * input buffer cannot hold is waited for in bytes, at the bitrate of the
+ * frames validated in it. */
+static enum mad_flow
+NC_P(decode_preroll)(mpeg_decoder_t *dec)
 {
-    int ret;
-    struct mad_stream *stream;
-    struct mad_frame *frame;
-    struct mad_synth *synth;
-    
-    stream = ws_malloc(sizeof(struct mad_stream));
-    frame = ws_malloc(sizeof(struct mad_frame));
-    synth = ws_malloc(sizeof(struct mad_synth));
+  struct mad_stream *stream = &dec->stream;
+  struct mad_stream scan;
+  struct mad_header header;
+  mad_timer_t have = mad_timer_zero;
+  unsigned long ms = 0, done = 0, size, want, room = ~0UL;
+  int avail;
+
+  size = INPUT_SIZE - MAD_BUFFER_GUARD;
+#if defined(AF_BUFFER_ZEROCOPY)
+  if( !dec->input )
+    size = AF_BUFFER_MIRROR - 1; /* the most fifo_input() keeps over a refill */
+#endif
+
+  for(;;)
+    {
+      if( decode_input(dec) == MAD_FLOW_STOP )
+        return MAD_FLOW_STOP;
+      if( !dec->preroll || dec->eof || input_avail(dec) < 0 || util_atomic_load(&dec->resync) )
+        return MAD_FLOW_CONTINUE;
+
+      /* count the complete frames past those counted before, the first of
+       * them only if the header of the next one follows it */
+      mad_stream_init(&scan);
+      mad_stream_buffer(&scan, stream->buffer + done, stream->bufend - stream->buffer - done);
+      scan.sync = 0;
+      for(;;)
+        {
+          if( mad_header_decode(&header, &scan) == -1 )
+            {
+              if( MAD_RECOVERABLE(scan.error) )
+                continue;
+              break;
+            }
+          mad_timer_add(&have, header.duration);
+        }
+      done = scan.next_frame - stream->buffer;
+      mad_stream_finish(&scan);
+
+      ms = mad_timer_count(have, MAD_UNITS_MILLISECONDS);
+      if( ms >= dec->preroll || (unsigned long)(stream->bufend - stream->buffer) >= size )
+        break;
+      stream->next_frame = stream->buffer; /* keep all of it over the refill */
+    }
+
+  if( ms == 0 || ms >= dec->preroll )
+    return MAD_FLOW_CONTINUE;
+
+  /* no more than the FIFO can hold, or the wait would never end */
+#if defined(AF_BUFFER_ZEROCOPY)
+  if( !dec->input )
+    room = audio_buffer_size() - (stream->bufend - stream->buffer);
+#endif
+  if( dec->io.read == fifo_read )
+    room = audio_buffer_size();
 
-    if( !stream ) { trace_error(("m stream\n")); goto err_out; }
-    if( !synth ) { trace_error(("m synth\n")); goto err_out; }
-    if( !frame ) { trace_error(("m frame\n")); goto err_out; }
+  want = (unsigned long)((unsigned long long)done * (dec->preroll - ms) / ms);
+  if( want > room )
+    want = room;
+  while( (avail = input_avail(dec)) >= 0 && (unsigned long)avail < want && !util_atomic_load(&dec->resync) )
+    util_task_sleep(PREROLL_POLL_MS);
 
-    mad_stream_init(stream);
-    mad_frame_init(frame);
-    mad_synth_init(synth);
+  return MAD_FLOW_CONTINUE;
+}
+
+mpeg_decoder_t *
+NC_P(mpeg_decoder_open)(const mpeg_io_t *io)
+{
+  mpeg_decoder_t *dec = ws_malloc(sizeof(*dec));
+
+  if( !dec ) { trace_error(("m decoder\n")); return NULL; }
+
+  dec->input = NULL;
+  if( io )
+    dec->io = *io;
+  else
+    ws_bzero(&dec->io, sizeof(dec->io));
+
+#if !defined(AF_BUFFER_ZEROCOPY)
+  if( !dec->io.read )
+    {
+      dec->io.read = fifo_read;
+      dec->io.avail = fifo_avail;
+    }
+#endif
+  if( !dec->io.config ) dec->io.config = adif_sink_config;
+  if( !dec->io.write ) dec->io.write = adif_sink_write;
+
+  if( dec->io.read )
+    {
+      dec->input = ws_malloc(INPUT_SIZE);
+      if( !dec->input ) { trace_error(("m input\n")); ws_free(dec); return NULL; }
+    }
+  dec->eof = 0;
+  dec->input_end = 0;
+  dec->bias = 0;
+  dec->indexed = 0;
+  dec->index = NULL;
+  dec->preroll = 0;
+  dec->options = 0;
+  ws_bzero(&dec->caps, sizeof(dec->caps));
+  dec->scalar = 0;
+  if( dec->io.write == adif_sink_write && adif_instance )
+    dec->caps = adif_instance->caps;
+  dec->resync = 0;
+
+  dec->fmt.sample_rate = 0;
+  dec->fmt.bit_depth = 16;
+  dec->fmt.channels = 2;
+  dec->fmt_changed = 1;
+
+#if ENABLE(MPEG_CONCEAL)
+  dec->last_len = 0;
+  dec->concealable = 0;
+  dec->concealing = 0;
+  dec->output = mad_timer_zero;
+  dec->base = util_task_get_ms();
+  ws_bzero(&dec->conceal, sizeof(dec->conceal));
+#endif
+
+  mad_stream_init(&dec->stream);
+  mad_frame_init(&dec->frame);
+  mad_synth_init(&dec->synth);
+
+  dec->stream.main_data = &dec->main_data;
+  dec->frame.overlap = &dec->overlap;
+  mad_frame_mute(&dec->frame);
+  dec->synth.sink = dec;
+
+#if ENABLE(MPEG_PIPELINE)
+  dec->pipe = NULL;
+#endif
+  return dec;
+}
+
+/* Decode until the input ends. All PCM has been written on return. */
+int
+NC_P(mpeg_decoder_run)(mpeg_decoder_t *dec)
+{
+    int ret;
+    enum mad_flow flow;
+    struct mad_stream *stream = &dec->stream;
+    struct mad_frame *frame = &dec->frame;
+    struct mad_frame *out = frame;
+#if ENABLE(MPEG_PIPELINE)
+    if( util_task_get_num_cores() > 1 && !(dec->pipe = pipe_open(dec)) )
+      trace_error(("synth task, decoding on one task\n"));
+#endif
     
-    while(audio_running)
+    for(flow = decode_preroll(dec); flow != MAD_FLOW_STOP; flow = decode_input(dec)) /* fill in the bufer */
       {
-        while( audio_status == AUDIO_STALLED )
-          util_task_yield();
-        
-        if( decode_input(stream) == MAD_FLOW_STOP ) /* fill in the bufer */
-          break;
-
         for(;;)
           {
-            ret = mad_frame_decode(frame, stream); /* returns 0 or -1 */
+            if( util_atomic_load(&dec->resync) )
+              break; /* drop the rest of the buffer with the old stream */
+#if ENABLE(MPEG_PIPELINE)
+            out = dec->pipe ? pipe_reserve(dec->pipe) : frame;
+#endif
+            ret = frame_decode(dec, out); /* returns 0 or -1 */
             if( ret == -1 )
               {
                 if (!MAD_RECOVERABLE(stream->error))
@@ -115,55 +775,227 @@ NC_P(task_mpeg_decode)(void *opaque)
                     break;
                   }
                 error(NULL, stream, frame);
+#if ENABLE(MPEG_CONCEAL)
+                if( stream->error >= MAD_ERROR_BADCRC ) /* a frame lost, not a false sync */
+                  {
+                    dec->conceal.dropped++;
+                    if( dec->concealable )
+                      conceal_frame(dec, out);
+                  }
+#endif
                 continue;
               }
-            mad_synth_frame(synth, frame);
+            if( !dec->indexed && index_stream(dec, &out->header) )
+              continue;
+#if ENABLE(MPEG_CONCEAL)
+            dec->last = out->header;
+            dec->last_len = stream->next_frame - stream->this_frame;
+            dec->concealable = 1;
+            dec->concealing = 0;
+#endif
+            frame_out(dec, out);
           }
+#if ENABLE(MPEG_CONCEAL)
+        wait_input(dec);
+#endif
       }
 
-    free(synth);
-    free(frame);
-    free(stream);
-    
-    WS_UNUSED(opaque);
+#if ENABLE(MPEG_PIPELINE)
+    if( dec->pipe )
+      {
+        pipe_close(dec->pipe);
+        dec->pipe = NULL;
+      }
+#endif
+    return 0;
+}
+
+/* Have mpeg_decoder_run() wait till 'ms' of audio has arrived in complete,
+ * valid frames before it decodes the first one. 0, the default, decodes
+ * whatever the first read returns right away. */
+void
+NC_P(mpeg_decoder_set_preroll)(mpeg_decoder_t *dec, unsigned int ms)
+{
+  dec->preroll = ms;
+}
+
+/* Decode only one channel of two channel streams, or mix them down, which
+ * spares the synthesis of one channel. A sink of one channel mixes them
+ * down unless it was told to take one of them. */
+void
+NC_P(mpeg_decoder_set_channels)(mpeg_decoder_t *dec, mpeg_channels_t channels)
+{
+  static const int options[] =
+    { 0, MAD_OPTION_LEFTCHANNEL, MAD_OPTION_RIGHTCHANNEL, MAD_OPTION_SINGLECHANNEL };
+
+  dec->options = options[channels];
+}
+
+/* Tell the decoder the most its sink takes: above caps->sample_rate, if
+ * not 0, it synthesizes at half the rate of the stream, and with
+ * caps->channels of 1 it outputs one channel. The default sink gives
+ * the caps of adif_instance. */
+void
+NC_P(mpeg_decoder_set_caps)(mpeg_decoder_t *dec, const adif_format_t *caps)
+{
+  dec->caps = *caps;
+}
+
+/* Decode with the scalar IMDCT and synthesis even where the SIMD ones were
+ * selected, the reference output to check them against. */
+void
+NC_P(mpeg_decoder_set_scalar)(mpeg_decoder_t *dec, int scalar)
+{
+  dec->scalar = (char)(scalar != 0);
+}
+
+/* Seek and time the stream by the frame index of all of it, built from
+ * offset 0 by mad_index_build(), when it is at hand, as a file is. The
+ * index has to outlive the decoder. */
+void
+NC_P(mpeg_decoder_set_index)(mpeg_decoder_t *dec, const struct mad_index *index)
+{
+  dec->index = index;
+}
+
+/* Map a playing position to the stream offset to fetch from. With a frame
+ * index it is the frame the bit reservoir and block overlap of the frame
+ * playing at 'pos' begin in. Otherwise it comes from the Xing/Info or VBRI
+ * index of the stream, or its first bitrate without one, once the first
+ * frame has been decoded. */
+int
+NC_P(mpeg_decoder_seek_offset)(mpeg_decoder_t *dec, const mad_timer_t *pos, unsigned long *offset)
+{
+  unsigned long rel;
+  long frame;
+
+  if( dec->index )
+    {
+      if( (frame = mad_index_find(dec->index, *pos)) < 0 )
+        return -WERR_FAILED;
+      *offset = dec->index->entry[mad_index_preroll(dec->index, (unsigned long)frame)].offset;
+      return 0;
+    }
+
+  if( !util_atomic_load(&dec->indexed) )
+    return -WERR_FAILED;
+
+  if( (dec->xing.flags & (MAD_XING_FRAMES | MAD_XING_BYTES)) == (MAD_XING_FRAMES | MAD_XING_BYTES) )
+    {
+      if( mad_xing_offset(&dec->xing, &dec->first, *pos, &rel) )
+        return -WERR_FAILED;
+    }
+  else if( mad_timer_sign(*pos) >= 0 )
+    rel = (unsigned long)((unsigned long long)dec->first.bitrate *
+                          mad_timer_count(*pos, MAD_UNITS_MILLISECONDS) / 8000);
+  else
+    rel = 0;
+
+  *offset = dec->start + rel;
+  if( *offset < dec->audio )
+    *offset = dec->audio; /* not the tag frame */
+  return 0;
+}
+
+/* Playing time of the stream, from its frame index or else only from a
+ * Xing/Info or VBRI tag. */
+int
+NC_P(mpeg_decoder_duration)(mpeg_decoder_t *dec, mad_timer_t *duration)
+{
+  if( dec->index )
+    return mad_index_duration(dec->index, duration) ? -WERR_FAILED : 0;
+  if( !util_atomic_load(&dec->indexed) || mad_xing_duration(&dec->xing, &dec->first, duration) )
+    return -WERR_FAILED;
+  return 0;
+}
+
+/* Called from another task once the input from position 'mark' on (counting
+ * the bytes io.read() returns) is the stream from byte 'offset' on. The
+ * decoder drops the input before the mark and resynchronizes after it. */
+void
+NC_P(mpeg_decoder_resync)(mpeg_decoder_t *dec, unsigned long mark, unsigned long offset)
+{
+  dec->resync_mark = mark;
+  dec->resync_offset = offset;
+  util_atomic_store(&dec->resync, 1);
+}
+
+/* Concealment counters since the decoder was opened */
+void
+NC_P(mpeg_decoder_conceal_stats)(const mpeg_decoder_t *dec, mpeg_conceal_stats_t *stats)
+{
+#if ENABLE(MPEG_CONCEAL)
+  *stats = dec->conceal;
+#else
+  ws_bzero(stats, sizeof(*stats));
+#endif
+}
+
+/* Resynchronization counters since the decoder was opened */
+void
+NC_P(mpeg_decoder_sync_stats)(const mpeg_decoder_t *dec, mpeg_sync_stats_t *stats)
+{
+  stats->resyncs = dec->stream.stats.resyncs;
+  stats->skipped = dec->stream.stats.skipped;
+  stats->rejected = dec->stream.stats.rejected;
+}
+
+void
+NC_P(mpeg_decoder_close)(mpeg_decoder_t *dec)
+{
+  mad_synth_finish(&dec->synth);
+  mad_frame_finish(&dec->frame);
+  mad_stream_finish(&dec->stream);
+
+  if( dec->input )
+    ws_free(dec->input);
+  ws_free(dec);
+}
+
+/* Decoder task of the radio, on the decoder passed in or a default one. */
+void
+NC_P(task_mpeg_decode)(void *opaque)
+{
+    mpeg_decoder_t *dec = opaque ? (mpeg_decoder_t *)opaque : mpeg_decoder_open(NULL);
+
+    if( dec )
+      {
+        mpeg_decoder_run(dec);
+        mpeg_decoder_close(dec);
+      }
     
-err_out:
     util_task_exit();
 }
 
 /* Called by the NXP modifications of libmad. Sets the needed output sample rate. */
 void
-NC_P(set_dac_sample_rate)(int rate)
+NC_P(set_dac_sample_rate)(void *sink, int rate)
 {
-  buffer_fmt.sample_rate = rate;
-}
+  mpeg_decoder_t *dec = (mpeg_decoder_t *)sink;
 
-static void
-render_send_sample(uint16_t smpl)
-{
-  int len = sizeof smpl;
-  while(len)
-  {
-    len -= adif_write(adif_instance, &smpl, sizeof smpl);
-  }
+  if( dec->fmt.sample_rate != rate )
+    {
+      dec->fmt.sample_rate = rate;
+      dec->fmt_changed = 1;
+    }
 }
 
-/* render callback for the libmad synth */
+/* render callback for the libmad synth, 'pcm' holds num_samples interleaved frames */
 void
-NC_P(render_sample_block)(short *sample_buff_ch0, short *sample_buff_ch1, int num_samples, unsigned int num_channels)
+NC_P(render_sample_block)(void *sink, short const *pcm, int num_samples, unsigned int num_channels)
 {
-  buffer_fmt.channels = num_channels;
-  uint32_t len = num_samples /** sizeof(short) * num_channels*/;
-  
-  adif_config(adif_instance, &buffer_fmt);
+  mpeg_decoder_t *dec = (mpeg_decoder_t *)sink;
 
-  while(len--)
+  if( dec->fmt.channels != num_channels )
+    {
+      dec->fmt.channels = num_channels;
+      dec->fmt_changed = 1;
+    }
+  if( dec->fmt_changed )
     {
-      int16_t dat = (int16_t)(*sample_buff_ch0++);
-      render_send_sample(dat);
-      
-      dat = (int16_t)(*sample_buff_ch1++);
-      render_send_sample(dat);
+      dec->io.config(dec->io.opaque, &dec->fmt);
+      dec->fmt_changed = 0;
     }
-  return;
+
+  dec->io.write(dec->io.opaque, pcm, num_samples, num_channels);
 }
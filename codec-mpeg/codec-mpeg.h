@@ -0,0 +1,82 @@
+/*
+ *  NanoRadio (Open source IoT hardware)
+ *
+ *  This project is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License(GPL)
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This project is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+#ifndef CODEC_MPEG_H_
+#define CODEC_MPEG_H_
+
+#include "af-interface.h"
+#include "timer.h"
+
+/*
+ * MPEG audio decoder. Each instance owns all of its state, so any number
+ * of them may run at once, one task each.
+ */
+typedef struct mpeg_decoder mpeg_decoder_t;
+struct mad_index;
+
+/* Members left NULL fall back to the audio FIFO and adif_instance. */
+typedef struct
+{
+  /* fill 'buf' with up to 'len' bytes of the stream, return the count or 0 at its end */
+  int (*read)(void *opaque, char *buf, int len);
+  /* output format, called before the first block and whenever it changes */
+  void (*config)(void *opaque, const adif_format_t *format);
+  /* interleaved 16-bit PCM */
+  void (*write)(void *opaque, const short *pcm, unsigned frames, unsigned channels);
+  void *opaque;
+  /* bytes read() can return without blocking, or -1 once it never blocks; NULL if
+   * unknown. Lets the decoder conceal frames instead of waiting past the output. */
+  int (*avail)(void *opaque);
+} mpeg_io_t;
+
+/* What the decoder makes of a two channel stream */
+typedef enum
+{
+  MPEG_CHANNELS_BOTH = 0,
+  MPEG_CHANNELS_LEFT,       /* the left one only, the right one is neither transformed nor synthesized */
+  MPEG_CHANNELS_RIGHT,      /* the right one only, likewise */
+  MPEG_CHANNELS_MIX         /* both mixed down to one, ahead of the synthesis */
+} mpeg_channels_t;
+
+/* Counters kept while the decoder recovers from damaged or misaligned input */
+typedef struct
+{
+  unsigned long resyncs;    /* times frame sync was regained */
+  unsigned long skipped;    /* bytes discarded while searching for sync */
+  unsigned long rejected;   /* candidate sync words that failed validation */
+} mpeg_sync_stats_t;
+
+/* Counters of the frames the decoder stood in for */
+typedef struct
+{
+  unsigned long dropped;    /* frames that failed to decode */
+  unsigned long concealed;  /* frames played from the one before instead */
+  unsigned long late;       /* of these, frames whose input missed the output */
+} mpeg_conceal_stats_t;
+
+extern mpeg_decoder_t *NC_P(mpeg_decoder_open)(const mpeg_io_t *io);
+extern void NC_P(mpeg_decoder_set_preroll)(mpeg_decoder_t *dec, unsigned int ms);
+extern void NC_P(mpeg_decoder_set_channels)(mpeg_decoder_t *dec, mpeg_channels_t channels);
+extern void NC_P(mpeg_decoder_set_caps)(mpeg_decoder_t *dec, const adif_format_t *caps);
+extern void NC_P(mpeg_decoder_set_scalar)(mpeg_decoder_t *dec, int scalar);
+extern void NC_P(mpeg_decoder_set_index)(mpeg_decoder_t *dec, const struct mad_index *index);
+extern int NC_P(mpeg_decoder_run)(mpeg_decoder_t *dec);
+extern int NC_P(mpeg_decoder_seek_offset)(mpeg_decoder_t *dec, const mad_timer_t *pos, unsigned long *offset);
+extern int NC_P(mpeg_decoder_duration)(mpeg_decoder_t *dec, mad_timer_t *duration);
+extern void NC_P(mpeg_decoder_resync)(mpeg_decoder_t *dec, unsigned long mark, unsigned long offset);
+extern void NC_P(mpeg_decoder_sync_stats)(const mpeg_decoder_t *dec, mpeg_sync_stats_t *stats);
+extern void NC_P(mpeg_decoder_conceal_stats)(const mpeg_decoder_t *dec, mpeg_conceal_stats_t *stats);
+extern void NC_P(mpeg_decoder_close)(mpeg_decoder_t *dec);
+
+#endif
@@ -345,6 +345,10 @@ int ICACHE_FLASH_ATTR run_sync(struct mad_decoder *decoder)
   mad_frame_init(frame);
   mad_synth_init(synth);
 
+  stream->main_data = &decoder->sync->main_data;
+  frame->overlap    = &decoder->sync->overlap;
+  synth->sink       = decoder->cb_data;
+
   mad_stream_options(stream, decoder->options);
 
   do {
@@ -543,7 +547,6 @@ int ICACHE_FLASH_ATTR mad_decoder_run(struct mad_decoder *decoder, enum mad_deco
 {
   int result;
   int (*run)(struct mad_decoder *) = 0;
-  static struct sync_t decsync; //statically-allocated decoder obj
 
   switch (decoder->mode = mode) {
   case MAD_DECODER_MODE_SYNC:
@@ -560,15 +563,14 @@ int ICACHE_FLASH_ATTR mad_decoder_run(struct mad_decoder *decoder, enum mad_deco
   if (run == 0)
     return -1;
 
-//  decoder->sync = malloc(sizeof(*decoder->sync));
-  decoder->sync=&decsync;
+  decoder->sync = malloc(sizeof(*decoder->sync));
   if (decoder->sync == 0)
     return -1;
 
   result = run(decoder);
 
-//  free(decoder->sync);
-//  decoder->sync = 0;
+  free(decoder->sync);
+  decoder->sync = 0;
 
   return result;
 }
@@ -43,6 +43,8 @@ struct sync_t {
     struct mad_stream stream;	// definito main_data_t un array di circa 4K
     struct mad_frame frame;
     struct mad_synth synth;
+    main_data_t main_data;		/* Layer III bit reservoir */
+    mad_fixed_t overlap[2][32][18];	/* Layer III block overlap */
 };
 
 // # define MAD_BUFFER_GUARD	8
@@ -42,6 +42,11 @@ mad_fixed_t ICACHE_FLASH_ATTR mad_f_abs(mad_fixed_t x)
  */
 mad_fixed_t ICACHE_FLASH_ATTR mad_f_div(mad_fixed_t x, mad_fixed_t y)
 {
+# if defined(FPM_FLOAT)
+  mad_fixed_t q = x / y;
+
+  return mad_f_abs(q) < MAD_F_MAX ? q : 0;
+# else
   mad_fixed_t q, r;
   unsigned int bits;
 
@@ -78,4 +83,5 @@ mad_fixed_t ICACHE_FLASH_ATTR mad_f_div(mad_fixed_t x, mad_fixed_t y)
     q = -q;
 
   return q << bits;
+# endif
 }
@@ -22,7 +22,12 @@
 # ifndef LIBMAD_FIXED_H
 # define LIBMAD_FIXED_H
 
-# if SIZEOF_INT >= 4
+# if defined(FPM_FLOAT)
+typedef float mad_fixed_t;
+
+typedef float mad_fixed64hi_t;
+typedef float mad_fixed64lo_t;
+# elif SIZEOF_INT >= 4
 typedef   signed int mad_fixed_t;
 
 typedef   signed int mad_fixed64hi_t;
@@ -107,10 +112,32 @@ typedef mad_fixed_t mad_sample_t;
 # define mad_f_sub(x, y)	((x) - (y))
 
 # if defined(FPM_FLOAT)
-#  error "FPM_FLOAT not yet supported"
 
+/*
+ * Native single precision for hosts with an FPU. Values keep the scale of
+ * the fixed-point format (MAD_F_ONE is 1.0), so the tables are shared with
+ * the integer versions; products need no rescaling and sums do not wrap.
+ */
 #  undef MAD_F
-#  define MAD_F(x)		mad_f_todouble(x)
+#  define MAD_F(x)		((mad_fixed_t)  \
+				 ((x##L) / (double) (1L << MAD_F_FRACBITS)))
+
+#  undef MAD_F_MIN
+#  undef MAD_F_MAX
+#  define MAD_F_MIN		((mad_fixed_t) -8.0)
+#  define MAD_F_MAX		((mad_fixed_t) +8.0)
+
+#  undef mad_f_tofixed
+#  undef mad_f_todouble
+#  define mad_f_tofixed(x)	((mad_fixed_t) (x))
+#  define mad_f_todouble(x)	((double) (x))
+
+#  undef mad_f_intpart
+#  undef mad_f_fracpart
+#  undef mad_f_fromint
+#  define mad_f_intpart(x)	((signed long) (x))
+#  define mad_f_fracpart(x)	((x) - mad_f_intpart(x))
+#  define mad_f_fromint(x)	((mad_fixed_t) (x))
 
 #  define mad_f_mul(x, y)	((x) * (y))
 #  define mad_f_scale64
@@ -33,6 +33,11 @@
 # include "timer.h"
 //# include "layer12.h"
 # include "layer3.h"
+# include "profile.h"
+
+# if defined(MAD_PROFILE)
+unsigned long long mad_stage_cycles[MAD_STAGE_COUNT];
+# endif
 
 static
 unsigned long const ICACHE_RODATA_ATTR bitrate_table[5][15] = {
@@ -145,7 +150,8 @@ int ICACHE_FLASH_ATTR decode_header(struct mad_header *header, struct mad_stream
   /* layer */
   header->layer = 4 - mad_bit_read(&stream->ptr, 2);
 
-  if (header->layer == 4) {
+  /* also refuse layers built without a decoder, as damaged input finds them */
+  if (header->layer == 4 || decoder_table[header->layer - 1] == 0) {
     stream->error = MAD_ERROR_BADLAYER;
     return -1;
   }
@@ -240,11 +246,13 @@ static
 int ICACHE_FLASH_ATTR free_bitrate(struct mad_stream *stream, struct mad_header const *header)
 {
   struct mad_bitptr keep_ptr;
+  struct mad_sync_stats keep_stats;
   unsigned long rate = 0;
   unsigned int pad_slot, slots_per_frame;
   unsigned char const *ptr = 0;
 
-  keep_ptr = stream->ptr;
+  keep_ptr   = stream->ptr;
+  keep_stats = stream->stats;
 
   pad_slot = (header->flags & MAD_FLAG_PADDING) ? 1 : 0;
   slots_per_frame = (header->layer == MAD_LAYER_III &&
@@ -282,7 +290,8 @@ int ICACHE_FLASH_ATTR free_bitrate(struct mad_stream *stream, struct mad_header
     mad_bit_skip(&stream->ptr, 8);
   }
 
-  stream->ptr = keep_ptr;
+  stream->ptr   = keep_ptr;
+  stream->stats = keep_stats;
 
   if (rate < 8 || (header->layer == MAD_LAYER_III && rate > 640)) {
     stream->error = MAD_ERROR_LOSTSYNC;
@@ -294,6 +303,21 @@ int ICACHE_FLASH_ATTR free_bitrate(struct mad_stream *stream, struct mad_header
   return 0;
 }
 
+/*
+ * NAME:	header_follows()
+ * DESCRIPTION:	check that a header matching this frame's starts at next
+ */
+static inline
+int header_follows(unsigned char const *this, unsigned char const *next)
+{
+  /* sync word, ID and layer; sample frequency; a permitted bitrate */
+
+  return next[0] == 0xff &&
+    (next[1] & 0xfe) == (this[1] & 0xfe) &&
+    (next[2] & 0x0c) == (this[2] & 0x0c) &&
+    (next[2] & 0xf0) != 0xf0;
+}
+
 /*
  * NAME:	header->decode()
  * DESCRIPTION:	read the next frame header from the stream
@@ -411,15 +435,17 @@ int ICACHE_FLASH_ATTR mad_header_decode(struct mad_header *header, struct mad_st
   stream->next_frame = stream->this_frame + N;
 
   if (!stream->sync) {
-    /* check that a valid frame header follows this frame */
+    /* check that a matching frame header follows this frame */
+
+    if (!header_follows(stream->this_frame, stream->next_frame)) {
+      ++stream->stats.rejected;
 
-    ptr = stream->next_frame;
-    if (!(ptr[0] == 0xff && (ptr[1] & 0xe0) == 0xe0)) {
       ptr = stream->next_frame = stream->this_frame + 1;
       goto sync;
     }
 
     stream->sync = 1;
+    ++stream->stats.resyncs;
   }
 
   header->flags |= MAD_FLAG_INCOMPLETE;
@@ -438,14 +464,22 @@ int ICACHE_FLASH_ATTR mad_header_decode(struct mad_header *header, struct mad_st
  */
 int ICACHE_FLASH_ATTR mad_frame_decode(struct mad_frame *frame, struct mad_stream *stream)
 {
+  MAD_PROFILE_DECL(clock);
+
   frame->options = stream->options;
 
   /* header() */
   /* error_check() */
 
+  MAD_PROFILE_START(clock);
+
   if (!(frame->header.flags & MAD_FLAG_INCOMPLETE) &&
-      mad_header_decode(&frame->header, stream) == -1)
+      mad_header_decode(&frame->header, stream) == -1) {
+    MAD_PROFILE_LAP(clock, MAD_STAGE_HEADER);
     goto fail;
+  }
+
+  MAD_PROFILE_LAP(clock, MAD_STAGE_HEADER);
 
   /* audio_data() */
 
@@ -75,6 +75,9 @@ struct mad_frame {
 };
 
 # define MAD_NCHANNELS(header)		((header)->mode ? 2 : 1)
+# define MAD_NSBCHANNELS(frame)  \
+  (((frame)->options & MAD_OPTION_SINGLECHANNEL) ? 1 :  \
+   MAD_NCHANNELS(&(frame)->header))
 # define MAD_NSBSAMPLES(header)  \
   ((header)->layer == MAD_LAYER_I ? 12 :  \
    (((header)->layer == MAD_LAYER_III &&  \
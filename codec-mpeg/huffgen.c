@@ -0,0 +1,192 @@
+/*
+ * libmad - MPEG audio decoder library
+ * Copyright (C) 2000-2004 Underbit Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Build-time generator for huffman_lut.dat.
+ *
+ * The code words are recovered by walking the tree tables of huffman.c, so
+ * the two representations cannot drift apart. Every pair table is then laid
+ * out as one direct lookup on the first HUFF_LUT_BITS bits of the code,
+ * with a second level for the few longer codes:
+ *
+ *   final  0 | len:5 | x:4 | y:4	len counts the bits of this level
+ *   link   1 | bits:4 | offset:11	index of the second level table
+ */
+
+# define HUFFGEN
+
+# include "huffman.c"
+
+# include <stdio.h>
+# include <stdlib.h>
+
+# define HUFF_LUT_BITS  9
+
+struct code {
+  unsigned int word, len, x, y;
+};
+
+static struct code codes[256];
+static unsigned int ncodes;
+
+static
+void collect(union huffpair const *table, unsigned int offset,
+	     unsigned int clumpsz, unsigned int prefix, unsigned int plen)
+{
+  unsigned int v;
+
+  for (v = 0; v < (1U << clumpsz); ++v) {
+    union huffpair const *pair = &table[offset + v];
+
+    if (!pair->final) {
+      collect(table, pair->ptr.offset, pair->ptr.bits,
+	      (prefix << clumpsz) | v, plen + clumpsz);
+    }
+    /* short codes fill several slots of a clump; take the first only */
+    else if ((v & ((1U << (clumpsz - pair->value.hlen)) - 1)) == 0) {
+      codes[ncodes].word = (prefix << pair->value.hlen) |
+	(v >> (clumpsz - pair->value.hlen));
+      codes[ncodes].len  = plen + pair->value.hlen;
+      codes[ncodes].x    = pair->value.x;
+      codes[ncodes].y    = pair->value.y;
+      ++ncodes;
+    }
+  }
+}
+
+static
+void fill(unsigned int *lut, unsigned int bits, unsigned int word,
+	  unsigned int len, unsigned int x, unsigned int y)
+{
+  unsigned int i, span = 1U << (bits - len);
+
+  for (i = 0; i < span; ++i)
+    lut[(word << (bits - len)) + i] = (len << 8) | (x << 4) | y;
+}
+
+static
+unsigned int emit(unsigned int index, union huffpair const *table,
+		  unsigned int startbits)
+{
+  unsigned int lut[1 << 12], sub[1 << HUFF_LUT_BITS];
+  unsigned int i, j, bits, maxlen, size, prefix;
+
+  ncodes = 0;
+  collect(table, 0, startbits, 0, 0);
+
+  maxlen = 0;
+  for (i = 0; i < ncodes; ++i) {
+    if (codes[i].len > maxlen)
+      maxlen = codes[i].len;
+  }
+
+  bits = maxlen < HUFF_LUT_BITS ? maxlen : HUFF_LUT_BITS;
+
+  /* widest second level needed under each primary index */
+  memset(sub, 0, sizeof(sub));
+  for (i = 0; i < ncodes; ++i) {
+    if (codes[i].len > bits) {
+      prefix = codes[i].word >> (codes[i].len - bits);
+      if (codes[i].len - bits > sub[prefix])
+	sub[prefix] = codes[i].len - bits;
+    }
+  }
+
+  size = 1U << bits;
+  for (i = 0; i < ncodes; ++i) {
+    if (codes[i].len <= bits)
+      fill(lut, bits, codes[i].word, codes[i].len, codes[i].x, codes[i].y);
+  }
+
+  for (j = 0; j < (1U << bits); ++j) {
+    if (sub[j] == 0)
+      continue;
+
+    if (size + (1U << sub[j]) > sizeof(lut) / sizeof(lut[0]) ||
+	size >= (1U << 11) || sub[j] > 15) {
+      fprintf(stderr, "huffgen: table %u does not fit\n", index);
+      exit(1);
+    }
+
+    lut[j] = 0x8000 | (sub[j] << 11) | size;
+
+    for (i = 0; i < ncodes; ++i) {
+      if (codes[i].len > bits &&
+	  codes[i].word >> (codes[i].len - bits) == j) {
+	fill(&lut[size], sub[j],
+	     codes[i].word & ((1U << (codes[i].len - bits)) - 1),
+	     codes[i].len - bits, codes[i].x, codes[i].y);
+      }
+    }
+
+    size += 1U << sub[j];
+  }
+
+  printf("static\nunsigned short const hufflut%u[%u] = {", index, size);
+  for (i = 0; i < size; ++i)
+    printf("%s0x%04x,", i % 8 ? " " : "\n  ", lut[i]);
+  printf("\n};\n\n");
+
+  return bits;
+}
+
+int main(void)
+{
+  unsigned int i, j, bits[32];
+  char name[16];
+
+  printf("/*\n * Generated by huffgen.c from the tables in huffman.c."
+	 " Do not edit.\n */\n\n");
+
+  for (i = 0; i < 32; ++i) {
+    bits[i] = 0;
+
+    if (mad_huff_pair_table[i].table == 0)
+      continue;
+
+    for (j = 0; j < i; ++j) {
+      if (mad_huff_pair_table[j].table == mad_huff_pair_table[i].table)
+	break;
+    }
+
+    if (j == i)
+      bits[i] = emit(i, mad_huff_pair_table[i].table,
+		     mad_huff_pair_table[i].startbits);
+  }
+
+  printf("struct hufflut const mad_huff_lut_table[32] = {\n");
+  for (i = 0; i < 32; ++i) {
+    if (mad_huff_pair_table[i].table == 0) {
+      printf("  /* %2u */ { 0,          0, 0 }%s\n", i, i < 31 ? "," : "");
+      continue;
+    }
+
+    for (j = 0; j < i; ++j) {
+      if (mad_huff_pair_table[j].table == mad_huff_pair_table[i].table)
+	break;
+    }
+
+    sprintf(name, "hufflut%u,", j);
+    printf("  /* %2u */ { %-10s %2u, %u }%s\n", i, name,
+	   mad_huff_pair_table[i].linbits, bits[j], i < 31 ? "," : "");
+  }
+  printf("};\n");
+
+  return 0;
+}
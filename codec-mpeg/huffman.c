@@ -25,6 +25,7 @@
 
 # include "global.h"
 
+# include "portable.h"
 # include "huffman.h"
 
 /*
@@ -3107,3 +3108,7 @@ struct hufftable const ICACHE_RODATA_ATTR mad_huff_pair_table[32] = {
   /* 30 */ { hufftab24, 11, 4 },
   /* 31 */ { hufftab24, 13, 4 }
 };
+
+# if ENABLE(HUFF_LUT) && !defined(HUFFGEN)
+#  include "huffman_lut.dat"
+# endif
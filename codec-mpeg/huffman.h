@@ -60,7 +60,27 @@ struct hufftable {
   unsigned int startbits;
 };
 
+/*
+ * Direct lookup form of the pair tables, generated into huffman_lut.dat.
+ * An entry either resolves a code (0 | len:5 | x:4 | y:4) or links to a
+ * second level table (1 | bits:4 | offset:11).
+ */
+
+struct hufflut {
+  unsigned short const *table;
+  unsigned short linbits;
+  unsigned short bits;
+};
+
+# define HUFFLUT_LINK(e)	((e) & 0x8000)
+# define HUFFLUT_BITS(e)	(((e) >> 11) & 0x0f)
+# define HUFFLUT_OFFSET(e)	((e) & 0x07ff)
+# define HUFFLUT_LEN(e)		((e) >> 8)
+# define HUFFLUT_X(e)		(((e) >> 4) & 0x0f)
+# define HUFFLUT_Y(e)		((e) & 0x0f)
+
 extern union huffquad const *const mad_huff_quad_table[2];
 extern struct hufftable const mad_huff_pair_table[32];
+extern struct hufflut const mad_huff_lut_table[32];
 
 # endif
@@ -0,0 +1,326 @@
+/*
+ * libmad - MPEG audio decoder library
+ * Copyright (C) 2000-2004 Underbit Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+# ifdef HAVE_CONFIG_H
+#  include "config.h"
+# endif
+
+# include "global.h"
+
+# include <stdlib.h>
+# include <string.h>
+
+# include "bit.h"
+# include "stream.h"
+# include "frame.h"
+# include "timer.h"
+# include "xing.h"
+# include "index.h"
+
+/*
+ * NAME:	index->init()
+ * DESCRIPTION:	initialize index structure
+ */
+void ICACHE_FLASH_ATTR mad_index_init(struct mad_index *index)
+{
+  index->entry      = 0;
+  index->count      = 0;
+  index->alloc      = 0;
+
+  index->samples    = 0;
+  index->bytes      = 0;
+  index->samplerate = 0;
+  index->uniform    = 1;
+
+  mad_xing_init(&index->xing);
+}
+
+/*
+ * NAME:	index->finish()
+ * DESCRIPTION:	deallocate any dynamic memory associated with index
+ */
+void ICACHE_FLASH_ATTR mad_index_finish(struct mad_index *index)
+{
+  free(index->entry);
+
+  index->entry = 0;
+  index->count = 0;
+  index->alloc = 0;
+}
+
+/*
+ * NAME:	append()
+ * DESCRIPTION:	add an entry, growing the table as needed
+ */
+static
+struct mad_index_entry *ICACHE_FLASH_ATTR append(struct mad_index *index)
+{
+  if (index->count == index->alloc) {
+    struct mad_index_entry *entry;
+    unsigned long alloc;
+
+    alloc = index->alloc ? index->alloc * 2 : 256;
+    entry = realloc(index->entry, alloc * sizeof(*entry));
+    if (entry == 0)
+      return 0;
+
+    index->entry = entry;
+    index->alloc = alloc;
+  }
+
+  return &index->entry[index->count++];
+}
+
+/*
+ * NAME:	index->scan()
+ * DESCRIPTION:	index the frames of a stream buffer, 'base' being its offset
+ */
+int ICACHE_FLASH_ATTR mad_index_scan(struct mad_index *index,
+				     struct mad_stream *stream,
+				     unsigned long base)
+{
+  struct mad_header header;
+
+  mad_header_init(&header);
+
+  for (;;) {
+    struct mad_index_entry *entry;
+    unsigned int length, overhead, samples;
+
+    if (mad_header_decode(&header, stream) == -1) {
+      if (!MAD_RECOVERABLE(stream->error))
+	break;
+
+      continue;
+    }
+
+    length = stream->next_frame - stream->this_frame;
+
+    /* the first frame may be a tag, holding no audio */
+
+    if (index->samplerate == 0) {
+      index->samplerate = header.samplerate;
+
+      if (mad_xing_parse(&index->xing, &header,
+			 stream->this_frame, length) == 0)
+	continue;
+    }
+
+    /* header, CRC and side info come before main data */
+
+    if (header.flags & MAD_FLAG_LSF_EXT)
+      overhead = (header.mode == MAD_MODE_SINGLE_CHANNEL) ? 9 : 17;
+    else
+      overhead = (header.mode == MAD_MODE_SINGLE_CHANNEL) ? 17 : 32;
+
+    overhead += (header.flags & MAD_FLAG_PROTECTION) ? 6 : 4;
+
+    if (length < overhead)
+      continue;
+
+    entry = append(index);
+    if (entry == 0) {
+      stream->error = MAD_ERROR_NOMEM;
+      return -1;
+    }
+
+    samples = 32 * MAD_NSBSAMPLES(&header);
+
+    entry->offset  = base + (stream->this_frame - stream->buffer);
+    entry->length  = length;
+    entry->samples = samples;
+
+    /* main_data_begin opens the side info, just after the CRC */
+
+    entry->main_data_begin =
+      mad_bit_read(&stream->ptr, (header.flags & MAD_FLAG_LSF_EXT) ? 8 : 9);
+    entry->main_data = length - overhead;
+
+    if (index->count > 1 && samples != index->entry[0].samples)
+      index->uniform = 0;
+
+    index->samples += samples;
+    index->bytes   += length;
+  }
+
+  return 0;
+}
+
+/*
+ * NAME:	index->build()
+ * DESCRIPTION:	index a whole stream held in memory
+ */
+int ICACHE_FLASH_ATTR mad_index_build(struct mad_index *index,
+				      unsigned char const *data,
+				      unsigned long length)
+{
+  struct mad_stream stream;
+  unsigned char *tail;
+  unsigned long done, rest;
+  int result = 0;
+
+  mad_stream_init(&stream);
+  mad_stream_buffer(&stream, data, length);
+
+  if (mad_index_scan(index, &stream, 0) == -1)
+    goto done;
+
+  /*
+   * Frames are only decoded with MAD_BUFFER_GUARD bytes after them, so
+   * the frames at the very end are indexed from a padded copy.
+   */
+
+  done = stream.next_frame - data;
+  rest = length - done;
+
+  if (rest == 0)
+    goto done;
+
+  tail = malloc(rest + MAD_BUFFER_GUARD);
+  if (tail == 0) {
+    result = -1;
+    goto done;
+  }
+
+  memcpy(tail, data + done, rest);
+  memset(tail + rest, 0, MAD_BUFFER_GUARD);
+
+  mad_stream_buffer(&stream, tail, rest + MAD_BUFFER_GUARD);
+  result = mad_index_scan(index, &stream, done);
+
+  free(tail);
+
+ done:
+  if (stream.error == MAD_ERROR_NOMEM)
+    result = -1;
+
+  mad_stream_finish(&stream);
+
+  return result;
+}
+
+/*
+ * NAME:	index->duration()
+ * DESCRIPTION:	compute the playing time of the indexed frames
+ */
+int ICACHE_FLASH_ATTR mad_index_duration(struct mad_index const *index,
+					 mad_timer_t *duration)
+{
+  unsigned long samples, trim = 0;
+
+  if (index->count == 0)
+    return -1;
+
+  samples = index->samples;
+
+  /* less the encoder delay and padding, for gapless playback */
+
+  if (index->xing.flags & MAD_XING_LAME)
+    trim = index->xing.delay + index->xing.padding;
+
+  mad_timer_set(duration, 0, samples > trim ? samples - trim : 0,
+		index->samplerate);
+
+  return 0;
+}
+
+/*
+ * NAME:	index->bitrate()
+ * DESCRIPTION:	return the average bitrate of the indexed frames (bps)
+ */
+unsigned long ICACHE_FLASH_ATTR mad_index_bitrate(struct mad_index const *index)
+{
+  if (index->samples == 0)
+    return 0;
+
+  return (unsigned long long) index->bytes * 8 * index->samplerate /
+    index->samples;
+}
+
+/*
+ * NAME:	index->find()
+ * DESCRIPTION:	return the frame playing at a position, or -1 past the end
+ */
+long ICACHE_FLASH_ATTR mad_index_find(struct mad_index const *index,
+				      mad_timer_t position)
+{
+  unsigned long sample, at, i;
+
+  if (index->count == 0)
+    return -1;
+
+  /* the MPEG sampling frequencies all have a unit of their own */
+
+  sample = mad_timer_sign(position) < 0 ?
+    0 : mad_timer_count(position, (enum mad_units) index->samplerate);
+
+  if (sample >= index->samples)
+    return -1;
+
+  if (index->uniform)
+    return sample / index->entry[0].samples;
+
+  for (i = 0, at = 0; at + index->entry[i].samples <= sample; ++i)
+    at += index->entry[i].samples;
+
+  return i;
+}
+
+/*
+ * NAME:	reservoir()
+ * DESCRIPTION:	return the first frame holding main data of a frame
+ */
+static
+unsigned long ICACHE_FLASH_ATTR reservoir(struct mad_index const *index, unsigned long frame)
+{
+  unsigned long need;
+
+  need = index->entry[frame].main_data_begin;
+
+  while (need && frame > 0) {
+    --frame;
+
+    if (index->entry[frame].main_data >= need)
+      break;
+
+    need -= index->entry[frame].main_data;
+  }
+
+  return frame;
+}
+
+/*
+ * NAME:	index->preroll()
+ * DESCRIPTION:	return the frame to start decoding from to play a frame
+ */
+unsigned long ICACHE_FLASH_ATTR mad_index_preroll(struct mad_index const *index,
+						  unsigned long frame)
+{
+  unsigned long first, prev;
+
+  if (frame == 0 || frame >= index->count)
+    return frame;
+
+  /* the frame's own main data, and that of the frame before for overlap */
+
+  first = reservoir(index, frame);
+  prev  = reservoir(index, frame - 1);
+
+  return prev < first ? prev : first;
+}
@@ -0,0 +1,69 @@
+/*
+ * libmad - MPEG audio decoder library
+ * Copyright (C) 2000-2004 Underbit Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+# ifndef LIBMAD_INDEX_H
+# define LIBMAD_INDEX_H
+
+# include "stream.h"
+# include "frame.h"
+# include "timer.h"
+# include "xing.h"
+
+/*
+ * Frame index of a stream, built from the frame headers and the
+ * main_data_begin field of the side info alone; no audio is decoded.
+ * It gives the exact duration and average bitrate of a stream, and the
+ * frame to start decoding from to reach a position with the bit
+ * reservoir and the overlap of the previous frame complete.
+ */
+
+struct mad_index_entry {
+  unsigned long offset;			/* of the frame in the stream */
+  unsigned short length;		/* frame bytes */
+  unsigned short samples;		/* PCM samples per channel */
+  unsigned short main_data_begin;	/* reservoir bytes the frame reads */
+  unsigned short main_data;		/* main data bytes the frame carries */
+};
+
+struct mad_index {
+  struct mad_index_entry *entry;	/* indexed audio frames */
+  unsigned long count;			/* entries in use */
+  unsigned long alloc;			/* entries allocated */
+
+  unsigned long samples;		/* samples of the indexed frames */
+  unsigned long bytes;			/* bytes of the indexed frames */
+  unsigned int samplerate;		/* of the first frame */
+  int uniform;				/* all frames are of equal samples */
+
+  struct mad_xing xing;			/* tag of the first frame, if any */
+};
+
+void mad_index_init(struct mad_index *);
+void mad_index_finish(struct mad_index *);
+
+int mad_index_scan(struct mad_index *, struct mad_stream *, unsigned long);
+int mad_index_build(struct mad_index *, unsigned char const *, unsigned long);
+
+int mad_index_duration(struct mad_index const *, mad_timer_t *);
+unsigned long mad_index_bitrate(struct mad_index const *);
+
+long mad_index_find(struct mad_index const *, mad_timer_t);
+unsigned long mad_index_preroll(struct mad_index const *, unsigned long);
+
+# endif
@@ -45,8 +45,20 @@
 # include "frame.h"
 # include "huffman.h"
 # include "layer3.h"
+# include "profile.h"
+# include "simd.h"
 #include "align.h"
 
+/* vector IMDCT for host builds, see III_imdct_simd() */
+# if defined(MAD_SIMD) && !defined(ASO_IMDCT)
+#  define IMDCT_SIMD
+# endif
+
+/* band-wise requantization for x86 host builds, see III_requantize_bands() */
+# if defined(MAD_SIMD) && !defined(FPM_FLOAT) && !defined(__ARM_NEON)
+#  define REQUANT_SIMD
+# endif
+
 
 /* --- Layer III ----------------------------------------------------------- */
 
@@ -334,8 +346,13 @@ unsigned char const pretab[22] = {
  */
 static
 struct fixedfloat {
+# if defined(REQUANT_SIMD) || defined(FPM_FLOAT)
+  mad_fixed_t mantissa;		/* whole words, so lanes can gather them */
+  signed int exponent;		/* (and a float does not fit a bitfield) */
+# else
   unsigned long mantissa  : 27;
   unsigned short exponent :  5;
+# endif
 } const ICACHE_RODATA_ATTR rq_table[8207] = {
 # include "rq_table.dat"
 };
@@ -896,6 +913,27 @@ mad_fixed_t ICACHE_FLASH_ATTR III_requantize(unsigned int value, signed int exp)
   requantized = power->mantissa;
   exp += power->exponent;
 
+# if defined(FPM_FLOAT)
+  if (exp < -126) {
+    /* underflow */
+    requantized = 0;
+  }
+  else {
+    union {
+      float f;
+      unsigned int bits;
+    } scale;
+
+    /* 2^exp, built directly in the exponent field */
+    scale.bits = (unsigned int) (exp + 127) << 23;
+    requantized *= scale.f;
+
+    if (requantized > MAD_F_MAX) {
+      /* overflow */
+      requantized = MAD_F_MAX;
+    }
+  }
+# else
   if (exp < 0) {
     if (-exp >= sizeof(mad_fixed_t) * CHAR_BIT) {
       /* underflow */
@@ -918,15 +956,162 @@ mad_fixed_t ICACHE_FLASH_ATTR III_requantize(unsigned int value, signed int exp)
     else
       requantized <<= exp;
   }
+# endif
 
   return frac ? mad_f_mul(requantized, root_table[3 + frac]) : requantized;
 }
 
+# if defined(REQUANT_SIMD)
+/*
+ * NAME:	III_requantize_v8()
+ * DESCRIPTION:	requantize eight values from their x^(4/3) mantissas and
+ *		exponents, as III_requantize()
+ */
+static inline __attribute__((target("avx2")))
+__m256i III_requantize_v8(__m256i m, __m256i e, signed int frac)
+{
+  __m256i const one  = _mm256_set1_epi32(1);
+  __m256i const zero = _mm256_setzero_si256();
+  __m256i neg, right, left, r;
+
+  /* round to nearest on the way down; counts of 32 and more give 0 */
+  neg   = _mm256_sub_epi32(zero, e);
+  right = _mm256_srlv_epi32(_mm256_add_epi32(m, _mm256_sllv_epi32(one,
+					   _mm256_sub_epi32(neg, one))), neg);
+  left  = _mm256_blendv_epi8(_mm256_sllv_epi32(m, e),
+			     _mm256_set1_epi32(MAD_F_MAX),
+			     _mm256_cmpgt_epi32(e, _mm256_set1_epi32(4)));
+  r = _mm256_blendv_epi8(left, right, _mm256_cmpgt_epi32(zero, e));
+
+  return frac ? (__m256i) mul_v8_avx2((dct_v8) r, root_table[3 + frac]) : r;
+}
+
+/*
+ * NAME:	III_requantize_x8_avx2()
+ * DESCRIPTION:	requantize the n signed lines of one band
+ */
+static __attribute__((target("avx2")))
+void III_requantize_x8_avx2(mad_fixed_t *xr, unsigned int n,
+			    signed int exp, signed int frac)
+{
+  __m256i const lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  __m256i const base = _mm256_set1_epi32(exp);
+  int const *mant = (int const *) &rq_table[0].mantissa;
+  int const *expo = (int const *) &rq_table[0].exponent;
+  __m256i rq_small[4], lo, hi, mask, x, v, r;
+  unsigned int i;
+
+  /* mantissas and exponents of 0..7 and 8..15, split out of rq_table */
+  for (i = 0; i < 2; ++i) {
+    __m256 a = _mm256_loadu_ps((float const *) &rq_table[8 * i + 0]);
+    __m256 b = _mm256_loadu_ps((float const *) &rq_table[8 * i + 4]);
+
+    rq_small[2 * i + 0] =
+      _mm256_permute4x64_epi64(_mm256_castps_si256(_mm256_shuffle_ps(a, b,
+	_MM_SHUFFLE(2, 0, 2, 0))), _MM_SHUFFLE(3, 1, 2, 0));
+    rq_small[2 * i + 1] =
+      _mm256_permute4x64_epi64(_mm256_castps_si256(_mm256_shuffle_ps(a, b,
+	_MM_SHUFFLE(3, 1, 3, 1))), _MM_SHUFFLE(3, 1, 2, 0));
+  }
+
+  /* the band's table of the values 0..15, which make up most lines */
+  lo = III_requantize_v8(rq_small[0], _mm256_add_epi32(rq_small[1], base),
+			 frac);
+  hi = III_requantize_v8(rq_small[2], _mm256_add_epi32(rq_small[3], base),
+			 frac);
+
+  for (i = 0; i < n; i += 8) {
+    /* the last vector of a band must not touch the next band */
+    mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(n - i), lane);
+    x = _mm256_maskload_epi32((int const *) &xr[i], mask);
+    v = _mm256_abs_epi32(x);
+
+    if (_mm256_testz_si256(v, _mm256_set1_epi32(~15))) {
+      r = _mm256_blendv_epi8(_mm256_permutevar8x32_epi32(lo, v),
+			     _mm256_permutevar8x32_epi32(hi, v),
+			     _mm256_cmpgt_epi32(v, _mm256_set1_epi32(7)));
+    }
+    else {
+      r = III_requantize_v8(_mm256_i32gather_epi32(mant, v, 8),
+			    _mm256_add_epi32(_mm256_i32gather_epi32(expo, v, 8),
+					     base), frac);
+    }
+
+    /* zero lines stay zero, negative lines are negated */
+    _mm256_maskstore_epi32((int *) &xr[i], mask, _mm256_sign_epi32(r, x));
+  }
+}
+
+/*
+ * NAME:	III_requantize_bands()
+ * DESCRIPTION:	requantize the signed integer lines left by III_huffdecode()
+ */
+static
+void III_requantize_bands(mad_fixed_t xr[576], unsigned char const *sfbwidth,
+			  signed int const *exponents, unsigned int lines)
+{
+  unsigned int l, end, reqhits, value;
+  mad_fixed_t reqcache[16], requantized;
+  signed int exp;
+  int avx2;
+
+  avx2 = __builtin_cpu_supports("avx2");
+
+  for (l = 0; l < lines; l = end) {
+    end = l + unalChar(sfbwidth++);
+    if (end > lines)
+      end = lines;
+
+    exp = *exponents++;
+
+    /* the exponent is split once per band rather than once per line */
+    if (avx2) {
+      III_requantize_x8_avx2(&xr[l], end - l, exp / 4, exp % 4);
+      continue;
+    }
+
+    for (reqhits = 0; l < end; ++l) {
+      value = xr[l] < 0 ? -xr[l] : xr[l];
+      if (value == 0)
+	continue;
+
+      if (value >= 16)
+	requantized = III_requantize(value, exp);
+      else if (reqhits & (1 << value))
+	requantized = reqcache[value];
+      else {
+	reqhits |= (1 << value);
+	requantized = reqcache[value] = III_requantize(value, exp);
+      }
+
+      xr[l] = xr[l] < 0 ? -requantized : requantized;
+    }
+  }
+}
+
+/* the Huffman decoder only leaves the integer lines */
+#  define REQUANTIZE(value, exp)	((mad_fixed_t) (value))
+#  define REQCACHED(value, exp)		((mad_fixed_t) (value))
+# else
+#  define REQUANTIZE(value, exp)	III_requantize((value), (exp))
+#  define REQCACHED(value, exp)  \
+    ((reqhits & (1 << (value))) ? reqcache[value] :  \
+     (reqhits |= (1 << (value)), reqcache[value] = III_requantize((value), (exp))))
+# endif
+
 /* we must take care that sz >= bits and sz < sizeof(long) lest bits == 0 */
 # define MASK(cache, sz, bits)	\
     (((cache) >> ((sz) - (bits))) & ((1 << (bits)) - 1))
 # define MASK1BIT(cache, sz)  \
-    ((cache) & (1 << ((sz) - 1)))
+    (((cache) >> ((sz) - 1)) & 1)
+
+/* apply a sign bit; a float select would branch on each (random) sign */
+# if defined(FPM_FLOAT)
+static mad_fixed_t const sign_table[2] = { 1, -1 };
+#  define SIGNED(value, bit)	((value) * sign_table[bit])
+# else
+#  define SIGNED(value, bit)	((bit) ? -(value) : (value))
+# endif
 
 /*
  * NAME:	III_huffdecode()
@@ -940,11 +1125,18 @@ enum mad_error ICACHE_FLASH_ATTR III_huffdecode(struct mad_bitptr *ptr, mad_fixe
 {
   signed int exponents[39], exp;
   signed int const *expptr;
+# if defined(REQUANT_SIMD)
+  unsigned char const *bandwidth = sfbwidth;
+# endif
   struct mad_bitptr peek;
   signed int bits_left, cachesz;
   register mad_fixed_t *xrptr;
   mad_fixed_t const *sfbound;
+# if ENABLE(HUFF_LUT)
+  register unsigned long long bitcache;
+# else
   register unsigned long bitcache;
+# endif
 
   bits_left = (signed) channel->part2_3_length - (signed) part2_length;
   if (bits_left < 0)
@@ -967,31 +1159,53 @@ enum mad_error ICACHE_FLASH_ATTR III_huffdecode(struct mad_bitptr *ptr, mad_fixe
   /* big_values */
   {
     unsigned int region, rcount;
+# if ENABLE(HUFF_LUT)
+    struct hufflut const *entry;
+    unsigned short const *table;
+# else
     struct hufftable const *entry;
     union huffpair const *table;
-    unsigned int linbits, startbits, big_values, reqhits;
+# endif
+    unsigned int linbits, startbits, big_values;
+# if !defined(REQUANT_SIMD)
+    unsigned int reqhits;
     mad_fixed_t reqcache[16];
+# endif
 
     sfbound = xrptr + unalChar(sfbwidth++);
     rcount  = channel->region0_count + 1;
 
+# if ENABLE(HUFF_LUT)
+    entry     = &mad_huff_lut_table[channel->table_select[region = 0]];
+    table     = entry->table;
+    linbits   = entry->linbits;
+    startbits = entry->bits;
+# else
     entry     = &mad_huff_pair_table[channel->table_select[region = 0]];
     table     = entry->table;
     linbits   = entry->linbits;
     startbits = entry->startbits;
+# endif
 
     if (table == 0)
       return MAD_ERROR_BADHUFFTABLE;
 
     expptr  = &exponents[0];
     exp     = *expptr++;
+# if !defined(REQUANT_SIMD)
     reqhits = 0;
+# endif
 
     big_values = channel->big_values;
 
     while (big_values-- && cachesz + bits_left > 0) {
+# if ENABLE(HUFF_LUT)
+      unsigned int hcod;
+# else
       union huffpair const *pair;
-      unsigned int clumpsz, value;
+      unsigned int clumpsz;
+# endif
+      unsigned int value, x, y;
       register mad_fixed_t requantized;
 
       if (xrptr == sfbound) {
@@ -1005,10 +1219,17 @@ enum mad_error ICACHE_FLASH_ATTR III_huffdecode(struct mad_bitptr *ptr, mad_fixe
 	  else
 	    rcount = 0;  /* all remaining */
 
+# if ENABLE(HUFF_LUT)
+	  entry     = &mad_huff_lut_table[channel->table_select[++region]];
+	  table     = entry->table;
+	  linbits   = entry->linbits;
+	  startbits = entry->bits;
+# else
 	  entry     = &mad_huff_pair_table[channel->table_select[++region]];
 	  table     = entry->table;
 	  linbits   = entry->linbits;
 	  startbits = entry->startbits;
+# endif
 
 	  if (table == 0)
 	    return MAD_ERROR_BADHUFFTABLE;
@@ -1016,12 +1237,41 @@ enum mad_error ICACHE_FLASH_ATTR III_huffdecode(struct mad_bitptr *ptr, mad_fixe
 
 	if (exp != *expptr) {
 	  exp = *expptr;
+# if !defined(REQUANT_SIMD)
 	  reqhits = 0;
+# endif
 	}
 
 	++expptr;
       }
 
+# if ENABLE(HUFF_LUT)
+      /*
+       * One refill covers the longest pair: hcod (19) plus linbits and
+       * sign for both values (2 * 14). Reads past part3 stay within the
+       * MAD_BUFFER_GUARD bits asserted below.
+       */
+      while (cachesz < 48 && bits_left > -48) {
+	bitcache   = (bitcache << 16) | mad_bit_read(&peek, 16);
+	cachesz   += 16;
+	bits_left -= 16;
+      }
+
+      /* hcod (0..19) */
+
+      hcod = table[MASK(bitcache, cachesz, startbits)];
+
+      if (HUFFLUT_LINK(hcod)) {
+	cachesz -= startbits;
+	hcod = table[HUFFLUT_OFFSET(hcod) +
+		     MASK(bitcache, cachesz, HUFFLUT_BITS(hcod))];
+      }
+
+      cachesz -= HUFFLUT_LEN(hcod);
+
+      x = HUFFLUT_X(hcod);
+      y = HUFFLUT_Y(hcod);
+# else
       if (cachesz < 21) {
 	unsigned int bits;
 
@@ -1045,10 +1295,14 @@ enum mad_error ICACHE_FLASH_ATTR III_huffdecode(struct mad_bitptr *ptr, mad_fixe
 
       cachesz -= pair->value.hlen;
 
+      x = pair->value.x;
+      y = pair->value.y;
+# endif
+
       if (linbits) {
 	/* x (0..14) */
 
-	value = pair->value.x;
+	value = x;
 
 	switch (value) {
 	case 0:
@@ -1065,25 +1319,19 @@ enum mad_error ICACHE_FLASH_ATTR III_huffdecode(struct mad_bitptr *ptr, mad_fixe
 	  value += MASK(bitcache, cachesz, linbits);
 	  cachesz -= linbits;
 
-	  requantized = III_requantize(value, exp);
+	  requantized = REQUANTIZE(value, exp);
 	  goto x_final;
 
 	default:
-	  if (reqhits & (1 << value))
-	    requantized = reqcache[value];
-	  else {
-	    reqhits |= (1 << value);
-	    requantized = reqcache[value] = III_requantize(value, exp);
-	  }
+	  requantized = REQCACHED(value, exp);
 
 	x_final:
-	  xrptr[0] = MASK1BIT(bitcache, cachesz--) ?
-	    -requantized : requantized;
+	  xrptr[0] = SIGNED(requantized, MASK1BIT(bitcache, cachesz--));
 	}
 
 	/* y (0..14) */
 
-	value = pair->value.y;
+	value = y;
 
 	switch (value) {
 	case 0:
@@ -1100,57 +1348,39 @@ enum mad_error ICACHE_FLASH_ATTR III_huffdecode(struct mad_bitptr *ptr, mad_fixe
 	  value += MASK(bitcache, cachesz, linbits);
 	  cachesz -= linbits;
 
-	  requantized = III_requantize(value, exp);
+	  requantized = REQUANTIZE(value, exp);
 	  goto y_final;
 
 	default:
-	  if (reqhits & (1 << value))
-	    requantized = reqcache[value];
-	  else {
-	    reqhits |= (1 << value);
-	    requantized = reqcache[value] = III_requantize(value, exp);
-	  }
+	  requantized = REQCACHED(value, exp);
 
 	y_final:
-	  xrptr[1] = MASK1BIT(bitcache, cachesz--) ?
-	    -requantized : requantized;
+	  xrptr[1] = SIGNED(requantized, MASK1BIT(bitcache, cachesz--));
 	}
       }
       else {
 	/* x (0..1) */
 
-	value = pair->value.x;
+	value = x;
 
 	if (value == 0)
 	  xrptr[0] = 0;
 	else {
-	  if (reqhits & (1 << value))
-	    requantized = reqcache[value];
-	  else {
-	    reqhits |= (1 << value);
-	    requantized = reqcache[value] = III_requantize(value, exp);
-	  }
+	  requantized = REQCACHED(value, exp);
 
-	  xrptr[0] = MASK1BIT(bitcache, cachesz--) ?
-	    -requantized : requantized;
+	  xrptr[0] = SIGNED(requantized, MASK1BIT(bitcache, cachesz--));
 	}
 
 	/* y (0..1) */
 
-	value = pair->value.y;
+	value = y;
 
 	if (value == 0)
 	  xrptr[1] = 0;
 	else {
-	  if (reqhits & (1 << value))
-	    requantized = reqcache[value];
-	  else {
-	    reqhits |= (1 << value);
-	    requantized = reqcache[value] = III_requantize(value, exp);
-	  }
+	  requantized = REQCACHED(value, exp);
 
-	  xrptr[1] = MASK1BIT(bitcache, cachesz--) ?
-	    -requantized : requantized;
+	  xrptr[1] = SIGNED(requantized, MASK1BIT(bitcache, cachesz--));
 	}
       }
 
@@ -1168,7 +1398,7 @@ enum mad_error ICACHE_FLASH_ATTR III_huffdecode(struct mad_bitptr *ptr, mad_fixe
 
     table = mad_huff_quad_table[channel->flags & count1table_select];
 
-    requantized = III_requantize(1, exp);
+    requantized = REQUANTIZE(1, exp);
 
     while (cachesz + bits_left > 0 && xrptr <= &xr[572]) {
       union huffquad const *quad;
@@ -1198,7 +1428,7 @@ enum mad_error ICACHE_FLASH_ATTR III_huffdecode(struct mad_bitptr *ptr, mad_fixe
 
 	if (exp != *expptr) {
 	  exp = *expptr;
-	  requantized = III_requantize(1, exp);
+	  requantized = REQUANTIZE(1, exp);
 	}
 
 	++expptr;
@@ -1207,12 +1437,12 @@ enum mad_error ICACHE_FLASH_ATTR III_huffdecode(struct mad_bitptr *ptr, mad_fixe
       /* v (0..1) */
 
       xrptr[0] = quad->value.v ?
-	(MASK1BIT(bitcache, cachesz--) ? -requantized : requantized) : 0;
+	SIGNED(requantized, MASK1BIT(bitcache, cachesz--)) : 0;
 
       /* w (0..1) */
 
       xrptr[1] = quad->value.w ?
-	(MASK1BIT(bitcache, cachesz--) ? -requantized : requantized) : 0;
+	SIGNED(requantized, MASK1BIT(bitcache, cachesz--)) : 0;
 
       xrptr += 2;
 
@@ -1221,7 +1451,7 @@ enum mad_error ICACHE_FLASH_ATTR III_huffdecode(struct mad_bitptr *ptr, mad_fixe
 
 	if (exp != *expptr) {
 	  exp = *expptr;
-	  requantized = III_requantize(1, exp);
+	  requantized = REQUANTIZE(1, exp);
 	}
 
 	++expptr;
@@ -1230,12 +1460,12 @@ enum mad_error ICACHE_FLASH_ATTR III_huffdecode(struct mad_bitptr *ptr, mad_fixe
       /* x (0..1) */
 
       xrptr[0] = quad->value.x ?
-	(MASK1BIT(bitcache, cachesz--) ? -requantized : requantized) : 0;
+	SIGNED(requantized, MASK1BIT(bitcache, cachesz--)) : 0;
 
       /* y (0..1) */
 
       xrptr[1] = quad->value.y ?
-	(MASK1BIT(bitcache, cachesz--) ? -requantized : requantized) : 0;
+	SIGNED(requantized, MASK1BIT(bitcache, cachesz--)) : 0;
 
       xrptr += 2;
     }
@@ -1262,6 +1492,10 @@ enum mad_error ICACHE_FLASH_ATTR III_huffdecode(struct mad_bitptr *ptr, mad_fixe
     fprintf(stderr, "%d stuffing bits\n", cachesz + bits_left);
 # endif
 
+# if defined(REQUANT_SIMD)
+  III_requantize_bands(xr, bandwidth, exponents, xrptr - xr);
+# endif
+
   /* rzero */
   while (xrptr < &xr[576]) {
     xrptr[0] = 0;
@@ -1275,6 +1509,9 @@ enum mad_error ICACHE_FLASH_ATTR III_huffdecode(struct mad_bitptr *ptr, mad_fixe
 
 # undef MASK
 # undef MASK1BIT
+# undef SIGNED
+# undef REQUANTIZE
+# undef REQCACHED
 
 /*
  * NAME:	III_reorder()
@@ -1579,191 +1816,15 @@ void ICACHE_FLASH_ATTR III_aliasreduce(mad_fixed_t xr[576], int lines)
 void III_imdct_l(mad_fixed_t const [18], mad_fixed_t [36], unsigned int);
 # else
 #  if 1
-static
-void ICACHE_FLASH_ATTR fastsdct(mad_fixed_t const x[9], mad_fixed_t y[18])
-{
-  mad_fixed_t a0,  a1,  a2,  a3,  a4,  a5,  a6,  a7,  a8,  a9,  a10, a11, a12;
-  mad_fixed_t a13, a14, a15, a16, a17, a18, a19, a20, a21, a22, a23, a24, a25;
-  mad_fixed_t m0,  m1,  m2,  m3,  m4,  m5,  m6,  m7;
-
-  enum {
-    c0 =  MAD_F(0x1f838b8d),  /* 2 * cos( 1 * PI / 18) */
-    c1 =  MAD_F(0x1bb67ae8),  /* 2 * cos( 3 * PI / 18) */
-    c2 =  MAD_F(0x18836fa3),  /* 2 * cos( 4 * PI / 18) */
-    c3 =  MAD_F(0x1491b752),  /* 2 * cos( 5 * PI / 18) */
-    c4 =  MAD_F(0x0af1d43a),  /* 2 * cos( 7 * PI / 18) */
-    c5 =  MAD_F(0x058e86a0),  /* 2 * cos( 8 * PI / 18) */
-    c6 = -MAD_F(0x1e11f642)   /* 2 * cos(16 * PI / 18) */
-  };
-
-  a0 = x[3] + x[5];
-  a1 = x[3] - x[5];
-  a2 = x[6] + x[2];
-  a3 = x[6] - x[2];
-  a4 = x[1] + x[7];
-  a5 = x[1] - x[7];
-  a6 = x[8] + x[0];
-  a7 = x[8] - x[0];
-
-  a8  = a0  + a2;
-  a9  = a0  - a2;
-  a10 = a0  - a6;
-  a11 = a2  - a6;
-  a12 = a8  + a6;
-  a13 = a1  - a3;
-  a14 = a13 + a7;
-  a15 = a3  + a7;
-  a16 = a1  - a7;
-  a17 = a1  + a3;
-
-  m0 = mad_f_mul(a17, -c3);
-  m1 = mad_f_mul(a16, -c0);
-  m2 = mad_f_mul(a15, -c4);
-  m3 = mad_f_mul(a14, -c1);
-  m4 = mad_f_mul(a5,  -c1);
-  m5 = mad_f_mul(a11, -c6);
-  m6 = mad_f_mul(a10, -c5);
-  m7 = mad_f_mul(a9,  -c2);
-
-  a18 =     x[4] + a4;
-  a19 = 2 * x[4] - a4;
-  a20 = a19 + m5;
-  a21 = a19 - m5;
-  a22 = a19 + m6;
-  a23 = m4  + m2;
-  a24 = m4  - m2;
-  a25 = m4  + m1;
-
-  /* output to every other slot for convenience */
-
-  y[ 0] = a18 + a12;
-  y[ 2] = m0  - a25;
-  y[ 4] = m7  - a20;
-  y[ 6] = m3;
-  y[ 8] = a21 - m6;
-  y[10] = a24 - m1;
-  y[12] = a12 - 2 * a18;
-  y[14] = a23 + m0;
-  y[16] = a22 + m7;
-}
-
-static inline
-void ICACHE_FLASH_ATTR sdctII(mad_fixed_t const x[18], mad_fixed_t X[18])
-{
-  mad_fixed_t tmp[9];
-  int i;
-
-  /* scale[i] = 2 * cos(PI * (2 * i + 1) / (2 * 18)) */
-  static mad_fixed_t const scale[9] = {
-    MAD_F(0x1fe0d3b4), MAD_F(0x1ee8dd47), MAD_F(0x1d007930),
-    MAD_F(0x1a367e59), MAD_F(0x16a09e66), MAD_F(0x125abcf8),
-    MAD_F(0x0d8616bc), MAD_F(0x08483ee1), MAD_F(0x02c9fad7)
-  };
-
-  /* divide the 18-point SDCT-II into two 9-point SDCT-IIs */
-
-  /* even input butterfly */
-
-  for (i = 0; i < 9; i += 3) {
-    tmp[i + 0] = x[i + 0] + x[18 - (i + 0) - 1];
-    tmp[i + 1] = x[i + 1] + x[18 - (i + 1) - 1];
-    tmp[i + 2] = x[i + 2] + x[18 - (i + 2) - 1];
-  }
-
-  fastsdct(tmp, &X[0]);
-
-  /* odd input butterfly and scaling */
-
-  for (i = 0; i < 9; i += 3) {
-    tmp[i + 0] = mad_f_mul(x[i + 0] - x[18 - (i + 0) - 1], scale[i + 0]);
-    tmp[i + 1] = mad_f_mul(x[i + 1] - x[18 - (i + 1) - 1], scale[i + 1]);
-    tmp[i + 2] = mad_f_mul(x[i + 2] - x[18 - (i + 2) - 1], scale[i + 2]);
-  }
-
-  fastsdct(tmp, &X[1]);
-
-  /* output accumulation */
-
-  for (i = 3; i < 18; i += 8) {
-    X[i + 0] -= X[(i + 0) - 2];
-    X[i + 2] -= X[(i + 2) - 2];
-    X[i + 4] -= X[(i + 4) - 2];
-    X[i + 6] -= X[(i + 6) - 2];
-  }
-}
-
-static inline
-void ICACHE_FLASH_ATTR dctIV(mad_fixed_t const y[18], mad_fixed_t X[18])
-{
-  mad_fixed_t tmp[18];
-  int i;
-
-  /* scale[i] = 2 * cos(PI * (2 * i + 1) / (4 * 18)) */
-  static mad_fixed_t const scale[18] = {
-    MAD_F(0x1ff833fa), MAD_F(0x1fb9ea93), MAD_F(0x1f3dd120),
-    MAD_F(0x1e84d969), MAD_F(0x1d906bcf), MAD_F(0x1c62648b),
-    MAD_F(0x1afd100f), MAD_F(0x1963268b), MAD_F(0x1797c6a4),
-    MAD_F(0x159e6f5b), MAD_F(0x137af940), MAD_F(0x11318ef3),
-    MAD_F(0x0ec6a507), MAD_F(0x0c3ef153), MAD_F(0x099f61c5),
-    MAD_F(0x06ed12c5), MAD_F(0x042d4544), MAD_F(0x0165547c)
-  };
-
-  /* scaling */
-
-  for (i = 0; i < 18; i += 3) {
-    tmp[i + 0] = mad_f_mul(y[i + 0], scale[i + 0]);
-    tmp[i + 1] = mad_f_mul(y[i + 1], scale[i + 1]);
-    tmp[i + 2] = mad_f_mul(y[i + 2], scale[i + 2]);
-  }
-
-  /* SDCT-II */
-
-  sdctII(tmp, X);
-
-  /* scale reduction and output accumulation */
-
-  X[0] /= 2;
-  for (i = 1; i < 17; i += 4) {
-    X[i + 0] = X[i + 0] / 2 - X[(i + 0) - 1];
-    X[i + 1] = X[i + 1] / 2 - X[(i + 1) - 1];
-    X[i + 2] = X[i + 2] / 2 - X[(i + 2) - 1];
-    X[i + 3] = X[i + 3] / 2 - X[(i + 3) - 1];
-  }
-  X[17] = X[17] / 2 - X[16];
-}
-
-/*
- * NAME:	imdct36
- * DESCRIPTION:	perform X[18]->x[36] IMDCT using Szu-Wei Lee's fast algorithm
- */
-static inline
-void ICACHE_FLASH_ATTR imdct36(mad_fixed_t const x[18], mad_fixed_t y[36])
-{
-  mad_fixed_t tmp[18];
-  int i;
-
-  /* DCT-IV */
-
-  dctIV(x, tmp);
-
-  /* convert 18-point DCT-IV to 36-point IMDCT */
-
-  for (i =  0; i <  9; i += 3) {
-    y[i + 0] =  tmp[9 + (i + 0)];
-    y[i + 1] =  tmp[9 + (i + 1)];
-    y[i + 2] =  tmp[9 + (i + 2)];
-  }
-  for (i =  9; i < 27; i += 3) {
-    y[i + 0] = -tmp[36 - (9 + (i + 0)) - 1];
-    y[i + 1] = -tmp[36 - (9 + (i + 1)) - 1];
-    y[i + 2] = -tmp[36 - (9 + (i + 2)) - 1];
-  }
-  for (i = 27; i < 36; i += 3) {
-    y[i + 0] = -tmp[(i + 0) - 27];
-    y[i + 1] = -tmp[(i + 1) - 27];
-    y[i + 2] = -tmp[(i + 2) - 27];
-  }
-}
+#   define IMDCT_T		mad_fixed_t
+#   define IMDCT_FN(name)	name
+#   define IMDCT_ATTR		ICACHE_FLASH_ATTR
+#   define MUL(x, y)		mad_f_mul((x), (y))
+#   include "imdct36.dat"
+#   undef MUL
+#   undef IMDCT_ATTR
+#   undef IMDCT_FN
+#   undef IMDCT_T
 #  else
 /*
  * NAME:	imdct36
@@ -2345,6 +2406,103 @@ void ICACHE_FLASH_ATTR III_freqinver(mad_fixed_t sample[18][32], unsigned int sb
 # endif
 }
 
+# if defined(IMDCT_SIMD)
+/*
+ * Vector IMDCT for host builds.
+ *
+ * Each lane of a vector carries one subband, so a group of 4 or 8 adjacent
+ * subbands goes through imdct36() or imdct12(), the window, the overlap-add
+ * and the frequency inversion together. The subband samples of a group are
+ * then contiguous in sample[i][sb..], and one store writes them. The
+ * transforms are those of imdct36.dat with vector multiplies from simd.h,
+ * so the output is bit-exact with the scalar FPM_64BIT path.
+ */
+typedef void (*imdct_lanes_t)(mad_fixed_t const *, unsigned int,
+			      mad_fixed_t [][18], mad_fixed_t [18][32],
+			      unsigned int);
+
+#  define IMDCT_LANES  4
+#  define IMDCT_T      dct_v4
+#  define IMDCT_LOAD(p, i)  \
+    ((dct_v4) { (p)[i], (p)[18 + (i)], (p)[36 + (i)], (p)[54 + (i)] })
+#  if defined(__ARM_NEON)
+#   define IMDCT_FN(name)	name##_x4_neon
+#   define IMDCT_ATTR
+#   define MUL(x, y)		mul_v4_neon((x), (y))
+#  else
+#   define IMDCT_FN(name)	name##_x4_sse41
+#   define IMDCT_ATTR		__attribute__((target("sse4.1")))
+#   define MUL(x, y)		mul_v4_sse41((x), (y))
+#  endif
+#  include "imdct36.dat"
+#  undef MUL
+#  undef IMDCT_ATTR
+#  undef IMDCT_FN
+#  undef IMDCT_LOAD
+#  undef IMDCT_T
+#  undef IMDCT_LANES
+
+#  if !defined(__ARM_NEON)
+#   define IMDCT_LANES		8
+#   define IMDCT_T		dct_v8
+#   define IMDCT_LOAD(p, i)  \
+    ((dct_v8) _mm256_i32gather_epi32((int const *) &(p)[i],  \
+	_mm256_setr_epi32(0, 18, 36, 54, 72, 90, 108, 126), 4))
+#   define IMDCT_FN(name)	name##_x8_avx2
+#   define IMDCT_ATTR		__attribute__((target("avx2")))
+#   define MUL(x, y)		mul_v8_avx2((x), (y))
+#   include "imdct36.dat"
+#   undef MUL
+#   undef IMDCT_ATTR
+#   undef IMDCT_FN
+#   undef IMDCT_LOAD
+#   undef IMDCT_T
+#   undef IMDCT_LANES
+#  endif
+
+/*
+ * NAME:	III_imdct_simd()
+ * DESCRIPTION:	run the vector kernels over subbands sb..sblimit - 1 and
+ *		return the first subband left for the scalar code
+ */
+static
+unsigned int III_imdct_simd(mad_fixed_t const xr[576], unsigned int block_type,
+			    mad_fixed_t overlap[32][18],
+			    mad_fixed_t sample[18][32],
+			    unsigned int sb, unsigned int sblimit)
+{
+  imdct_lanes_t wide = 0, narrow = 0;
+
+#  if defined(__ARM_NEON)
+  narrow = III_imdct_lanes_x4_neon;
+#  else
+  if (__builtin_cpu_supports("avx2"))
+    wide = III_imdct_lanes_x8_avx2;
+  if (__builtin_cpu_supports("sse4.1"))
+    narrow = III_imdct_lanes_x4_sse41;
+#  endif
+
+  /*
+   * A group may run past sblimit. The IMDCT of zero lines is zero, so those
+   * subbands come out just as III_overlap_z() would leave them.
+   */
+  while (sb < sblimit) {
+    if (wide && sb + 8 <= 32) {
+      wide(&xr[18 * sb], block_type, &overlap[sb], sample, sb);
+      sb += 8;
+    }
+    else if (narrow && sb + 4 <= 32) {
+      narrow(&xr[18 * sb], block_type, &overlap[sb], sample, sb);
+      sb += 4;
+    }
+    else
+      break;
+  }
+
+  return sb;
+}
+# endif  /* IMDCT_SIMD */
+
 /*
  * NAME:	III_decode()
  * DESCRIPTION:	decode frame main_data
@@ -2354,7 +2512,10 @@ enum mad_error ICACHE_FLASH_ATTR III_decode(struct mad_bitptr *ptr, struct mad_f
 			  struct sideinfo *si, unsigned int nch)
 {
   struct mad_header *header = &frame->header;
-  unsigned int sfreqi, ngr, gr;
+  unsigned int sfreqi, ngr, gr, single, sbmax;
+  MAD_PROFILE_DECL(clock);
+
+  MAD_PROFILE_START(clock);
 
   {
     unsigned int sfreq;
@@ -2372,6 +2533,18 @@ enum mad_error ICACHE_FLASH_ATTR III_decode(struct mad_bitptr *ptr, struct mad_f
       sfreqi += 3;
   }
 
+  /*
+   * With MAD_OPTION_LEFTCHANNEL or MAD_OPTION_RIGHTCHANNEL the other channel
+   * is decoded no further than the stereo processing it takes part in, and
+   * the one kept goes to sbsample[0]. MAD_OPTION_SINGLECHANNEL mixes both
+   * down there once they are subband samples. MAD_OPTION_HALFSAMPLERATE
+   * synthesizes the lower 16 subbands only, so the upper ones are zeroed
+   * ahead of the IMDCT rather than aliased into the output.
+   */
+
+  single = nch == 2 ? frame->options & MAD_OPTION_SINGLECHANNEL : 0;
+  sbmax  = (frame->options & MAD_OPTION_HALFSAMPLERATE) ? 16 : 32;
+
   /* scalefactors, Huffman decoding, requantization */
 
   ngr = (header->flags & MAD_FLAG_LSF_EXT) ? 1 : 2;
@@ -2408,6 +2581,8 @@ enum mad_error ICACHE_FLASH_ATTR III_decode(struct mad_bitptr *ptr, struct mad_f
 	return error;
     }
 
+    MAD_PROFILE_LAP(clock, MAD_STAGE_HUFFMAN);
+
     /* joint stereo processing */
 
     if (header->mode == MAD_MODE_JOINT_STEREO && header->mode_extension) {
@@ -2416,6 +2591,8 @@ enum mad_error ICACHE_FLASH_ATTR III_decode(struct mad_bitptr *ptr, struct mad_f
 	return error;
     }
 
+    MAD_PROFILE_LAP(clock, MAD_STAGE_STEREO);
+
     /* reordering, alias reduction, IMDCT, overlap-add, frequency inversion */
 
     for (ch = 0; ch < nch; ++ch) {
@@ -2424,6 +2601,14 @@ enum mad_error ICACHE_FLASH_ATTR III_decode(struct mad_bitptr *ptr, struct mad_f
       unsigned int sb, l, i, sblimit;
       mad_fixed_t output[36];
 
+      if (single == MAD_OPTION_LEFTCHANNEL && ch == 1)
+	break;
+      if (single == MAD_OPTION_RIGHTCHANNEL) {
+	if (ch == 0)
+	  continue;
+	sample = &frame->sbsample[0][18 * gr];
+      }
+
       if (channel->block_type == 2) {
 	III_reorder(xr[ch], channel, sfbwidth[ch]);
 
@@ -2440,7 +2625,10 @@ enum mad_error ICACHE_FLASH_ATTR III_decode(struct mad_bitptr *ptr, struct mad_f
 # endif
       }
       else
-	III_aliasreduce(xr[ch], 576);
+	III_aliasreduce(xr[ch], 18 * sbmax);
+
+      for (i = 18 * sbmax; i < 576; ++i)
+	xr[ch][i] = 0;
 
       l = 0;
 
@@ -2477,9 +2665,19 @@ enum mad_error ICACHE_FLASH_ATTR III_decode(struct mad_bitptr *ptr, struct mad_f
 
       sblimit = 32 - (576 - i) / 18;
 
+# if defined(IMDCT_SIMD)
+      if (!(frame->options & MAD_OPTION_NOSIMD)) {
+	sb = III_imdct_simd(xr[ch], channel->block_type, (*frame->overlap)[ch],
+			    sample, sb, sblimit);
+	l  = 18 * sb;
+	if (sblimit < sb)
+	  sblimit = sb;
+      }
+# endif
+
       if (channel->block_type != 2) {
 	/* long blocks */
-	for (sb = 2; sb < sblimit; ++sb, l += 18) {
+	for (; sb < sblimit; ++sb, l += 18) {
 	  III_imdct_l(&xr[ch][l], output, channel->block_type);
 	  III_overlap(output, (*frame->overlap)[ch][sb], sample, sb);
 
@@ -2489,7 +2687,7 @@ enum mad_error ICACHE_FLASH_ATTR III_decode(struct mad_bitptr *ptr, struct mad_f
       }
       else {
 	/* short blocks */
-	for (sb = 2; sb < sblimit; ++sb, l += 18) {
+	for (; sb < sblimit; ++sb, l += 18) {
 	  III_imdct_s(&xr[ch][l], output);
 	  III_overlap(output, (*frame->overlap)[ch][sb], sample, sb);
 
@@ -2507,6 +2705,22 @@ enum mad_error ICACHE_FLASH_ATTR III_decode(struct mad_bitptr *ptr, struct mad_f
 	  III_freqinver(sample, sb);
       }
     }
+
+    /* downmix */
+
+    if (single == MAD_OPTION_SINGLECHANNEL) {
+      mad_fixed_t (*left)[32]  = &frame->sbsample[0][18 * gr];
+      mad_fixed_t (*right)[32] = &frame->sbsample[1][18 * gr];
+      unsigned int s, sb;
+
+      for (s = 0; s < 18; ++s) {
+	for (sb = 0; sb < sbmax; ++sb)
+	  left[s][sb] = mad_f_mul(left[s][sb],  MAD_F(0x08000000)) +
+			mad_f_mul(right[s][sb], MAD_F(0x08000000));
+      }
+    }
+
+    MAD_PROFILE_LAP(clock, MAD_STAGE_IMDCT);
   }
 
   return MAD_ERROR_NONE;
@@ -2520,34 +2734,22 @@ int ICACHE_FLASH_ATTR mad_layer_III(struct mad_stream *stream, struct mad_frame
 {
   struct mad_header *header = &frame->header;
   unsigned int nch, priv_bitlen, next_md_begin = 0;
-  unsigned int si_len, data_bitlen, md_len;
+  unsigned int si_len, data_bitlen, md_len, md_avail = 0;
   unsigned int frame_space, frame_used, frame_free;
   struct mad_bitptr ptr;
   struct sideinfo si;
   enum mad_error error;
   int result = 0, i;
-  static mad_fixed_t ovlbuf[2 * 32 * 18];
+  MAD_PROFILE_DECL(clock);
 
-  /* allocate Layer III dynamic structures */
-    frame->overlap=(void*)ovlbuf;
-	stream->main_data=&MainData;
-/*
-  if (stream->main_data == 0) {
-    stream->main_data = malloc(MAD_BUFFER_MDLEN);
-    if (stream->main_data == 0) {
-      stream->error = MAD_ERROR_NOMEM;
-      return -1;
-    }
+  /* Layer III dynamic structures belong to the owner of the stream and
+     frame, which attaches them before decoding (see mpeg_decoder_open) */
+  if (stream->main_data == 0 || frame->overlap == 0) {
+    stream->error = MAD_ERROR_NOMEM;
+    return -1;
   }
 
-  if (frame->overlap == 0) {
-    frame->overlap = calloc(2 * 32 * 18, sizeof(mad_fixed_t));
-    if (frame->overlap == 0) {
-      stream->error = MAD_ERROR_NOMEM;
-      return -1;
-    }
-  }
-*/
+  MAD_PROFILE_START(clock);
 
   nch = MAD_NCHANNELS(header);
   si_len = (header->flags & MAD_FLAG_LSF_EXT) ?
@@ -2623,6 +2825,7 @@ int ICACHE_FLASH_ATTR mad_layer_III(struct mad_stream *stream, struct mad_frame
     stream->md_len = 0;
 
     frame_used = md_len;
+    md_avail   = frame_space;
   }
   else {
     if (si.main_data_begin > stream->md_len) {
@@ -2632,16 +2835,29 @@ int ICACHE_FLASH_ATTR mad_layer_III(struct mad_stream *stream, struct mad_frame
       }
     }
     else {
+      unsigned int md_copy;
+
       mad_bit_init(&ptr,
 		   *stream->main_data + stream->md_len - si.main_data_begin);
 
+      /*
+       * The rest of the frame goes in after the reservoir, with the bytes
+       * the next frame claims: only a frame whose part2_3_length runs over
+       * into them reads those, as it would in the stream buffer.
+       */
+      md_copy = MAD_BUFFER_MDLEN - MAD_BUFFER_GUARD - stream->md_len;
+      if (md_copy > frame_space)
+	md_copy = frame_space;
+
+      memcpy(*stream->main_data + stream->md_len,
+	     mad_bit_nextbyte(&stream->ptr), md_copy);
+      md_avail = si.main_data_begin + md_copy;
+
       if (md_len > si.main_data_begin) {
 	assert(stream->md_len + md_len -
 	       si.main_data_begin <= MAD_BUFFER_MDLEN);
 
-	memcpy(*stream->main_data + stream->md_len,
-	       mad_bit_nextbyte(&stream->ptr),
-	       frame_used = md_len - si.main_data_begin);
+	frame_used = md_len - si.main_data_begin;
 	stream->md_len += frame_used;
       }
     }
@@ -2649,8 +2865,17 @@ int ICACHE_FLASH_ATTR mad_layer_III(struct mad_stream *stream, struct mad_frame
 
   frame_free = frame_space - frame_used;
 
+  /* damaged side info can claim more audio data than the buffers hold */
+
+  if (result == 0 && data_bitlen > md_avail * CHAR_BIT) {
+    stream->error = MAD_ERROR_BADPART3LEN;
+    result = -1;
+  }
+
   /* decode main_data */
 
+  MAD_PROFILE_LAP(clock, MAD_STAGE_SIDEINFO);
+
   if (result == 0) {
     error = III_decode(&ptr, frame, &si, nch);
     if (error) {
@@ -2658,10 +2883,13 @@ int ICACHE_FLASH_ATTR mad_layer_III(struct mad_stream *stream, struct mad_frame
       result = -1;
     }
 
+    MAD_PROFILE_START(clock);
+
     /* designate ancillary bits */
 
     stream->anc_ptr    = ptr;
-    stream->anc_bitlen = md_len * CHAR_BIT - data_bitlen;
+    stream->anc_bitlen = data_bitlen < md_len * CHAR_BIT ?
+      md_len * CHAR_BIT - data_bitlen : 0;
   }
 
 # if 0 && defined(DEBUG)
@@ -2701,5 +2929,7 @@ int ICACHE_FLASH_ATTR mad_layer_III(struct mad_stream *stream, struct mad_frame
     stream->md_len += frame_free;
   }
 
+  MAD_PROFILE_LAP(clock, MAD_STAGE_SIDEINFO);
+
   return result;
 }
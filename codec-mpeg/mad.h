@@ -65,7 +65,12 @@ extern char const mad_build[];
 # ifndef LIBMAD_FIXED_H
 # define LIBMAD_FIXED_H
 
-# if SIZEOF_INT >= 4
+# if defined(FPM_FLOAT)
+typedef float mad_fixed_t;
+
+typedef float mad_fixed64hi_t;
+typedef float mad_fixed64lo_t;
+# elif SIZEOF_INT >= 4
 typedef   signed int mad_fixed_t;
 
 typedef   signed int mad_fixed64hi_t;
@@ -150,10 +155,32 @@ typedef mad_fixed_t mad_sample_t;
 # define mad_f_sub(x, y)	((x) - (y))
 
 # if defined(FPM_FLOAT)
-#  error "FPM_FLOAT not yet supported"
 
+/*
+ * Native single precision for hosts with an FPU. Values keep the scale of
+ * the fixed-point format (MAD_F_ONE is 1.0), so the tables are shared with
+ * the integer versions; products need no rescaling and sums do not wrap.
+ */
 #  undef MAD_F
-#  define MAD_F(x)		mad_f_todouble(x)
+#  define MAD_F(x)		((mad_fixed_t)  \
+				 ((x##L) / (double) (1L << MAD_F_FRACBITS)))
+
+#  undef MAD_F_MIN
+#  undef MAD_F_MAX
+#  define MAD_F_MIN		((mad_fixed_t) -8.0)
+#  define MAD_F_MAX		((mad_fixed_t) +8.0)
+
+#  undef mad_f_tofixed
+#  undef mad_f_todouble
+#  define mad_f_tofixed(x)	((mad_fixed_t) (x))
+#  define mad_f_todouble(x)	((double) (x))
+
+#  undef mad_f_intpart
+#  undef mad_f_fracpart
+#  undef mad_f_fromint
+#  define mad_f_intpart(x)	((signed long) (x))
+#  define mad_f_fracpart(x)	((x) - mad_f_intpart(x))
+#  define mad_f_fromint(x)	((mad_fixed_t) (x))
 
 #  define mad_f_mul(x, y)	((x) * (y))
 #  define mad_f_scale64
@@ -546,11 +573,21 @@ mad_fixed_t mad_f_div(mad_fixed_t, mad_fixed_t);
 # ifndef LIBMAD_BIT_H
 # define LIBMAD_BIT_H
 
+# include "portable.h"
+
+# if ENABLE(BIT_WORD_READ)
+struct mad_bitptr {
+  unsigned char const *byte;		/* next byte to enter the reservoir */
+  unsigned long long cache;		/* unread bits, MSB first */
+  unsigned short left;			/* valid bits in cache */
+};
+# else
 struct mad_bitptr {
   unsigned char const *byte;
   unsigned short cache;
   unsigned short left;
 };
+# endif
 
 void mad_bit_init(struct mad_bitptr *, unsigned char const *);
 
@@ -559,10 +596,15 @@ void mad_bit_init(struct mad_bitptr *, unsigned char const *);
 unsigned int mad_bit_length(struct mad_bitptr const *,
 			    struct mad_bitptr const *);
 
-# define mad_bit_bitsleft(bitptr)  ((bitptr)->left)
+# if ENABLE(BIT_WORD_READ)
+#  define mad_bit_bitsleft(bitptr)  ((((bitptr)->left - 1) & 7) + 1)
+# else
+#  define mad_bit_bitsleft(bitptr)  ((bitptr)->left)
+# endif
 unsigned char const *mad_bit_nextbyte(struct mad_bitptr const *);
 
 void mad_bit_skip(struct mad_bitptr *, unsigned int);
+unsigned long mad_bit_peek(struct mad_bitptr *, unsigned int);
 unsigned long mad_bit_read(struct mad_bitptr *, unsigned int);
 void mad_bit_write(struct mad_bitptr *, unsigned int, unsigned long);
 
@@ -658,7 +700,8 @@ void mad_timer_string(mad_timer_t, char *, char const *,
 # define LIBMAD_STREAM_H
 
 
-# define MAD_BUFFER_GUARD	8
+/* 8 bytes for libmad plus 16 of read-ahead for the 64-bit bit reservoir */
+# define MAD_BUFFER_GUARD	24
 # define MAD_BUFFER_MDLEN	(511 + 2048 + MAD_BUFFER_GUARD)
 
 enum mad_error {
@@ -693,6 +736,12 @@ enum mad_error {
 # define MAD_RECOVERABLE(error)	((error) & 0xff00)
 typedef unsigned char main_data_t[MAD_BUFFER_MDLEN];
 
+struct mad_sync_stats {
+  unsigned long resyncs;		/* times sync was regained */
+  unsigned long skipped;		/* bytes scanned while out of sync */
+  unsigned long rejected;		/* candidate sync words rejected */
+};
+
 struct mad_stream {
   unsigned char const *buffer;		/* input bitstream buffer */
   unsigned char const *bufend;		/* end of buffer */
@@ -700,6 +749,7 @@ struct mad_stream {
 
   int sync;				/* stream sync found */
   unsigned long freerate;		/* free bitrate (fixed) */
+  struct mad_sync_stats stats;		/* resynchronization counters */
 
   unsigned char const *this_frame;	/* start of current frame */
   unsigned char const *next_frame;	/* start of next frame */
@@ -720,12 +770,13 @@ struct mad_stream {
 
 enum {
   MAD_OPTION_IGNORECRC      = 0x0001,	/* ignore CRC errors */
-  MAD_OPTION_HALFSAMPLERATE = 0x0002	/* generate PCM at 1/2 sample rate */
-# if 0  /* not yet implemented */
+  MAD_OPTION_HALFSAMPLERATE = 0x0002,	/* generate PCM at 1/2 sample rate */
+
   MAD_OPTION_LEFTCHANNEL    = 0x0010,	/* decode left channel only */
   MAD_OPTION_RIGHTCHANNEL   = 0x0020,	/* decode right channel only */
-  MAD_OPTION_SINGLECHANNEL  = 0x0030	/* combine channels */
-# endif
+  MAD_OPTION_SINGLECHANNEL  = 0x0030,	/* combine channels */
+
+  MAD_OPTION_NOSIMD         = 0x0100	/* use the scalar IMDCT and synthesis */
 };
 
 void mad_stream_init(struct mad_stream *);
@@ -798,6 +849,9 @@ struct mad_frame {
 };
 
 # define MAD_NCHANNELS(header)		((header)->mode ? 2 : 1)
+# define MAD_NSBCHANNELS(frame)  \
+  (((frame)->options & MAD_OPTION_SINGLECHANNEL) ? 1 :  \
+   MAD_NCHANNELS(&(frame)->header))
 # define MAD_NSBSAMPLES(header)  \
   ((header)->layer == MAD_LAYER_I ? 12 :  \
    (((header)->layer == MAD_LAYER_III &&  \
@@ -853,6 +907,11 @@ struct mad_pcm {
   unsigned short length;		/* number of samples per channel */
 };
 
+/* subband sample slots rendered per block (18 == one granule) */
+# if !defined(MAD_SYNTH_BLOCK_SLOTS)
+#  define MAD_SYNTH_BLOCK_SLOTS  18
+# endif
+
 struct mad_synth {
   mad_fixed_t filter[2][2][2][16][8];	/* polyphase filterbank outputs */
   					/* [ch][eo][peo][s][v] */
@@ -860,6 +919,11 @@ struct mad_synth {
   unsigned int phase;			/* current processing phase */
 
   struct mad_pcm pcm;			/* PCM output */
+
+  void *sink;				/* passed to the PCM sink */
+
+  signed short block[MAD_SYNTH_BLOCK_SLOTS * 32 * 2];
+					/* interleaved 16-bit PCM block */
 };
 
 /* single channel PCM selector */
@@ -887,6 +951,12 @@ void mad_synth_mute(struct mad_synth *);
 
 void mad_synth_frame(struct mad_synth *, struct mad_frame const *);
 
+# ifdef NANORADIO
+/* PCM sink, implemented by codec-mpeg.c */
+void set_dac_sample_rate(void *, int);
+void render_sample_block(void *, short const *, int, unsigned int);
+# endif
+
 # endif
 
 /* Id: decoder.h,v 1.17 2004/01/23 09:41:32 rob Exp */
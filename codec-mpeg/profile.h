@@ -0,0 +1,92 @@
+/*
+ * libmad - MPEG audio decoder library
+ * Copyright (C) 2000-2004 Underbit Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+# ifndef LIBMAD_PROFILE_H
+# define LIBMAD_PROFILE_H
+
+/*
+ * Per-stage cycle accounting, compiled in with MAD_PROFILE only. The
+ * counters are process wide, so only one decoder should run while they
+ * are read. Each stage is written by a single task, which keeps the
+ * synthesis task of a pipelined decoder safe.
+ */
+
+enum mad_stage {
+  MAD_STAGE_HEADER = 0,			/* frame header and CRC */
+  MAD_STAGE_SIDEINFO,			/* side info and bit reservoir */
+  MAD_STAGE_HUFFMAN,			/* scalefactors, Huffman, requantization */
+  MAD_STAGE_STEREO,			/* MS and intensity stereo */
+  MAD_STAGE_IMDCT,			/* reorder, alias reduction, IMDCT, overlap */
+  MAD_STAGE_SYNTH,			/* polyphase synthesis and PCM output */
+  MAD_STAGE_COUNT
+};
+
+# if defined(MAD_PROFILE)
+
+#  if !defined(__x86_64__) && !defined(__i386__) && !defined(__aarch64__)
+#   include <time.h>
+#  endif
+
+#  include "fixed.h"
+
+extern unsigned long long mad_stage_cycles[MAD_STAGE_COUNT];
+
+int mad_profile_dct32(mad_fixed_t const [36][32], unsigned int,
+		      unsigned long long [2]);
+
+static inline
+unsigned long long mad_profile_clock(void)
+{
+#  if defined(__x86_64__) || defined(__i386__)
+  unsigned int lo, hi;
+
+  __asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+  return ((unsigned long long) hi << 32) | lo;
+#  elif defined(__aarch64__)
+  unsigned long long t;
+
+  __asm__ __volatile__ ("mrs %0, cntvct_el0" : "=r" (t));
+  return t;
+#  else
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#  endif
+}
+
+#  define MAD_PROFILE_DECL(t)		unsigned long long t
+#  define MAD_PROFILE_START(t)		((t) = mad_profile_clock())
+/* charge the time since 't' to 'stage' and restart the clock */
+#  define MAD_PROFILE_LAP(t, stage)  \
+  do {  \
+    unsigned long long now_ = mad_profile_clock();  \
+    mad_stage_cycles[stage] += now_ - (t);  \
+    (t) = now_;  \
+  } while (0)
+
+# else
+
+#  define MAD_PROFILE_DECL(t)		int t
+#  define MAD_PROFILE_START(t)		((void) (t = 0))
+#  define MAD_PROFILE_LAP(t, stage)	((void) (t))
+
+# endif
+
+# endif
@@ -0,0 +1,106 @@
+/*
+ * libmad - MPEG audio decoder library
+ * Copyright (C) 2000-2004 Underbit Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+# ifndef LIBMAD_SIMD_H
+# define LIBMAD_SIMD_H
+
+# include "fixed.h"
+
+/*
+ * Vector helpers for the host SIMD kernels of the synthesis and the Layer III
+ * IMDCT. A dct_v4 or dct_v8 holds one sample per lane. The multiplies widen
+ * each lane to 64 bits and scale it like mad_f_mul(), so the kernels are
+ * bit-exact with the FPM_64BIT scalar code. With FPM_FLOAT the lanes are
+ * floats and the multiplies are plain vector products.
+ */
+# if (defined(FPM_64BIT) || defined(FPM_FLOAT)) && defined(__GNUC__) &&  \
+     (defined(__x86_64__) || defined(__i386__) || defined(__ARM_NEON))
+#  define MAD_SIMD
+
+#  if defined(__ARM_NEON)
+#   include <arm_neon.h>
+#  else
+#   include <immintrin.h>
+#  endif
+
+typedef mad_fixed_t dct_v4 __attribute__((vector_size(16)));
+typedef mad_fixed_t dct_v8 __attribute__((vector_size(32)));
+
+#  if defined(FPM_FLOAT)
+#   define mul_v4_neon(x, y)	((x) * (y))
+#   define mul_v4_sse41(x, y)	((x) * (y))
+#   define mul_v8_avx2(x, y)	((x) * (y))
+#  elif defined(__ARM_NEON)
+static inline
+dct_v4 mul_v4_neon(dct_v4 x, mad_fixed_t y)
+{
+  int32x2_t c = vdup_n_s32(y);
+  int32x4_t v = (int32x4_t) x;
+
+#   if defined(OPT_ACCURACY)
+  return (dct_v4) vcombine_s32(vrshrn_n_s64(vmull_s32(vget_low_s32(v), c),
+					    MAD_F_SCALEBITS),
+			       vrshrn_n_s64(vmull_s32(vget_high_s32(v), c),
+					    MAD_F_SCALEBITS));
+#   else
+  return (dct_v4) vcombine_s32(vshrn_n_s64(vmull_s32(vget_low_s32(v), c),
+					   MAD_F_SCALEBITS),
+			       vshrn_n_s64(vmull_s32(vget_high_s32(v), c),
+					   MAD_F_SCALEBITS));
+#   endif
+}
+#  else
+#   if defined(OPT_ACCURACY)
+#    define DCT_ROUND  (1LL << (MAD_F_SCALEBITS - 1))
+#   else
+#    define DCT_ROUND  0
+#   endif
+
+static inline __attribute__((target("sse4.1")))
+dct_v4 mul_v4_sse41(dct_v4 x, mad_fixed_t y)
+{
+  __m128i const c = _mm_set1_epi32(y), r = _mm_set1_epi64x(DCT_ROUND);
+  __m128i e, o;
+
+  e = _mm_mul_epi32((__m128i) x, c);
+  o = _mm_mul_epi32(_mm_srli_epi64((__m128i) x, 32), c);
+  e = _mm_srli_epi64(_mm_add_epi64(e, r), MAD_F_SCALEBITS);
+  o = _mm_slli_epi64(_mm_srli_epi64(_mm_add_epi64(o, r), MAD_F_SCALEBITS), 32);
+
+  return (dct_v4) _mm_blend_epi16(e, o, 0xcc);
+}
+
+static inline __attribute__((target("avx2")))
+dct_v8 mul_v8_avx2(dct_v8 x, mad_fixed_t y)
+{
+  __m256i const c = _mm256_set1_epi32(y), r = _mm256_set1_epi64x(DCT_ROUND);
+  __m256i e, o;
+
+  e = _mm256_mul_epi32((__m256i) x, c);
+  o = _mm256_mul_epi32(_mm256_srli_epi64((__m256i) x, 32), c);
+  e = _mm256_srli_epi64(_mm256_add_epi64(e, r), MAD_F_SCALEBITS);
+  o = _mm256_slli_epi64(_mm256_srli_epi64(_mm256_add_epi64(o, r),
+					  MAD_F_SCALEBITS), 32);
+
+  return (dct_v8) _mm256_blend_epi32(e, o, 0xaa);
+}
+#  endif
+# endif  /* MAD_SIMD */
+
+# endif
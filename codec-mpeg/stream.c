@@ -26,12 +26,11 @@
 # include "global.h"
 
 # include <stdlib.h>
+# include <string.h>
 
 # include "bit.h"
 # include "stream.h"
 
-main_data_t MainData; //static alloc of decoder data
-
 /*
  * NAME:	stream->init()
  * DESCRIPTION:	initialize stream struct
@@ -45,6 +44,10 @@ void ICACHE_FLASH_ATTR mad_stream_init(struct mad_stream *stream)
   stream->sync       = 0;
   stream->freerate   = 0;
 
+  stream->stats.resyncs  = 0;
+  stream->stats.skipped  = 0;
+  stream->stats.rejected = 0;
+
   stream->this_frame = 0;
   stream->next_frame = 0;
   mad_bit_init(&stream->ptr, 0);
@@ -101,6 +104,20 @@ void ICACHE_FLASH_ATTR mad_stream_skip(struct mad_stream *stream, unsigned long
   stream->skiplen += length;
 }
 
+/*
+ * NAME:	sync_word()
+ * DESCRIPTION:	check for a sync word opening a plausible frame header
+ */
+static inline
+int sync_word(unsigned char const *ptr)
+{
+  return (ptr[1] & 0xe0) == 0xe0 &&
+    (ptr[1] & 0x18) != 0x08 &&	/* MPEG 2.5 with ID set */
+    (ptr[1] & 0x06) != 0x00 &&	/* reserved layer */
+    (ptr[2] & 0xf0) != 0xf0 &&	/* forbidden bitrate */
+    (ptr[2] & 0x0c) != 0x0c;	/* reserved sample frequency */
+}
+
 /*
  * NAME:	stream->sync()
  * DESCRIPTION:	locate the next stream sync word
@@ -108,20 +125,39 @@ void ICACHE_FLASH_ATTR mad_stream_skip(struct mad_stream *stream, unsigned long
 int ICACHE_FLASH_ATTR mad_stream_sync(struct mad_stream *stream)
 {
   register unsigned char const *ptr, *end;
+  unsigned char const *start;
 
-  ptr = mad_bit_nextbyte(&stream->ptr);
+  start = ptr = mad_bit_nextbyte(&stream->ptr);
   end = stream->bufend;
 
-  while (ptr < end - 1 &&
-	 !(ptr[0] == 0xff && (ptr[1] & 0xe0) == 0xe0))
-    ++ptr;
+  /*
+   * Let memchr() find the 0xff bytes and reject candidates whose header
+   * fields are reserved here, rather than making the caller fail on each
+   * one in turn. Candidates must leave MAD_BUFFER_GUARD bytes of buffer.
+   */
 
-  if (end - ptr < MAD_BUFFER_GUARD)
-    return -1;
+  while (end - ptr >= MAD_BUFFER_GUARD) {
+    ptr = memchr(ptr, 0xff, (end - MAD_BUFFER_GUARD + 1) - ptr);
+    if (ptr == 0)
+      break;
 
-  mad_bit_init(&stream->ptr, ptr);
+    if (sync_word(ptr)) {
+      stream->stats.skipped += ptr - start;
+      mad_bit_init(&stream->ptr, ptr);
 
-  return 0;
+      return 0;
+    }
+
+    if ((ptr[1] & 0xe0) == 0xe0)
+      ++stream->stats.rejected;
+
+    ++ptr;
+  }
+
+  if (end - start > MAD_BUFFER_GUARD)
+    stream->stats.skipped += (end - MAD_BUFFER_GUARD) - start;
+
+  return -1;
 }
 
 /*
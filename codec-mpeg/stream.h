@@ -24,7 +24,8 @@
 
 # include "bit.h"
 
-# define MAD_BUFFER_GUARD	8
+/* 8 bytes for libmad plus 16 of read-ahead for the 64-bit bit reservoir */
+# define MAD_BUFFER_GUARD	24
 # define MAD_BUFFER_MDLEN	(511 + 2048 + MAD_BUFFER_GUARD)
 
 enum mad_error {
@@ -59,6 +60,12 @@ enum mad_error {
 # define MAD_RECOVERABLE(error)	((error) & 0xff00)
 typedef unsigned char main_data_t[MAD_BUFFER_MDLEN];
 
+struct mad_sync_stats {
+  unsigned long resyncs;		/* times sync was regained */
+  unsigned long skipped;		/* bytes scanned while out of sync */
+  unsigned long rejected;		/* candidate sync words rejected */
+};
+
 struct mad_stream {
   unsigned char const *buffer;		/* input bitstream buffer */
   unsigned char const *bufend;		/* end of buffer */
@@ -66,6 +73,7 @@ struct mad_stream {
 
   int sync;				/* stream sync found */
   unsigned long freerate;		/* free bitrate (fixed) */
+  struct mad_sync_stats stats;		/* resynchronization counters */
 
   unsigned char const *this_frame;	/* start of current frame */
   unsigned char const *next_frame;	/* start of next frame */
@@ -85,12 +93,13 @@ struct mad_stream {
 
 enum {
   MAD_OPTION_IGNORECRC      = 0x0001,	/* ignore CRC errors */
-  MAD_OPTION_HALFSAMPLERATE = 0x0002	/* generate PCM at 1/2 sample rate */
-# if 0  /* not yet implemented */
+  MAD_OPTION_HALFSAMPLERATE = 0x0002,	/* generate PCM at 1/2 sample rate */
+
   MAD_OPTION_LEFTCHANNEL    = 0x0010,	/* decode left channel only */
   MAD_OPTION_RIGHTCHANNEL   = 0x0020,	/* decode right channel only */
-  MAD_OPTION_SINGLECHANNEL  = 0x0030	/* combine channels */
-# endif
+  MAD_OPTION_SINGLECHANNEL  = 0x0030,	/* combine channels */
+
+  MAD_OPTION_NOSIMD         = 0x0100	/* use the scalar IMDCT and synthesis */
 };
 
 void mad_stream_init(struct mad_stream *);
@@ -31,6 +31,11 @@ struct mad_pcm {
   unsigned short length;		/* number of samples per channel */
 };
 
+/* subband sample slots rendered per block (18 == one granule) */
+# if !defined(MAD_SYNTH_BLOCK_SLOTS)
+#  define MAD_SYNTH_BLOCK_SLOTS  18
+# endif
+
 struct mad_synth {
   mad_fixed_t filter[2][2][2][16][8];	/* polyphase filterbank outputs */
   					/* [ch][eo][peo][s][v] */
@@ -38,6 +43,11 @@ struct mad_synth {
   unsigned int phase;			/* current processing phase */
 
   struct mad_pcm pcm;			/* PCM output */
+
+  void *sink;				/* passed to the PCM sink */
+
+  signed short block[MAD_SYNTH_BLOCK_SLOTS * 32 * 2];
+					/* interleaved 16-bit PCM block */
 };
 
 /* single channel PCM selector */
@@ -65,4 +75,10 @@ void mad_synth_mute(struct mad_synth *);
 
 void mad_synth_frame(struct mad_synth *, struct mad_frame const *);
 
+# ifdef NANORADIO
+/* PCM sink, implemented by codec-mpeg.c */
+void set_dac_sample_rate(void *, int);
+void render_sample_block(void *, short const *, int, unsigned int);
+# endif
+
 # endif
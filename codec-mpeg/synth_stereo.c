@@ -28,9 +28,17 @@
 # include "fixed.h"
 # include "frame.h"
 # include "synth.h"
+# include "profile.h"
+# include "simd.h"
 # include "string.h"
 //# include "lpc_io.h"
 
+/* vector window sums for host builds, see synth->full_simd() */
+# if defined(MAD_SIMD) && !defined(OPT_SSO) && !defined(ASO_SYNTH)
+#  define SYNTH_SIMD
+static void synth_simd_select(void);
+# endif
+
 
 // #define SAVED_SAMPLE_BUFF_LEN   240000
 // unsigned int saved_idx = 0;
@@ -47,6 +55,18 @@
 static inline
 signed int scale(mad_fixed_t sample)
 {
+# if defined(FPM_FLOAT)
+  /* the same gain as the shift below; round by truncating a positive value */
+  sample = sample * (1L << (16 - 2)) + ((1L << (16 - 2)) + 0.5f);
+
+  /* clip */
+  if (sample >= (2L << (16 - 2)))
+    return (1L << (16 - 2)) - 1;
+  else if (sample < 0)
+    return -(1L << (16 - 2));
+
+  return (signed int) sample - (1L << (16 - 2));
+# else
   /* round */
   sample += (1L << (MAD_F_FRACBITS - 16));
 
@@ -62,6 +82,7 @@ signed int scale(mad_fixed_t sample)
   //but somehow that clipped and distorted on loud sounds...
   //This seems to be OK:
   return sample >> (MAD_F_FRACBITS + 2 - 16);
+# endif
 }
 /*
  * NAME:	synth->init()
@@ -69,6 +90,9 @@ signed int scale(mad_fixed_t sample)
  */
 void ICACHE_FLASH_ATTR mad_synth_init(struct mad_synth *synth)
 {
+# if defined(SYNTH_SIMD)
+  synth_simd_select();
+# endif
   mad_synth_mute(synth);
 
   synth->phase = 0;
@@ -76,6 +100,8 @@ void ICACHE_FLASH_ATTR mad_synth_init(struct mad_synth *synth)
   synth->pcm.samplerate = 0;
   synth->pcm.channels   = 0;
   synth->pcm.length     = 0;
+
+  synth->sink = 0;
 }
 
 /*
@@ -157,393 +183,165 @@ static
 void ICACHE_FLASH_ATTR dct32(mad_fixed_t const in[32], unsigned int slot,
 	   mad_fixed_t lo[16][8], mad_fixed_t hi[16][8])
 {
-  mad_fixed_t t0,   t1,   t2,   t3,   t4,   t5,   t6,   t7;
-  mad_fixed_t t8,   t9,   t10,  t11,  t12,  t13,  t14,  t15;
-  mad_fixed_t t16,  t17,  t18,  t19,  t20,  t21,  t22,  t23;
-  mad_fixed_t t24,  t25,  t26,  t27,  t28,  t29,  t30,  t31;
-  mad_fixed_t t32,  t33,  t34,  t35,  t36,  t37,  t38,  t39;
-  mad_fixed_t t40,  t41,  t42,  t43,  t44,  t45,  t46,  t47;
-  mad_fixed_t t48,  t49,  t50,  t51,  t52,  t53,  t54,  t55;
-  mad_fixed_t t56,  t57,  t58,  t59,  t60,  t61,  t62,  t63;
-  mad_fixed_t t64,  t65,  t66,  t67,  t68,  t69,  t70,  t71;
-  mad_fixed_t t72,  t73,  t74,  t75,  t76,  t77,  t78,  t79;
-  mad_fixed_t t80,  t81,  t82,  t83,  t84,  t85,  t86,  t87;
-  mad_fixed_t t88,  t89,  t90,  t91,  t92,  t93,  t94,  t95;
-  mad_fixed_t t96,  t97,  t98,  t99,  t100, t101, t102, t103;
-  mad_fixed_t t104, t105, t106, t107, t108, t109, t110, t111;
-  mad_fixed_t t112, t113, t114, t115, t116, t117, t118, t119;
-  mad_fixed_t t120, t121, t122, t123, t124, t125, t126, t127;
-  mad_fixed_t t128, t129, t130, t131, t132, t133, t134, t135;
-  mad_fixed_t t136, t137, t138, t139, t140, t141, t142, t143;
-  mad_fixed_t t144, t145, t146, t147, t148, t149, t150, t151;
-  mad_fixed_t t152, t153, t154, t155, t156, t157, t158, t159;
-  mad_fixed_t t160, t161, t162, t163, t164, t165, t166, t167;
-  mad_fixed_t t168, t169, t170, t171, t172, t173, t174, t175;
-  mad_fixed_t t176;
-
-  /* costab[i] = cos(PI / (2 * 32) * i) */
-
-# if defined(OPT_DCTO)
-#  define costab1	MAD_F(0x7fd8878e)
-#  define costab2	MAD_F(0x7f62368f)
-#  define costab3	MAD_F(0x7e9d55fc)
-#  define costab4	MAD_F(0x7d8a5f40)
-#  define costab5	MAD_F(0x7c29fbee)
-#  define costab6	MAD_F(0x7a7d055b)
-#  define costab7	MAD_F(0x78848414)
-#  define costab8	MAD_F(0x7641af3d)
-#  define costab9	MAD_F(0x73b5ebd1)
-#  define costab10	MAD_F(0x70e2cbc6)
-#  define costab11	MAD_F(0x6dca0d14)
-#  define costab12	MAD_F(0x6a6d98a4)
-#  define costab13	MAD_F(0x66cf8120)
-#  define costab14	MAD_F(0x62f201ac)
-#  define costab15	MAD_F(0x5ed77c8a)
-#  define costab16	MAD_F(0x5a82799a)
-#  define costab17	MAD_F(0x55f5a4d2)
-#  define costab18	MAD_F(0x5133cc94)
-#  define costab19	MAD_F(0x4c3fdff4)
-#  define costab20	MAD_F(0x471cece7)
-#  define costab21	MAD_F(0x41ce1e65)
-#  define costab22	MAD_F(0x3c56ba70)
-#  define costab23	MAD_F(0x36ba2014)
-#  define costab24	MAD_F(0x30fbc54d)
-#  define costab25	MAD_F(0x2b1f34eb)
-#  define costab26	MAD_F(0x25280c5e)
-#  define costab27	MAD_F(0x1f19f97b)
-#  define costab28	MAD_F(0x18f8b83c)
-#  define costab29	MAD_F(0x12c8106f)
-#  define costab30	MAD_F(0x0c8bd35e)
-#  define costab31	MAD_F(0x0647d97c)
-# else
-#  define costab1	MAD_F(0x0ffb10f2)  /* 0.998795456 */
-#  define costab2	MAD_F(0x0fec46d2)  /* 0.995184727 */
-#  define costab3	MAD_F(0x0fd3aac0)  /* 0.989176510 */
-#  define costab4	MAD_F(0x0fb14be8)  /* 0.980785280 */
-#  define costab5	MAD_F(0x0f853f7e)  /* 0.970031253 */
-#  define costab6	MAD_F(0x0f4fa0ab)  /* 0.956940336 */
-#  define costab7	MAD_F(0x0f109082)  /* 0.941544065 */
-#  define costab8	MAD_F(0x0ec835e8)  /* 0.923879533 */
-#  define costab9	MAD_F(0x0e76bd7a)  /* 0.903989293 */
-#  define costab10	MAD_F(0x0e1c5979)  /* 0.881921264 */
-#  define costab11	MAD_F(0x0db941a3)  /* 0.857728610 */
-#  define costab12	MAD_F(0x0d4db315)  /* 0.831469612 */
-#  define costab13	MAD_F(0x0cd9f024)  /* 0.803207531 */
-#  define costab14	MAD_F(0x0c5e4036)  /* 0.773010453 */
-#  define costab15	MAD_F(0x0bdaef91)  /* 0.740951125 */
-#  define costab16	MAD_F(0x0b504f33)  /* 0.707106781 */
-#  define costab17	MAD_F(0x0abeb49a)  /* 0.671558955 */
-#  define costab18	MAD_F(0x0a267993)  /* 0.634393284 */
-#  define costab19	MAD_F(0x0987fbfe)  /* 0.595699304 */
-#  define costab20	MAD_F(0x08e39d9d)  /* 0.555570233 */
-#  define costab21	MAD_F(0x0839c3cd)  /* 0.514102744 */
-#  define costab22	MAD_F(0x078ad74e)  /* 0.471396737 */
-#  define costab23	MAD_F(0x06d74402)  /* 0.427555093 */
-#  define costab24	MAD_F(0x061f78aa)  /* 0.382683432 */
-#  define costab25	MAD_F(0x0563e69d)  /* 0.336889853 */
-#  define costab26	MAD_F(0x04a5018c)  /* 0.290284677 */
-#  define costab27	MAD_F(0x03e33f2f)  /* 0.242980180 */
-#  define costab28	MAD_F(0x031f1708)  /* 0.195090322 */
-#  define costab29	MAD_F(0x0259020e)  /* 0.146730474 */
-#  define costab30	MAD_F(0x01917a6c)  /* 0.098017140 */
-#  define costab31	MAD_F(0x00c8fb30)  /* 0.049067674 */
-# endif
-
-  t0   = in[0]  + in[31];  t16  = MUL(in[0]  - in[31], costab1);
-  t1   = in[15] + in[16];  t17  = MUL(in[15] - in[16], costab31);
-
-  t41  = t16 + t17;
-  t59  = MUL(t16 - t17, costab2);
-  t33  = t0  + t1;
-  t50  = MUL(t0  - t1,  costab2);
-
-  t2   = in[7]  + in[24];  t18  = MUL(in[7]  - in[24], costab15);
-  t3   = in[8]  + in[23];  t19  = MUL(in[8]  - in[23], costab17);
-
-  t42  = t18 + t19;
-  t60  = MUL(t18 - t19, costab30);
-  t34  = t2  + t3;
-  t51  = MUL(t2  - t3,  costab30);
-
-  t4   = in[3]  + in[28];  t20  = MUL(in[3]  - in[28], costab7);
-  t5   = in[12] + in[19];  t21  = MUL(in[12] - in[19], costab25);
-
-  t43  = t20 + t21;
-  t61  = MUL(t20 - t21, costab14);
-  t35  = t4  + t5;
-  t52  = MUL(t4  - t5,  costab14);
-
-  t6   = in[4]  + in[27];  t22  = MUL(in[4]  - in[27], costab9);
-  t7   = in[11] + in[20];  t23  = MUL(in[11] - in[20], costab23);
-
-  t44  = t22 + t23;
-  t62  = MUL(t22 - t23, costab18);
-  t36  = t6  + t7;
-  t53  = MUL(t6  - t7,  costab18);
-
-  t8   = in[1]  + in[30];  t24  = MUL(in[1]  - in[30], costab3);
-  t9   = in[14] + in[17];  t25  = MUL(in[14] - in[17], costab29);
-
-  t45  = t24 + t25;
-  t63  = MUL(t24 - t25, costab6);
-  t37  = t8  + t9;
-  t54  = MUL(t8  - t9,  costab6);
-
-  t10  = in[6]  + in[25];  t26  = MUL(in[6]  - in[25], costab13);
-  t11  = in[9]  + in[22];  t27  = MUL(in[9]  - in[22], costab19);
-
-  t46  = t26 + t27;
-  t64  = MUL(t26 - t27, costab26);
-  t38  = t10 + t11;
-  t55  = MUL(t10 - t11, costab26);
-
-  t12  = in[2]  + in[29];  t28  = MUL(in[2]  - in[29], costab5);
-  t13  = in[13] + in[18];  t29  = MUL(in[13] - in[18], costab27);
-
-  t47  = t28 + t29;
-  t65  = MUL(t28 - t29, costab10);
-  t39  = t12 + t13;
-  t56  = MUL(t12 - t13, costab10);
-
-  t14  = in[5]  + in[26];  t30  = MUL(in[5]  - in[26], costab11);
-  t15  = in[10] + in[21];  t31  = MUL(in[10] - in[21], costab21);
-
-  t48  = t30 + t31;
-  t66  = MUL(t30 - t31, costab22);
-  t40  = t14 + t15;
-  t57  = MUL(t14 - t15, costab22);
-
-  t69  = t33 + t34;  t89  = MUL(t33 - t34, costab4);
-  t70  = t35 + t36;  t90  = MUL(t35 - t36, costab28);
-  t71  = t37 + t38;  t91  = MUL(t37 - t38, costab12);
-  t72  = t39 + t40;  t92  = MUL(t39 - t40, costab20);
-  t73  = t41 + t42;  t94  = MUL(t41 - t42, costab4);
-  t74  = t43 + t44;  t95  = MUL(t43 - t44, costab28);
-  t75  = t45 + t46;  t96  = MUL(t45 - t46, costab12);
-  t76  = t47 + t48;  t97  = MUL(t47 - t48, costab20);
-
-  t78  = t50 + t51;  t100 = MUL(t50 - t51, costab4);
-  t79  = t52 + t53;  t101 = MUL(t52 - t53, costab28);
-  t80  = t54 + t55;  t102 = MUL(t54 - t55, costab12);
-  t81  = t56 + t57;  t103 = MUL(t56 - t57, costab20);
-
-  t83  = t59 + t60;  t106 = MUL(t59 - t60, costab4);
-  t84  = t61 + t62;  t107 = MUL(t61 - t62, costab28);
-  t85  = t63 + t64;  t108 = MUL(t63 - t64, costab12);
-  t86  = t65 + t66;  t109 = MUL(t65 - t66, costab20);
-
-  t113 = t69  + t70;
-  t114 = t71  + t72;
-
-  /*  0 */ hi[15][slot] = SHIFT(t113 + t114);
-  /* 16 */ lo[ 0][slot] = SHIFT(MUL(t113 - t114, costab16));
-
-  t115 = t73  + t74;
-  t116 = t75  + t76;
-
-  t32  = t115 + t116;
-
-  /*  1 */ hi[14][slot] = SHIFT(t32);
-
-  t118 = t78  + t79;
-  t119 = t80  + t81;
-
-  t58  = t118 + t119;
-
-  /*  2 */ hi[13][slot] = SHIFT(t58);
-
-  t121 = t83  + t84;
-  t122 = t85  + t86;
-
-  t67  = t121 + t122;
-
-  t49  = (t67 * 2) - t32;
-
-  /*  3 */ hi[12][slot] = SHIFT(t49);
-
-  t125 = t89  + t90;
-  t126 = t91  + t92;
-
-  t93  = t125 + t126;
-
-  /*  4 */ hi[11][slot] = SHIFT(t93);
-
-  t128 = t94  + t95;
-  t129 = t96  + t97;
-
-  t98  = t128 + t129;
-
-  t68  = (t98 * 2) - t49;
-
-  /*  5 */ hi[10][slot] = SHIFT(t68);
-
-  t132 = t100 + t101;
-  t133 = t102 + t103;
-
-  t104 = t132 + t133;
-
-  t82  = (t104 * 2) - t58;
-
-  /*  6 */ hi[ 9][slot] = SHIFT(t82);
-
-  t136 = t106 + t107;
-  t137 = t108 + t109;
-
-  t110 = t136 + t137;
-
-  t87  = (t110 * 2) - t67;
-
-  t77  = (t87 * 2) - t68;
-
-  /*  7 */ hi[ 8][slot] = SHIFT(t77);
-
-  t141 = MUL(t69 - t70, costab8);
-  t142 = MUL(t71 - t72, costab24);
-  t143 = t141 + t142;
-
-  /*  8 */ hi[ 7][slot] = SHIFT(t143);
-  /* 24 */ lo[ 8][slot] =
-	     SHIFT((MUL(t141 - t142, costab16) * 2) - t143);
-
-  t144 = MUL(t73 - t74, costab8);
-  t145 = MUL(t75 - t76, costab24);
-  t146 = t144 + t145;
-
-  t88  = (t146 * 2) - t77;
-
-  /*  9 */ hi[ 6][slot] = SHIFT(t88);
-
-  t148 = MUL(t78 - t79, costab8);
-  t149 = MUL(t80 - t81, costab24);
-  t150 = t148 + t149;
-
-  t105 = (t150 * 2) - t82;
-
-  /* 10 */ hi[ 5][slot] = SHIFT(t105);
-
-  t152 = MUL(t83 - t84, costab8);
-  t153 = MUL(t85 - t86, costab24);
-  t154 = t152 + t153;
-
-  t111 = (t154 * 2) - t87;
-
-  t99  = (t111 * 2) - t88;
-
-  /* 11 */ hi[ 4][slot] = SHIFT(t99);
-
-  t157 = MUL(t89 - t90, costab8);
-  t158 = MUL(t91 - t92, costab24);
-  t159 = t157 + t158;
-
-  t127 = (t159 * 2) - t93;
-
-  /* 12 */ hi[ 3][slot] = SHIFT(t127);
-
-  t160 = (MUL(t125 - t126, costab16) * 2) - t127;
-
-  /* 20 */ lo[ 4][slot] = SHIFT(t160);
-  /* 28 */ lo[12][slot] =
-	     SHIFT((((MUL(t157 - t158, costab16) * 2) - t159) * 2) - t160);
-
-  t161 = MUL(t94 - t95, costab8);
-  t162 = MUL(t96 - t97, costab24);
-  t163 = t161 + t162;
-
-  t130 = (t163 * 2) - t98;
-
-  t112 = (t130 * 2) - t99;
-
-  /* 13 */ hi[ 2][slot] = SHIFT(t112);
-
-  t164 = (MUL(t128 - t129, costab16) * 2) - t130;
-
-  t166 = MUL(t100 - t101, costab8);
-  t167 = MUL(t102 - t103, costab24);
-  t168 = t166 + t167;
-
-  t134 = (t168 * 2) - t104;
-
-  t120 = (t134 * 2) - t105;
-
-  /* 14 */ hi[ 1][slot] = SHIFT(t120);
-
-  t135 = (MUL(t118 - t119, costab16) * 2) - t120;
-
-  /* 18 */ lo[ 2][slot] = SHIFT(t135);
-
-  t169 = (MUL(t132 - t133, costab16) * 2) - t134;
-
-  t151 = (t169 * 2) - t135;
-
-  /* 22 */ lo[ 6][slot] = SHIFT(t151);
-
-  t170 = (((MUL(t148 - t149, costab16) * 2) - t150) * 2) - t151;
-
-  /* 26 */ lo[10][slot] = SHIFT(t170);
-  /* 30 */ lo[14][slot] =
-	     SHIFT((((((MUL(t166 - t167, costab16) * 2) -
-		       t168) * 2) - t169) * 2) - t170);
-
-  t171 = MUL(t106 - t107, costab8);
-  t172 = MUL(t108 - t109, costab24);
-  t173 = t171 + t172;
-
-  t138 = (t173 * 2) - t110;
-
-  t123 = (t138 * 2) - t111;
-
-  t139 = (MUL(t121 - t122, costab16) * 2) - t123;
-
-  t117 = (t123 * 2) - t112;
-
-  /* 15 */ hi[ 0][slot] = SHIFT(t117);
-
-  t124 = (MUL(t115 - t116, costab16) * 2) - t117;
-
-  /* 17 */ lo[ 1][slot] = SHIFT(t124);
-
-  t131 = (t139 * 2) - t124;
-
-  /* 19 */ lo[ 3][slot] = SHIFT(t131);
-
-  t140 = (t164 * 2) - t131;
+# define DCT32_T  mad_fixed_t
+# include "dct32.dat"
+# undef DCT32_T
+}
 
-  /* 21 */ lo[ 5][slot] = SHIFT(t140);
+# if defined(SYNTH_SIMD)
+/*
+ * Batched dct32(): the same butterflies with every temporary holding one
+ * subband-sample slot per vector lane, so one channel of a granule is
+ * transformed in ns / lanes passes instead of ns calls. Each lane kernel
+ * reads `lanes' consecutive slots and writes row k of the result (lo[0..15]
+ * then hi[0..15]) at out[k * 36 + lane]. Multiplies are widened to 64 bits
+ * and scaled like mad_f_mul(), so results are bit-exact with dct32().
+ */
+typedef void (*dct32_lanes_t)(mad_fixed_t const (*)[32], mad_fixed_t *);
 
-  t174 = (MUL(t136 - t137, costab16) * 2) - t138;
+static dct32_lanes_t dct32_lanes;
+static unsigned int dct32_nlanes;
 
-  t155 = (t174 * 2) - t139;
+#  undef MUL
 
-  t147 = (t155 * 2) - t140;
+#  if defined(__ARM_NEON)
+static
+void dct32_x4_neon(mad_fixed_t const (*src)[32], mad_fixed_t *out)
+{
+  dct_v4 in[32], lo[16][1], hi[16][1];
+  unsigned int const slot = 0;
+  unsigned int i;
 
-  /* 23 */ lo[ 7][slot] = SHIFT(t147);
+  for (i = 0; i < 32; ++i)
+    in[i] = (dct_v4) { src[0][i], src[1][i], src[2][i], src[3][i] };
+  {
+#   define MUL(x, y)  mul_v4_neon((x), (y))
+#   define DCT32_T    dct_v4
+#   include "dct32.dat"
+#   undef DCT32_T
+#   undef MUL
+  }
+  for (i = 0; i < 16; ++i) {
+    memcpy(&out[i * 36],        &lo[i][0], sizeof(lo[i][0]));
+    memcpy(&out[(16 + i) * 36], &hi[i][0], sizeof(hi[i][0]));
+  }
+}
+#  else
+static __attribute__((target("sse4.1")))
+void dct32_x4_sse41(mad_fixed_t const (*src)[32], mad_fixed_t *out)
+{
+  dct_v4 in[32], lo[16][1], hi[16][1];
+  unsigned int const slot = 0;
+  unsigned int i;
 
-  t156 = (((MUL(t144 - t145, costab16) * 2) - t146) * 2) - t147;
+  for (i = 0; i < 32; ++i)
+    in[i] = (dct_v4) { src[0][i], src[1][i], src[2][i], src[3][i] };
+  {
+#   define MUL(x, y)  mul_v4_sse41((x), (y))
+#   define DCT32_T    dct_v4
+#   include "dct32.dat"
+#   undef DCT32_T
+#   undef MUL
+  }
+  for (i = 0; i < 16; ++i) {
+    memcpy(&out[i * 36],        &lo[i][0], sizeof(lo[i][0]));
+    memcpy(&out[(16 + i) * 36], &hi[i][0], sizeof(hi[i][0]));
+  }
+}
 
-  /* 25 */ lo[ 9][slot] = SHIFT(t156);
+static __attribute__((target("avx2")))
+void dct32_x8_avx2(mad_fixed_t const (*src)[32], mad_fixed_t *out)
+{
+  __m256i const row = _mm256_setr_epi32(0, 32, 64, 96, 128, 160, 192, 224);
+  dct_v8 in[32], lo[16][1], hi[16][1];
+  unsigned int const slot = 0;
+  unsigned int i;
+
+  /* slot l of the pass goes to lane l */
+  for (i = 0; i < 32; ++i)
+    in[i] = (dct_v8) _mm256_i32gather_epi32((int const *) &src[0][i], row, 4);
+  {
+#   define MUL(x, y)  mul_v8_avx2((x), (y))
+#   define DCT32_T    dct_v8
+#   include "dct32.dat"
+#   undef DCT32_T
+#   undef MUL
+  }
+  for (i = 0; i < 16; ++i) {
+    memcpy(&out[i * 36],        &lo[i][0], sizeof(lo[i][0]));
+    memcpy(&out[(16 + i) * 36], &hi[i][0], sizeof(hi[i][0]));
+  }
+}
+#  endif
 
-  t175 = (((MUL(t152 - t153, costab16) * 2) - t154) * 2) - t155;
+/*
+ * NAME:	dct32_batch()
+ * DESCRIPTION:	transform ns slots of one channel into out[lo/hi][16][slot]
+ */
+static
+void dct32_batch(mad_fixed_t const sbsample[36][32], unsigned int ns,
+		 mad_fixed_t out[2][16][36])
+{
+  unsigned int const n = dct32_nlanes;
+  unsigned int s, k;
 
-  t165 = (t175 * 2) - t156;
+  for (s = 0; s < ns; s += n) {
+    /* keep the last pass inside the 36 slots; overlapping lanes recompute */
+    k = s + n <= 36 ? s : 36 - n;
+    dct32_lanes(&sbsample[k], &out[0][0][k]);
+  }
+}
+# endif  /* SYNTH_SIMD */
 
-  /* 27 */ lo[11][slot] = SHIFT(t165);
+# if defined(MAD_PROFILE)
+/*
+ * NAME:	profile->dct32()
+ * DESCRIPTION:	time 'rounds' transforms of the 36 slots of sbsample by
+ *		dct32() and by dct32_batch(), and count the outputs in which
+ *		the two differ; -1 where there is no batched transform
+ */
+int mad_profile_dct32(mad_fixed_t const sbsample[36][32], unsigned int rounds,
+		      unsigned long long cycles[2])
+{
+#  if defined(SYNTH_SIMD)
+  mad_fixed_t lo[16][8], hi[16][8], out[2][16][36];
+  unsigned long long t;
+  unsigned int r, s, i;
+  int differ = 0;
+
+  synth_simd_select();
+  if (!dct32_lanes)
+    return -1;
+
+  /* the barriers keep the unread outputs from being optimized out */
+  t = mad_profile_clock();
+  for (r = 0; r < rounds; ++r) {
+    for (s = 0; s < 36; ++s) {
+      dct32(sbsample[s], s & 7, lo, hi);
+      __asm__ __volatile__ ("" : : "r" (lo), "r" (hi) : "memory");
+    }
+  }
+  cycles[0] = mad_profile_clock() - t;
 
-  t176 = (((((MUL(t161 - t162, costab16) * 2) -
-	     t163) * 2) - t164) * 2) - t165;
+  t = mad_profile_clock();
+  for (r = 0; r < rounds; ++r) {
+    dct32_batch(sbsample, 36, out);
+    __asm__ __volatile__ ("" : : "r" (out) : "memory");
+  }
+  cycles[1] = mad_profile_clock() - t;
 
-  /* 29 */ lo[13][slot] = SHIFT(t176);
-  /* 31 */ lo[15][slot] =
-	     SHIFT((((((((MUL(t171 - t172, costab16) * 2) -
-			 t173) * 2) - t174) * 2) - t175) * 2) - t176);
+  for (s = 0; s < 36; ++s) {
+    dct32(sbsample[s], s & 7, lo, hi);
+    for (i = 0; i < 16; ++i)
+      differ += (lo[i][s & 7] != out[0][i][s]) + (hi[i][s & 7] != out[1][i][s]);
+  }
 
-  /*
-   * Totals:
-   *  80 multiplies
-   *  80 additions
-   * 119 subtractions
-   *  49 shifts (not counting SSO)
-   */
+  return differ;
+#  else
+  return -1;
+#  endif
 }
+# endif
 
 # undef MUL
 # undef SHIFT
@@ -592,7 +390,7 @@ static
 void ICACHE_FLASH_ATTR synth_full(struct mad_synth *synth, struct mad_frame const *frame,
 		unsigned int nch, unsigned int ns)
 {
-  unsigned int phase, ch, s, sb, pe, po;
+  unsigned int phase, ch, s, sb, pe, po, nslot;
   short int *pcm1, *pcm2;
   mad_fixed_t (*filter)[2][2][16][8];
   mad_fixed_t (*sbsample)[36][32];
@@ -601,23 +399,20 @@ void ICACHE_FLASH_ATTR synth_full(struct mad_synth *synth, struct mad_frame cons
   register mad_fixed64hi_t hi;
   register mad_fixed64lo_t lo;
   mad_fixed_t raw_sample;
-  short int short_sample_buff[2][32];
 
   phase = synth->phase;
+  nslot = 0;
 
   if (nch > 2)
     return;
 
   for (s = 0; s < ns; ++s)
   {
-    memset (short_sample_buff[0], 0x00, sizeof(short_sample_buff[0]));
-    memset (short_sample_buff[1], 0x00, sizeof(short_sample_buff[0]));
-
     for (ch = 0; ch < nch; ++ch)
     {
       sbsample = (void*) &frame->sbsample[ch];
       filter   = &synth->filter[ch];
-      pcm1     = short_sample_buff[ch];
+      pcm1     = &synth->block[nslot * 32 * nch + ch];
 
       dct32((*sbsample)[s], phase >> 1,
 	    (*filter)[0][phase & 1], (*filter)[1][phase & 1]);
@@ -656,8 +451,9 @@ void ICACHE_FLASH_ATTR synth_full(struct mad_synth *synth, struct mad_frame cons
 
       raw_sample = SHIFT(MLZ(hi, lo));
       raw_sample = scale(raw_sample);
-      (*pcm1++) += (short int)raw_sample;
-      pcm2 = pcm1 + 30;
+      *pcm1 = (short int)raw_sample;
+      pcm1 += nch;
+      pcm2 = pcm1 + 30 * nch;
 
       for (sb = 1; sb < 16; ++sb)
       {
@@ -690,7 +486,8 @@ void ICACHE_FLASH_ATTR synth_full(struct mad_synth *synth, struct mad_frame cons
 
         raw_sample = SHIFT(MLZ(hi, lo));
         raw_sample = scale(raw_sample);
-        (*pcm1++) += (short int)raw_sample;
+        *pcm1 = (short int)raw_sample;
+        pcm1 += nch;
 
         ptr = *Dptr - pe;
         ML0(hi, lo, (*fe)[0], ptr[31 - 16]);
@@ -714,7 +511,8 @@ void ICACHE_FLASH_ATTR synth_full(struct mad_synth *synth, struct mad_frame cons
 
         raw_sample = SHIFT(MLZ(hi, lo));
         raw_sample = scale(raw_sample);
-        (*pcm2--) += (short int)raw_sample;
+        *pcm2 = (short int)raw_sample;
+        pcm2 -= nch;
 
         ++fo;
       }
@@ -733,20 +531,336 @@ void ICACHE_FLASH_ATTR synth_full(struct mad_synth *synth, struct mad_frame cons
 
       raw_sample = SHIFT(-MLZ(hi, lo));
       raw_sample = scale(raw_sample);
-      (*pcm1) += (short int)raw_sample;
+      *pcm1 = (short int)raw_sample;
 
     }  /* Channel For */
 
+    /* hand a granule of interleaved PCM to the sink at once */
+    if (++nslot == MAD_SYNTH_BLOCK_SLOTS || s == ns - 1)
+    {
 #ifdef NANORADIO
-    /* Render block */
-    render_sample_block(short_sample_buff[0], short_sample_buff[1], 32, nch);
+      render_sample_block(synth->sink, synth->block, nslot * 32, nch);
 #endif
+      nslot = 0;
+    }
     phase = (phase + 1) % 16;
 
   } /* Block for */
 }
 #endif
 
+/*
+ * SIMD polyphase window for host builds.
+ *
+ * Every output sample of synth_full() is the sum of one or two 8-tap dot
+ * products between a row of the filter bank and 8 coefficients picked from
+ * D[] at a phase dependent offset. Those coefficients are gathered once
+ * into contiguous rows (D_even for the ptr[0], ptr[14] .. ptr[2] pattern,
+ * D_odd for the ptr[31 - 16] .. ptr[31 - 2] pattern), so a whole column of
+ * taps becomes one vector load. Each 32x32->64 product is scaled exactly as
+ * mad_f_mul() does and the partial sums wrap in 32 bits like the scalar
+ * MLA chain, so the PCM is bit-exact with the FPM_64BIT path.
+ *
+ * The window of one slot cannot be interleaved with the next: dct32() of
+ * slot s + 1 replaces filter history still needed by slot s. The DCTs
+ * themselves are independent and are batched across slots, see
+ * dct32_batch().
+ */
+# if defined(SYNTH_SIMD)
+#  if defined(OPT_ACCURACY)
+#   define SIMD_ROUND  (1L << (MAD_F_SCALEBITS - 1))
+#  else
+#   define SIMD_ROUND  0
+#  endif
+
+typedef void (*dot8_rows_t)(mad_fixed_t const (*)[8], mad_fixed_t const (*)[8],
+			    unsigned int, mad_fixed_t *);
+
+static mad_fixed_t D_even[16][17][8];	/* [offset][row][tap] */
+static mad_fixed_t D_odd[16][17][8];
+static dot8_rows_t dot8_rows;
+
+#  if defined(FPM_FLOAT)
+/*
+ * Float taps need no widening. Each row is two 4-lane products whose partial
+ * sums are folded as (t0 + t2) + (t1 + t3); four rows are folded together by
+ * a transpose, a row left over on its own, in the same order.
+ */
+typedef int dct_i4 __attribute__((vector_size(16)));
+
+static inline
+dct_v4 dot8_v4(mad_fixed_t const f[8], mad_fixed_t const c[8])
+{
+  dct_v4 a0, a1, b0, b1;
+
+  memcpy(&a0, &f[0], sizeof(a0));
+  memcpy(&a1, &f[4], sizeof(a1));
+  memcpy(&b0, &c[0], sizeof(b0));
+  memcpy(&b1, &c[4], sizeof(b1));
+
+  return a0 * b0 + a1 * b1;
+}
+
+static
+void dot8_rows_float(mad_fixed_t const (*f)[8], mad_fixed_t const (*c)[8],
+		     unsigned int n, mad_fixed_t *out)
+{
+  dct_v4 t0, t1, t2, t3, u0, u1;
+  unsigned int i;
+
+  for (i = 0; i + 4 <= n; i += 4) {
+    t0 = dot8_v4(f[i + 0], c[i + 0]);
+    t1 = dot8_v4(f[i + 1], c[i + 1]);
+    t2 = dot8_v4(f[i + 2], c[i + 2]);
+    t3 = dot8_v4(f[i + 3], c[i + 3]);
+
+    u0 = __builtin_shuffle(t0, t1, (dct_i4) { 0, 4, 1, 5 }) +
+         __builtin_shuffle(t0, t1, (dct_i4) { 2, 6, 3, 7 });
+    u1 = __builtin_shuffle(t2, t3, (dct_i4) { 0, 4, 1, 5 }) +
+         __builtin_shuffle(t2, t3, (dct_i4) { 2, 6, 3, 7 });
+    u0 = __builtin_shuffle(u0, u1, (dct_i4) { 0, 1, 4, 5 }) +
+         __builtin_shuffle(u0, u1, (dct_i4) { 2, 3, 6, 7 });
+
+    memcpy(&out[i], &u0, sizeof(u0));
+  }
+
+  for (; i < n; ++i) {
+    t0 = dot8_v4(f[i], c[i]);
+    out[i] = (t0[0] + t0[2]) + (t0[1] + t0[3]);
+  }
+}
+
+#   define dot8_rows_neon	dot8_rows_float
+#   define dot8_rows_sse41	dot8_rows_float
+#   define dot8_rows_avx2	dot8_rows_float
+#  elif defined(__ARM_NEON)
+static
+void dot8_rows_neon(mad_fixed_t const (*f)[8], mad_fixed_t const (*c)[8],
+		    unsigned int n, mad_fixed_t *out)
+{
+  unsigned int i;
+
+  for (i = 0; i < n; ++i) {
+    int32x4_t a0 = vld1q_s32(f[i]), a1 = vld1q_s32(f[i] + 4);
+    int32x4_t b0 = vld1q_s32(c[i]), b1 = vld1q_s32(c[i] + 4);
+    int32x2_t t;
+
+#   if defined(OPT_ACCURACY)
+#    define NARROW(x)  vrshrn_n_s64((x), MAD_F_SCALEBITS)
+#   else
+#    define NARROW(x)  vshrn_n_s64((x), MAD_F_SCALEBITS)
+#   endif
+    t = vadd_s32(vadd_s32(NARROW(vmull_s32(vget_low_s32(a0),  vget_low_s32(b0))),
+			  NARROW(vmull_s32(vget_high_s32(a0), vget_high_s32(b0)))),
+		 vadd_s32(NARROW(vmull_s32(vget_low_s32(a1),  vget_low_s32(b1))),
+			  NARROW(vmull_s32(vget_high_s32(a1), vget_high_s32(b1)))));
+#   undef NARROW
+
+    out[i] = vget_lane_s32(vpadd_s32(t, t), 0);
+  }
+}
+#  else
+static __attribute__((target("sse4.1")))
+void dot8_rows_sse41(mad_fixed_t const (*f)[8], mad_fixed_t const (*c)[8],
+		     unsigned int n, mad_fixed_t *out)
+{
+  __m128i const round = _mm_set1_epi64x(SIMD_ROUND);
+  unsigned int i;
+
+  for (i = 0; i < n; ++i) {
+    __m128i a0 = _mm_loadu_si128((__m128i const *) &f[i][0]);
+    __m128i a1 = _mm_loadu_si128((__m128i const *) &f[i][4]);
+    __m128i b0 = _mm_loadu_si128((__m128i const *) &c[i][0]);
+    __m128i b1 = _mm_loadu_si128((__m128i const *) &c[i][4]);
+    __m128i e0, o0, e1, o1, t;
+
+    e0 = _mm_mul_epi32(a0, b0);
+    o0 = _mm_mul_epi32(_mm_srli_epi64(a0, 32), _mm_srli_epi64(b0, 32));
+    e1 = _mm_mul_epi32(a1, b1);
+    o1 = _mm_mul_epi32(_mm_srli_epi64(a1, 32), _mm_srli_epi64(b1, 32));
+
+    /* the low dword of each lane now holds mad_f_mul() of one tap */
+    e0 = _mm_srli_epi64(_mm_add_epi64(e0, round), MAD_F_SCALEBITS);
+    o0 = _mm_srli_epi64(_mm_add_epi64(o0, round), MAD_F_SCALEBITS);
+    e1 = _mm_srli_epi64(_mm_add_epi64(e1, round), MAD_F_SCALEBITS);
+    o1 = _mm_srli_epi64(_mm_add_epi64(o1, round), MAD_F_SCALEBITS);
+
+    t = _mm_add_epi32(_mm_add_epi32(e0, o0), _mm_add_epi32(e1, o1));
+    t = _mm_add_epi32(t, _mm_shuffle_epi32(t, _MM_SHUFFLE(1, 0, 3, 2)));
+
+    out[i] = _mm_cvtsi128_si32(t);
+  }
+}
+
+static __attribute__((target("avx2")))
+void dot8_rows_avx2(mad_fixed_t const (*f)[8], mad_fixed_t const (*c)[8],
+		    unsigned int n, mad_fixed_t *out)
+{
+  __m256i const round = _mm256_set1_epi64x(SIMD_ROUND);
+  unsigned int i;
+
+  for (i = 0; i < n; ++i) {
+    __m256i a = _mm256_loadu_si256((__m256i const *) f[i]);
+    __m256i b = _mm256_loadu_si256((__m256i const *) c[i]);
+    __m256i e, o;
+    __m128i t;
+
+    e = _mm256_mul_epi32(a, b);
+    o = _mm256_mul_epi32(_mm256_srli_epi64(a, 32), _mm256_srli_epi64(b, 32));
+
+    e = _mm256_srli_epi64(_mm256_add_epi64(e, round), MAD_F_SCALEBITS);
+    o = _mm256_srli_epi64(_mm256_add_epi64(o, round), MAD_F_SCALEBITS);
+    e = _mm256_add_epi32(e, o);
+
+    t = _mm_add_epi32(_mm256_castsi256_si128(e), _mm256_extracti128_si256(e, 1));
+    t = _mm_add_epi32(t, _mm_shuffle_epi32(t, _MM_SHUFFLE(1, 0, 3, 2)));
+
+    out[i] = _mm_cvtsi128_si32(t);
+  }
+}
+#  endif
+
+/*
+ * NAME:	synth->simd_select()
+ * DESCRIPTION:	build the gathered window tables and pick a kernel by CPU
+ */
+static
+void synth_simd_select(void)
+{
+  static int state;			/* 0 idle, 1 building, 2 ready */
+  unsigned int off, sb, k;
+  int idle = 0;
+
+  /* every decoder instance calls this, the tables are built once */
+  if (__atomic_load_n(&state, __ATOMIC_ACQUIRE) == 2)
+    return;
+  if (!__atomic_compare_exchange_n(&state, &idle, 1, 0,
+				   __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+    while (__atomic_load_n(&state, __ATOMIC_ACQUIRE) != 2)
+      ;
+    return;
+  }
+
+  for (off = 0; off < 16; ++off) {
+    for (sb = 0; sb < 17; ++sb) {
+      D_even[off][sb][0] = D[sb][off];
+      D_odd[off][sb][0]  = sb ? D[sb][15 - off] : 0;
+      for (k = 1; k < 8; ++k) {
+	D_even[off][sb][k] = D[sb][off + 16 - 2 * k];
+	D_odd[off][sb][k]  = sb ? D[sb][15 + 2 * k - off] : 0;
+      }
+    }
+  }
+
+#  if defined(__ARM_NEON)
+  dct32_lanes  = dct32_x4_neon;
+  dct32_nlanes = 4;
+  dot8_rows    = dot8_rows_neon;
+#  else
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    dct32_lanes  = dct32_x8_avx2;
+    dct32_nlanes = 8;
+    dot8_rows    = dot8_rows_avx2;
+  }
+  else if (__builtin_cpu_supports("sse4.1")) {
+    dct32_lanes  = dct32_x4_sse41;
+    dct32_nlanes = 4;
+    dot8_rows    = dot8_rows_sse41;
+  }
+#  endif
+
+  __atomic_store_n(&state, 2, __ATOMIC_RELEASE);
+}
+
+/*
+ * NAME:	synth->simd()
+ * DESCRIPTION:	perform full or, keeping every other sample as synth_half()
+ *		does, half frequency PCM synthesis with vector DCT and
+ *		window sums
+ */
+static inline
+void synth_simd(struct mad_synth *synth, struct mad_frame const *frame,
+		unsigned int nch, unsigned int ns, unsigned int half)
+{
+  unsigned int phase, ch, s, sb, pe, po, nslot;
+  mad_fixed_t (*filter)[2][2][16][8];
+  mad_fixed_t (*fe)[8], (*fx)[8], (*fo)[8];
+  mad_fixed_t even[16], odd[17], x, even_r[16], odd_r[16];
+  mad_fixed_t dct[2][2][16][36];
+  short int *pcm;
+
+  phase = synth->phase;
+  nslot = 0;
+
+  if (nch > 2 || ns > 36)
+    return;
+
+  /* the DCT has no history, so do all slots of the granule up front */
+  for (ch = 0; ch < nch; ++ch)
+    dct32_batch(frame->sbsample[ch], ns, dct[ch]);
+
+  for (s = 0; s < ns; ++s) {
+    pe = phase & ~1;
+    po = ((phase - 1) & 0xf) | 1;
+
+    for (ch = 0; ch < nch; ++ch) {
+      filter = &synth->filter[ch];
+      pcm    = &synth->block[(nslot * 32 >> half) * nch + ch];
+
+      /* the window reads 16 slots of history; add this slot's column */
+      for (sb = 0; sb < 16; ++sb) {
+	(*filter)[0][phase & 1][sb][phase >> 1] = dct[ch][0][sb][s];
+	(*filter)[1][phase & 1][sb][phase >> 1] = dct[ch][1][sb][s];
+      }
+
+      fe = &(*filter)[0][ phase & 1][0];
+      fx = &(*filter)[0][~phase & 1][0];
+      fo = &(*filter)[1][~phase & 1][0];
+
+      /* samples 0..15: fe . D[sb] + pe  -  fo . D[sb] + po */
+      dot8_rows(fe, &D_even[pe][0], 16, even);
+      dot8_rows(fo, &D_even[po][1], 16, &odd[1]);
+      dot8_rows(fx, &D_even[po][0], 1, &x);
+
+      /* samples 31..17: fe . D[sb] - pe  +  fo . D[sb] - po */
+      dot8_rows(fe + 1, &D_odd[pe][1], 15, &even_r[1]);
+      dot8_rows(fo, &D_odd[po][1], 15, &odd_r[1]);
+
+      pcm[0] = (short int) scale(SHIFT(even[0] - x));
+      for (sb = 1 + half; sb < 16; sb += 1 + half) {
+	pcm[(sb >> half) * nch]        = (short int) scale(SHIFT(even[sb] - odd[sb]));
+	pcm[((32 - sb) >> half) * nch] = (short int) scale(SHIFT(even_r[sb] + odd_r[sb]));
+      }
+      pcm[(16 >> half) * nch] = (short int) scale(SHIFT(-odd[16]));
+    }
+
+    /* hand a granule of interleaved PCM to the sink at once */
+    if (++nslot == MAD_SYNTH_BLOCK_SLOTS || s == ns - 1) {
+#ifdef NANORADIO
+      render_sample_block(synth->sink, synth->block, nslot * 32 >> half, nch);
+#endif
+      nslot = 0;
+    }
+    phase = (phase + 1) % 16;
+  }
+}
+
+static
+void synth_full_simd(struct mad_synth *synth, struct mad_frame const *frame,
+		     unsigned int nch, unsigned int ns)
+{
+  synth_simd(synth, frame, nch, ns, 0);
+}
+
+static
+void synth_half_simd(struct mad_synth *synth, struct mad_frame const *frame,
+		     unsigned int nch, unsigned int ns)
+{
+  synth_simd(synth, frame, nch, ns, 1);
+}
+# endif  /* SYNTH_SIMD */
+
 /*
  * NAME:	synth->half()
  * DESCRIPTION:	perform half frequency PCM synthesis
@@ -755,7 +869,7 @@ static
 void ICACHE_FLASH_ATTR synth_half(struct mad_synth *synth, struct mad_frame const *frame,
 		unsigned int nch, unsigned int ns)
 {
-  unsigned int phase, ch, s, sb, pe, po;
+  unsigned int phase, ch, s, sb, pe, po, nslot;
   short int *pcm1, *pcm2;
   mad_fixed_t (*filter)[2][2][16][8];
   mad_fixed_t (*sbsample)[36][32];
@@ -764,23 +878,20 @@ void ICACHE_FLASH_ATTR synth_half(struct mad_synth *synth, struct mad_frame cons
   register mad_fixed64hi_t hi;
   register mad_fixed64lo_t lo;
   mad_fixed_t raw_sample;
-  short int short_sample_buff[2][16];
 
   phase = synth->phase;
+  nslot = 0;
 
   if (nch > 2)
     return;
 
   for (s = 0; s < ns; ++s)
   {
-    memset (short_sample_buff[0], 0x00, sizeof(short_sample_buff[0]));
-    memset (short_sample_buff[1], 0x00, sizeof(short_sample_buff[0]));
-
     for (ch = 0; ch < nch; ++ch)
     {
       sbsample = (void *) &frame->sbsample[ch];
       filter   = &synth->filter[ch];
-      pcm1 = short_sample_buff[ch];
+      pcm1 = &synth->block[nslot * 16 * nch + ch];
 
       dct32((*sbsample)[s], phase >> 1,
 	    (*filter)[0][phase & 1], (*filter)[1][phase & 1]);
@@ -819,8 +930,9 @@ void ICACHE_FLASH_ATTR synth_half(struct mad_synth *synth, struct mad_frame cons
 
       raw_sample = SHIFT(MLZ(hi, lo));
       raw_sample = scale(raw_sample);
-      (*pcm1++) += (short int)raw_sample;
-      pcm2 = pcm1 + 14;
+      *pcm1 = (short int)raw_sample;
+      pcm1 += nch;
+      pcm2 = pcm1 + 14 * nch;
 
       for (sb = 1; sb < 16; ++sb)
       {
@@ -829,6 +941,12 @@ void ICACHE_FLASH_ATTR synth_half(struct mad_synth *synth, struct mad_frame cons
 
         /* D[32 - sb][i] == -D[sb][31 - i] */
 
+        if (sb & 1)
+        {
+          ++fo;
+          continue; /* every other sample only */
+        }
+
         ptr = *Dptr + po;
         ML0(hi, lo, (*fo)[0], ptr[ 0]);
         MLA(hi, lo, (*fo)[1], ptr[14]);
@@ -853,7 +971,8 @@ void ICACHE_FLASH_ATTR synth_half(struct mad_synth *synth, struct mad_frame cons
 
         raw_sample = SHIFT(MLZ(hi, lo));
         raw_sample = scale(raw_sample);
-        (*pcm1++) += (short int)raw_sample;
+        *pcm1 = (short int)raw_sample;
+        pcm1 += nch;
 
         ptr = *Dptr - pe;
         ML0(hi, lo, (*fe)[0], ptr[31 - 16]);
@@ -877,7 +996,8 @@ void ICACHE_FLASH_ATTR synth_half(struct mad_synth *synth, struct mad_frame cons
 
         raw_sample = SHIFT(MLZ(hi, lo));
         raw_sample = scale(raw_sample);
-        (*pcm2--) += (short int)raw_sample;
+        *pcm2 = (short int)raw_sample;
+        pcm2 -= nch;
 
         ++fo;
       }
@@ -896,13 +1016,17 @@ void ICACHE_FLASH_ATTR synth_half(struct mad_synth *synth, struct mad_frame cons
 
       raw_sample = SHIFT(-MLZ(hi, lo));
       raw_sample = scale(raw_sample);
-      (*pcm1) += (short int)raw_sample;
+      *pcm1 = (short int)raw_sample;
 
     } /* Channel For */
+    /* hand a granule of interleaved PCM to the sink at once */
+    if (++nslot == MAD_SYNTH_BLOCK_SLOTS || s == ns - 1)
+    {
 #ifdef NANORADIO
-    /* Block render */
-    render_sample_block(short_sample_buff[0], short_sample_buff[1], 16, nch);
+      render_sample_block(synth->sink, synth->block, nslot * 16, nch);
 #endif
+      nslot = 0;
+    }
     phase = (phase + 1) % 16;
 
   }/* Block For */
@@ -917,28 +1041,41 @@ void ICACHE_FLASH_ATTR mad_synth_frame(struct mad_synth *synth, struct mad_frame
   unsigned int nch, ns;
   void (*synth_frame)(struct mad_synth *, struct mad_frame const *,
 		      unsigned int, unsigned int);
+  MAD_PROFILE_DECL(clock);
+
+  MAD_PROFILE_START(clock);
 
-  nch = MAD_NCHANNELS(&frame->header);
+  nch = MAD_NSBCHANNELS(frame);
   ns  = MAD_NSBSAMPLES(&frame->header);
 
   synth->pcm.samplerate = frame->header.samplerate;
 #ifdef NANORADIO
-  set_dac_sample_rate(synth->pcm.samplerate);
+  set_dac_sample_rate(synth->sink, synth->pcm.samplerate);
 #endif
   synth->pcm.channels   = nch;
   synth->pcm.length     = 32 * ns;
 
   synth_frame = synth_full;
+# if defined(SYNTH_SIMD)
+  if (dot8_rows && !(frame->options & MAD_OPTION_NOSIMD))
+    synth_frame = synth_full_simd;
+# endif
 
   if (frame->options & MAD_OPTION_HALFSAMPLERATE) {
     synth->pcm.samplerate /= 2;
     synth->pcm.length     /= 2;
 #ifdef NANORADIO
-    set_dac_sample_rate(synth->pcm.samplerate);
+    set_dac_sample_rate(synth->sink, synth->pcm.samplerate);
 #endif
     synth_frame = synth_half;
+# if defined(SYNTH_SIMD)
+    if (dot8_rows && !(frame->options & MAD_OPTION_NOSIMD))
+      synth_frame = synth_half_simd;
+# endif
   }
 
   synth_frame(synth, frame, nch, ns);
   synth->phase = (synth->phase + ns) % 16;
+
+  MAD_PROFILE_LAP(clock, MAD_STAGE_SYNTH);
 }
@@ -42,7 +42,9 @@ char const mad_build[] = ""
   "EXPERIMENTAL "
 # endif
 
-# if defined(FPM_64BIT)
+# if defined(FPM_FLOAT)
+  "FPM_FLOAT "
+# elif defined(FPM_64BIT)
   "FPM_64BIT "
 # elif defined(FPM_INTEL)
   "FPM_INTEL "
@@ -0,0 +1,363 @@
+/*
+ * libmad - MPEG audio decoder library
+ * Copyright (C) 2000-2004 Underbit Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+# ifdef HAVE_CONFIG_H
+#  include "config.h"
+# endif
+
+# include "global.h"
+
+# include <string.h>
+
+# include "frame.h"
+# include "xing.h"
+
+/*
+ * NAME:	be32()
+ * DESCRIPTION:	read a big-endian 32-bit field
+ */
+static inline
+unsigned long be32(unsigned char const *ptr)
+{
+  return ((unsigned long) ptr[0] << 24) | ((unsigned long) ptr[1] << 16) |
+    ((unsigned long) ptr[2] << 8) | ptr[3];
+}
+
+/*
+ * NAME:	be16()
+ * DESCRIPTION:	read a big-endian 16-bit field
+ */
+static inline
+unsigned int be16(unsigned char const *ptr)
+{
+  return ((unsigned int) ptr[0] << 8) | ptr[1];
+}
+
+/*
+ * NAME:	xing->init()
+ * DESCRIPTION:	initialize Xing structure
+ */
+void ICACHE_FLASH_ATTR mad_xing_init(struct mad_xing *xing)
+{
+  xing->flags   = 0;
+  xing->frames  = 0;
+  xing->bytes   = 0;
+  xing->scale   = 0;
+  xing->delay   = 0;
+  xing->padding = 0;
+}
+
+/*
+ * NAME:	parse_lame()
+ * DESCRIPTION:	read encoder delay and padding from a LAME tag
+ */
+static
+void ICACHE_FLASH_ATTR parse_lame(struct mad_xing *xing,
+				  unsigned char const *ptr,
+				  unsigned char const *end)
+{
+  /* encoder version string, then fixed fields up to delay and padding */
+
+  if (end - ptr < 24 ||
+      (memcmp(ptr, "LAME", 4) != 0 && memcmp(ptr, "Lavf", 4) != 0 &&
+       memcmp(ptr, "Lavc", 4) != 0))
+    return;
+
+  xing->delay   = (ptr[21] << 4) | (ptr[22] >> 4);
+  xing->padding = ((ptr[22] & 0x0f) << 8) | ptr[23];
+
+  xing->flags |= MAD_XING_LAME;
+}
+
+/*
+ * NAME:	parse_xing()
+ * DESCRIPTION:	read a Xing or Info tag
+ */
+static
+int ICACHE_FLASH_ATTR parse_xing(struct mad_xing *xing,
+				 unsigned char const *ptr,
+				 unsigned char const *end)
+{
+  unsigned int i;
+
+  if (ptr[0] == 'I')
+    xing->flags |= MAD_XING_INFO;
+
+  xing->flags |= be32(ptr + 4) & 0x000f;
+  ptr += 8;
+
+  if (xing->flags & MAD_XING_FRAMES) {
+    if (end - ptr < 4)
+      goto fail;
+
+    xing->frames = be32(ptr);
+    ptr += 4;
+  }
+
+  if (xing->flags & MAD_XING_BYTES) {
+    if (end - ptr < 4)
+      goto fail;
+
+    xing->bytes = be32(ptr);
+    ptr += 4;
+  }
+
+  if (xing->flags & MAD_XING_TOC) {
+    if (end - ptr < 100)
+      goto fail;
+
+    memcpy(xing->toc, ptr, 100);
+    ptr += 100;
+
+    /* a table that runs backwards is of no use for seeking */
+
+    for (i = 1; i < 100; ++i) {
+      if (xing->toc[i] < xing->toc[i - 1]) {
+	xing->flags &= ~MAD_XING_TOC;
+	break;
+      }
+    }
+  }
+
+  if (xing->flags & MAD_XING_SCALE) {
+    if (end - ptr < 4)
+      goto fail;
+
+    xing->scale = be32(ptr);
+    ptr += 4;
+  }
+
+  if (xing->frames == 0)
+    xing->flags &= ~MAD_XING_FRAMES;
+
+  parse_lame(xing, ptr, end);
+
+  return 0;
+
+ fail:
+  xing->flags = 0;
+  return -1;
+}
+
+/*
+ * NAME:	vbri_entry()
+ * DESCRIPTION:	read one entry of a VBRI table
+ */
+static inline
+unsigned long vbri_entry(unsigned char const *table, unsigned int index,
+			 unsigned int size)
+{
+  unsigned char const *ptr = table + index * size;
+  unsigned long value = 0;
+
+  while (size--)
+    value = (value << 8) | *ptr++;
+
+  return value;
+}
+
+/*
+ * NAME:	parse_vbri()
+ * DESCRIPTION:	read a VBRI tag, converting its table to a Xing one
+ */
+static
+int ICACHE_FLASH_ATTR parse_vbri(struct mad_xing *xing,
+				 unsigned char const *ptr,
+				 unsigned char const *end,
+				 unsigned int framelen)
+{
+  unsigned int entries, scale, size, per_entry, i, e;
+  unsigned long pos;
+  unsigned char const *table;
+
+  xing->bytes  = be32(ptr + 10);
+  xing->frames = be32(ptr + 14);
+  entries      = be16(ptr + 18);
+  scale        = be16(ptr + 20);
+  size         = be16(ptr + 22);
+  per_entry    = be16(ptr + 24);
+
+  table = ptr + 26;
+
+  if (xing->bytes == 0 || xing->frames == 0)
+    return -1;
+
+  xing->flags |= MAD_XING_VBRI | MAD_XING_FRAMES | MAD_XING_BYTES;
+
+  if (entries == 0 || size == 0 || size > 4 || per_entry == 0 ||
+      (unsigned long) (end - table) < (unsigned long) entries * size)
+    return 0;
+
+  /*
+   * Each entry is the scaled byte length of per_entry frames, counted
+   * from the frame after this one. Sample the table at every percent of
+   * the frames, interpolating within an entry.
+   */
+
+  pos = framelen;  /* bytes before entry e */
+  e   = 0;
+
+  for (i = 0; i < 100; ++i) {
+    unsigned long frame, into, at;
+
+    frame = (unsigned long long) xing->frames * i / 100;
+
+    while (e + 1 < entries && (unsigned long) (e + 1) * per_entry <= frame)
+      pos += vbri_entry(table, e++, size) * scale;
+
+    into = frame - (unsigned long) e * per_entry;
+    if (into > per_entry)
+      into = per_entry;
+
+    at = pos + (unsigned long long) vbri_entry(table, e, size) * scale *
+      into / per_entry;
+    at = (unsigned long long) at * 256 / xing->bytes;
+
+    xing->toc[i] = (at > 255) ? 255 : at;
+  }
+
+  xing->flags |= MAD_XING_TOC;
+
+  return 0;
+}
+
+/*
+ * NAME:	xing->parse()
+ * DESCRIPTION:	look for a seek index tag in the first frame of a stream
+ */
+int ICACHE_FLASH_ATTR mad_xing_parse(struct mad_xing *xing,
+				     struct mad_header const *header,
+				     unsigned char const *frame,
+				     unsigned int length)
+{
+  unsigned char const *ptr, *end;
+  unsigned int si_len;
+
+  mad_xing_init(xing);
+
+  if (header->layer != MAD_LAYER_III)
+    return -1;
+
+  end = frame + length;
+
+  /* a Xing/Info tag takes the place of main_data, after the side info */
+
+  if (header->flags & MAD_FLAG_LSF_EXT)
+    si_len = (header->mode == MAD_MODE_SINGLE_CHANNEL) ? 9 : 17;
+  else
+    si_len = (header->mode == MAD_MODE_SINGLE_CHANNEL) ? 17 : 32;
+
+  ptr = frame + 4 + si_len;
+  if (header->flags & MAD_FLAG_PROTECTION)
+    ptr += 2;
+
+  if (end - ptr >= 8 &&
+      (memcmp(ptr, "Xing", 4) == 0 || memcmp(ptr, "Info", 4) == 0))
+    return parse_xing(xing, ptr, end);
+
+  /* a VBRI tag is always 32 bytes after the header */
+
+  ptr = frame + 4 + 32;
+
+  if (end - ptr >= 26 && memcmp(ptr, "VBRI", 4) == 0)
+    return parse_vbri(xing, ptr, end, length);
+
+  return -1;
+}
+
+/*
+ * NAME:	stream_ms()
+ * DESCRIPTION:	return the playing time of the indexed frames in ms
+ */
+static
+unsigned long ICACHE_FLASH_ATTR stream_ms(struct mad_xing const *xing,
+					  struct mad_header const *header)
+{
+  return (unsigned long long) xing->frames * 32 * MAD_NSBSAMPLES(header) *
+    1000 / header->samplerate;
+}
+
+/*
+ * NAME:	xing->duration()
+ * DESCRIPTION:	compute the playing time of the stream
+ */
+int ICACHE_FLASH_ATTR mad_xing_duration(struct mad_xing const *xing,
+					struct mad_header const *header,
+					mad_timer_t *duration)
+{
+  unsigned long samples, trim = 0;
+
+  if (!(xing->flags & MAD_XING_FRAMES) || header->samplerate == 0)
+    return -1;
+
+  samples = xing->frames * 32 * MAD_NSBSAMPLES(header);
+
+  if (xing->flags & MAD_XING_LAME)
+    trim = xing->delay + xing->padding;
+
+  mad_timer_set(duration, 0, samples > trim ? samples - trim : 0,
+		header->samplerate);
+
+  return 0;
+}
+
+/*
+ * NAME:	xing->offset()
+ * DESCRIPTION:	map a playing position to a byte offset from the tag frame
+ */
+int ICACHE_FLASH_ATTR mad_xing_offset(struct mad_xing const *xing,
+				      struct mad_header const *header,
+				      mad_timer_t position,
+				      unsigned long *offset)
+{
+  unsigned long total, ms, i, rem;
+  unsigned int a, b, q;
+
+  if ((xing->flags & (MAD_XING_FRAMES | MAD_XING_BYTES)) !=
+      (MAD_XING_FRAMES | MAD_XING_BYTES) || header->samplerate == 0)
+    return -1;
+
+  total = stream_ms(xing, header);
+  ms    = mad_timer_sign(position) < 0 ?
+    0 : mad_timer_count(position, MAD_UNITS_MILLISECONDS);
+
+  if (total == 0 || ms >= total)
+    return -1;
+
+  if (!(xing->flags & MAD_XING_TOC)) {
+    /* without a table the stream is taken to be of constant bitrate */
+
+    *offset = (unsigned long long) xing->bytes * ms / total;
+    return 0;
+  }
+
+  /* interpolate between the percents, q in 1/65536ths of the stream */
+
+  i   = (unsigned long long) ms * 100 / total;
+  rem = (unsigned long long) ms * 100 - (unsigned long long) i * total;
+
+  a = xing->toc[i];
+  b = (i < 99) ? xing->toc[i + 1] : 256;
+
+  q = (a << 8) + (unsigned long) ((unsigned long long) (b - a) * 256 * rem / total);
+
+  *offset = ((unsigned long long) xing->bytes * q) >> 16;
+
+  return 0;
+}
@@ -0,0 +1,63 @@
+/*
+ * libmad - MPEG audio decoder library
+ * Copyright (C) 2000-2004 Underbit Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+# ifndef LIBMAD_XING_H
+# define LIBMAD_XING_H
+
+# include "frame.h"
+
+/*
+ * Seek index of a VBR stream, read from the Xing/Info or VBRI tag its
+ * encoder puts in place of the first frame's audio, and the LAME tag
+ * that may follow a Xing/Info tag. A VBRI table is converted to the
+ * 100-point form of the Xing one, so seeking needs only the latter.
+ */
+
+enum {
+  MAD_XING_FRAMES = 0x0001,		/* frame count known */
+  MAD_XING_BYTES  = 0x0002,		/* byte count known */
+  MAD_XING_TOC    = 0x0004,		/* seek table present */
+  MAD_XING_SCALE  = 0x0008,		/* VBR quality present */
+
+  MAD_XING_INFO   = 0x0100,		/* "Info" tag of a CBR stream */
+  MAD_XING_VBRI   = 0x0200,		/* converted from a VBRI tag */
+  MAD_XING_LAME   = 0x0400		/* encoder delay and padding known */
+};
+
+struct mad_xing {
+  int flags;				/* fields present (see above) */
+  unsigned long frames;			/* audio frames in the stream */
+  unsigned long bytes;			/* stream bytes from the tag frame */
+  unsigned char toc[100];		/* offset at each percent, 1/256ths */
+  long scale;				/* VBR quality, 0 (best) to 100 */
+  unsigned int delay;			/* encoder delay, samples */
+  unsigned int padding;			/* encoder padding, samples */
+};
+
+void mad_xing_init(struct mad_xing *);
+
+int mad_xing_parse(struct mad_xing *, struct mad_header const *,
+		   unsigned char const *, unsigned int);
+
+int mad_xing_duration(struct mad_xing const *, struct mad_header const *,
+		      mad_timer_t *);
+int mad_xing_offset(struct mad_xing const *, struct mad_header const *,
+		    mad_timer_t, unsigned long *);
+
+# endif
@@ -0,0 +1,228 @@
+/*
+ *  NanoRadio (Open source IoT hardware)
+ *
+ *  This project is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License(GPL)
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This project is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+/*
+ * Host name cache benchmark. getaddrinfo() is replaced by a stub resolver
+ * that answers 127.0.0.1 after 'delay' ms, and fails for names under
+ * .invalid. A local stand-in station sends each stream a few KB and drops
+ * it. Reports the time from each reconnect to the first byte of the body,
+ * the lookups a connection retry loop makes to a name that does not
+ * resolve, and how long dns_cache_lookup() holds up its caller. With -u
+ * the cache is flushed before every connection, as every connection looked
+ * the name up before.
+ *
+ *   dns-bench [-u] [-n reconnects] [-d delay_ms] [-s body_bytes]
+ */
+
+#include "portable.h"
+#include "util-task.h"
+#include "http-protocol.h"
+#include "dns-cache.h"
+#include "bench-util.h"
+
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+typedef struct
+{
+  int delay;              /* ms the stub resolver takes */
+  int body_size;
+  int listen_fd;
+  volatile long queries;
+  double first_byte;      /* bench_now() the first byte of the body came */
+  long body_read;
+} bench_t;
+
+/* The HTTP events carry no context. */
+static bench_t bench;
+
+/* Stub resolver, in place of the one of the C library */
+int
+getaddrinfo(const char *node, const char *service, const struct addrinfo *hints, struct addrinfo **res)
+{
+  struct addrinfo *ai;
+  struct sockaddr_in *sin;
+  size_t len = strlen(node);
+
+  __sync_fetch_and_add(&bench.queries, 1);
+  util_task_sleep(bench.delay);
+  if( len >= 8 && !strcmp(node + len - 8, ".invalid") )
+    return EAI_NONAME;
+  if( !(ai = ws_malloc(sizeof(*ai) + sizeof(*sin))) )
+    return EAI_MEMORY;
+  ws_bzero(ai, sizeof(*ai) + sizeof(*sin));
+  sin = (struct sockaddr_in *)(ai + 1);
+  sin->sin_family = AF_INET;
+  sin->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  ai->ai_family = AF_INET;
+  ai->ai_socktype = SOCK_STREAM;
+  ai->ai_addr = (struct sockaddr *)sin;
+  ai->ai_addrlen = sizeof(*sin);
+  *res = ai;
+  return 0;
+  WS_UNUSED(service); WS_UNUSED(hints);
+}
+
+void
+freeaddrinfo(struct addrinfo *res)
+{
+  ws_free(res);
+}
+
+/* Stand-in station, a task for each connection, which drops the stream */
+static void
+NC_P(task_conn)(void *opaque)
+{
+  static const char header[] = "HTTP/1.1 200 OK\r\nContent-Type: audio/mpeg\r\n\r\n";
+  int fd = (int)(intptr_t)opaque;
+  char req[1024], *resp;
+  int pos, len;
+
+  for(pos = 0; pos < (int)sizeof(req) - 1; pos += len)
+    {
+      if( (len = recv(fd, req + pos, sizeof(req) - 1 - pos, 0)) <= 0 )
+        break;
+      req[pos + len] = '\0';
+      if( strstr(req, "\r\n\r\n") )
+        break;
+    }
+  if( len > 0 && (resp = ws_malloc(sizeof(header) + bench.body_size)) )
+    {
+      strcpy(resp, header);
+      memset(resp + sizeof(header) - 1, 'x', bench.body_size);
+      send(fd, resp, sizeof(header) - 1 + bench.body_size, 0);
+      ws_free(resp);
+    }
+  close(fd);
+  util_task_exit();
+}
+
+static int
+NC_P(event_body)(char *at, int length)
+{
+  if( !bench.body_read )
+    bench.first_byte = bench_now();
+  bench.body_read += length;
+  return 0;
+  WS_UNUSED(at);
+}
+
+int
+main(int argc, char **argv)
+{
+  static http_t http;
+  static char buff[HTTP_BUFF_SIZE];
+  int uncached = 0, reconnects = 20, port, i, rc, failed = 0, pending = 0;
+  double t, total = 0, longest = 0, call, answer;
+  long queries;
+  struct in_addr addr;
+  http_event_procs_t procs;
+  dns_cache_stats_t stats;
+
+  bench.delay = 50;
+  bench.body_size = 4096;
+
+  for(i = 1; i < argc; i++)
+    {
+      if( !strcmp(argv[i], "-u") )
+        uncached = 1;
+      else if( !strcmp(argv[i], "-n") && i + 1 < argc )
+        reconnects = atoi(argv[++i]);
+      else if( !strcmp(argv[i], "-d") && i + 1 < argc )
+        bench.delay = atoi(argv[++i]);
+      else if( !strcmp(argv[i], "-s") && i + 1 < argc )
+        bench.body_size = atoi(argv[++i]);
+      else
+        {
+          fprintf(stderr, "usage: %s [-u] [-n reconnects] [-d delay_ms] [-s body_bytes]\n", argv[0]);
+          return 1;
+        }
+    }
+  if( reconnects <= 0 || bench.body_size <= 0 || bench.delay < 0 )
+    return 1;
+
+  if( dns_cache_init() ||
+      (bench.listen_fd = bench_listen_local(&port, 4)) < 0 ||
+      bench_serve(bench.listen_fd, task_conn) )
+    {
+      fprintf(stderr, "cannot serve on the loopback interface\n");
+      return 1;
+    }
+
+  http_callbacks_init(&procs);
+  procs.event_body = event_body;
+
+  /* the stream drops, and is connected to again right away */
+  for(i = 0; i < reconnects; i++)
+    {
+      if( uncached )
+        dns_cache_flush();
+      bench.body_read = 0;
+      t = bench_now();
+      http_init(&http, buff, sizeof(buff));
+      if( (rc = http_request(&http, "station.test", "/stream", port, -1, -1)) ||
+          (rc = http_read_response(&http, &procs)) || bench.body_read != bench.body_size )
+        failed++;
+      ws_socket_close(&http.socket);
+      if( !bench.body_read )
+        continue;
+      t = bench.first_byte - t;
+      total += t;
+      if( t > longest )
+        longest = t;
+    }
+
+  /* the retry loop of a connection to a name that does not resolve */
+  queries = bench.queries;
+  for(i = 0; i < 20; i++)
+    {
+      if( uncached )
+        dns_cache_flush();
+      if( http_request(&http, "gone.invalid", "/stream", port, -1, -1) != -WERR_CONN_FATAL )
+        failed++;
+      ws_socket_close(&http.socket);
+    }
+  queries = bench.queries - queries;
+
+  /* a name looked up by the worker */
+  t = bench_now();
+  if( (rc = dns_cache_lookup("next.test", &addr)) == -WERR_AGAIN )
+    pending = 1;
+  else if( rc )
+    failed++;
+  call = bench_now() - t;
+  while( (rc = dns_cache_lookup("next.test", &addr)) == -WERR_AGAIN )
+    util_task_sleep(1);
+  answer = bench_now() - t;
+  if( rc || addr.s_addr != htonl(INADDR_LOOPBACK) )
+    failed++;
+
+  printf("%s, %d ms stub resolver, streams of %d bytes dropped and reconnected\n",
+         uncached ? "no cache" : "cache", bench.delay, bench.body_size);
+  printf("%d reconnects, first byte %.1f ms mean, %.1f ms longest\n",
+         reconnects, total * 1000 / reconnects, longest * 1000);
+  printf("20 connection retries to a name that does not resolve: %ld lookups\n", queries);
+  printf("dns_cache_lookup(): %s, returned in %.3f ms, address in %.1f ms\n",
+         pending ? "looked up by the worker" : "answered", call * 1000, answer * 1000);
+  dns_cache_get_stats(&stats);
+  printf("%ld lookups in all, cache: %lu queries, %lu hits, %lu stale, %lu negative hits\n",
+         bench.queries, stats.queries, stats.hits, stats.stale, stats.failed);
+  printf("%d failed\n", failed);
+
+  close(bench.listen_fd);
+  return failed ? 1 : 0;
+}
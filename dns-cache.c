@@ -0,0 +1,353 @@
+/*
+ *  NanoRadio (Open source IoT hardware)
+ *
+ *  This project is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License(GPL)
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This project is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+/*
+ * Host name cache. An address is kept for DNS_CACHE_TTL_MS, getaddrinfo()
+ * does not tell the TTL of the record. A name that did not resolve is
+ * answered as such for DNS_CACHE_NEG_MS, so retries of a connection do not
+ * ask again each time. An expired address is still answered for
+ * DNS_CACHE_STALE_MS more while a worker task looks the name up again, and
+ * kept if that fails. dns_cache_lookup() never waits, the worker resolves
+ * a name it does not know yet.
+ */
+#define TRACE_UNIT "dns"
+
+#include "portable.h"
+
+#if PORT (SOCKET)
+# include <netdb.h>
+# include <netinet/in.h>
+# include <sys/socket.h>
+#elif PORT (LWIP)
+# include "lwip/sockets.h"
+# include "lwip/netdb.h"
+#endif
+
+#include "util-logtrace.h"
+#include "util-task.h"
+
+#include "dns-cache.h"
+
+#define DNS_CACHE_SIZE 8
+#define DNS_CACHE_HOST 64
+#define DNS_CACHE_TTL_MS 600000
+#define DNS_CACHE_NEG_MS 5000
+#define DNS_CACHE_STALE_MS 3600000
+#define DNS_CACHE_POLL_MS 10
+
+enum {
+  DNS_EMPTY = 0,
+  DNS_PENDING,  /* no address yet, being looked up */
+  DNS_OK,
+  DNS_FAILED
+};
+
+typedef struct {
+  char host[DNS_CACHE_HOST];
+  struct in_addr addr;
+  char state;
+  char lookup;          /* the worker is to look it up, or is doing so */
+  unsigned long expires; /* util_task_get_ms() */
+  unsigned long used;
+} dns_entry_t;
+
+static dns_entry_t dns_cache[DNS_CACHE_SIZE];
+static dns_cache_stats_t dns_stats;
+static util_mutex_t dns_mux;
+static util_semaphore_t dns_wake;
+static char dns_inited;
+
+static int
+NC_P(dns_query)(const char *host, struct in_addr *addr)
+{
+  struct addrinfo hints, *res = NULL;
+
+  ws_bzero(&hints, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  if( getaddrinfo(host, NULL, &hints, &res) || !res )
+    {
+      trace_error(("failed to parse host IP address\n"));
+      return -WERR_CONN_FATAL;
+    }
+  *addr = ((struct sockaddr_in *)res->ai_addr)->sin_addr;
+  freeaddrinfo(res);
+  return 0;
+}
+
+static dns_entry_t *
+NC_P(dns_find)(const char *host)
+{
+  int i;
+  for(i = 0; i < DNS_CACHE_SIZE; i++)
+    if( dns_cache[i].state != DNS_EMPTY && !strcmp(dns_cache[i].host, host) )
+      return &dns_cache[i];
+  return NULL;
+}
+
+/* An entry for host, a free one or else the one unused for longest.
+ * Names being looked up stay. */
+static dns_entry_t *
+NC_P(dns_claim)(const char *host, unsigned long now)
+{
+  dns_entry_t *entry, *pick = NULL;
+  int i;
+
+  for(i = 0; i < DNS_CACHE_SIZE; i++)
+    {
+      entry = &dns_cache[i];
+      if( entry->state == DNS_EMPTY )
+        {
+          pick = entry;
+          break;
+        }
+      if( !entry->lookup && (!pick || now - entry->used > now - pick->used) )
+        pick = entry;
+    }
+  if( pick )
+    {
+      ws_bzero(pick, sizeof(*pick));
+      strcpy(pick->host, host);
+      pick->used = now;
+    }
+  return pick;
+}
+
+/* Put the outcome of a lookup to the entry of host */
+static void
+NC_P(dns_store)(dns_entry_t *entry, const char *host, int rc, const struct in_addr *addr)
+{
+  unsigned long now = util_task_get_ms();
+
+  if( !entry && !(entry = dns_find(host)) && !(entry = dns_claim(host, now)) )
+    return;
+  entry->lookup = 0;
+  if( !rc )
+    {
+      entry->addr = *addr;
+      entry->state = DNS_OK;
+      entry->expires = now + DNS_CACHE_TTL_MS;
+    }
+  else if( entry->state == DNS_OK )
+    entry->expires = now + DNS_CACHE_NEG_MS; /* keep the address, ask again later */
+  else
+    {
+      entry->state = DNS_FAILED;
+      entry->expires = now + DNS_CACHE_NEG_MS;
+    }
+}
+
+static void
+NC_P(task_dns)(void *opaque)
+{
+  char host[DNS_CACHE_HOST];
+  struct in_addr addr;
+  dns_entry_t *entry;
+  int i, rc;
+
+  for(;;)
+    {
+      util_semaphore_take(dns_wake);
+      for(;;)
+        {
+          util_mutex_take(dns_mux);
+          for(entry = NULL, i = 0; i < DNS_CACHE_SIZE && !entry; i++)
+            if( dns_cache[i].lookup == 1 )
+              entry = &dns_cache[i];
+          if( !entry )
+            {
+              util_mutex_give(dns_mux);
+              break;
+            }
+          entry->lookup = 2; /* in progress */
+          strcpy(host, entry->host);
+          util_mutex_give(dns_mux);
+
+          rc = dns_query(host, &addr);
+
+          util_mutex_take(dns_mux);
+          dns_stats.queries++;
+          /* flushed or forgotten meanwhile */
+          if( entry->state != DNS_EMPTY && entry->lookup == 2 && !strcmp(entry->host, host) )
+            dns_store(entry, host, rc, &addr);
+          util_mutex_give(dns_mux);
+        }
+    }
+  WS_UNUSED(opaque);
+}
+
+/* Have the worker look up 'entry', with dns_mux taken */
+static void
+NC_P(dns_queue)(dns_entry_t *entry)
+{
+  if( !entry->lookup )
+    {
+      entry->lookup = 1;
+      util_semaphore_give(dns_wake);
+    }
+}
+
+/* Start the cache, once at startup before any task looks names up. Until
+ * it is started names are looked up uncached. */
+int
+NC_P(dns_cache_init)(void)
+{
+  if( util_atomic_load(&dns_inited) )
+    return 0;
+  if( (!dns_mux && !(dns_mux = util_create_mutex())) ||
+      (!dns_wake && !(dns_wake = util_create_semaphore(0))) )
+    return -WERR_NO_MEMORY;
+  if( util_create_task(task_dns, "dns", 512, CORE_PROTO_STACK, NULL) )
+    return -WERR_FAILED;
+  util_atomic_store(&dns_inited, 1);
+  return 0;
+}
+
+/* Answer for host from the cache if it can. Returns 0 with *addr, < 0 when
+ * the name did not resolve lately, or 1 when it has to be looked up. */
+static int
+NC_P(dns_answer)(const char *host, struct in_addr *addr, unsigned long now, dns_entry_t **pentry)
+{
+  dns_entry_t *entry = *pentry = dns_find(host);
+  long left;
+
+  if( !entry )
+    return 1;
+  left = (long)(entry->expires - now);
+  entry->used = now;
+  switch( entry->state )
+    {
+      case DNS_OK:
+        if( left > 0 )
+          {
+            dns_stats.hits++;
+            *addr = entry->addr;
+            return 0;
+          }
+        if( left > -DNS_CACHE_STALE_MS )
+          {
+            dns_stats.stale++;
+            dns_queue(entry);
+            *addr = entry->addr;
+            return 0;
+          }
+        break;
+      case DNS_FAILED:
+        if( left > 0 )
+          {
+            dns_stats.failed++;
+            return -WERR_CONN_FATAL;
+          }
+        break;
+    }
+  return 1;
+}
+
+/* The address of host, from the cache or else looked up, waiting for it.
+ * Returns -WERR_CONN_FATAL if the name does not resolve. */
+int
+NC_P(dns_cache_resolve)(const char *host, struct in_addr *addr)
+{
+  dns_entry_t *entry;
+  int rc;
+
+  if( strlen(host) >= DNS_CACHE_HOST || !util_atomic_load(&dns_inited) )
+    return dns_query(host, addr);
+
+  util_mutex_take(dns_mux);
+  /* the worker may be at it already */
+  while( (rc = dns_answer(host, addr, util_task_get_ms(), &entry)) > 0 && entry && entry->lookup )
+    {
+      util_mutex_give(dns_mux);
+      util_task_sleep(DNS_CACHE_POLL_MS);
+      util_mutex_take(dns_mux);
+    }
+  util_mutex_give(dns_mux);
+  if( rc <= 0 )
+    return rc;
+
+  rc = dns_query(host, addr);
+
+  util_mutex_take(dns_mux);
+  dns_stats.queries++;
+  dns_store(NULL, host, rc, addr);
+  util_mutex_give(dns_mux);
+  return rc;
+}
+
+/* As dns_cache_resolve(), but returns -WERR_AGAIN rather than wait while
+ * the worker looks the name up. */
+int
+NC_P(dns_cache_lookup)(const char *host, struct in_addr *addr)
+{
+  dns_entry_t *entry;
+  int rc;
+
+  if( strlen(host) >= DNS_CACHE_HOST || !util_atomic_load(&dns_inited) )
+    return dns_query(host, addr);
+
+  util_mutex_take(dns_mux);
+  if( (rc = dns_answer(host, addr, util_task_get_ms(), &entry)) > 0 )
+    {
+      if( entry || (entry = dns_claim(host, util_task_get_ms())) )
+        {
+          if( entry->state != DNS_OK )
+            entry->state = DNS_PENDING;
+          dns_queue(entry);
+          rc = -WERR_AGAIN;
+        }
+    }
+  util_mutex_give(dns_mux);
+
+  if( rc > 0 ) /* no room while all names are being looked up */
+    rc = dns_query(host, addr);
+  return rc;
+}
+
+/* Drop the address of host, as when it could not be connected to */
+void
+NC_P(dns_cache_forget)(const char *host)
+{
+  dns_entry_t *entry;
+
+  if( !util_atomic_load(&dns_inited) )
+    return;
+  util_mutex_take(dns_mux);
+  if( (entry = dns_find(host)) && entry->state == DNS_OK )
+    ws_bzero(entry, sizeof(*entry));
+  util_mutex_give(dns_mux);
+}
+
+/* Drop all names, as when the network changed */
+void
+NC_P(dns_cache_flush)(void)
+{
+  if( !util_atomic_load(&dns_inited) )
+    return;
+  util_mutex_take(dns_mux);
+  ws_bzero(dns_cache, sizeof(dns_cache));
+  util_mutex_give(dns_mux);
+}
+
+void
+NC_P(dns_cache_get_stats)(dns_cache_stats_t *stats)
+{
+  char inited = util_atomic_load(&dns_inited);
+
+  if( inited )
+    util_mutex_take(dns_mux);
+  *stats = dns_stats;
+  if( inited )
+    util_mutex_give(dns_mux);
+}
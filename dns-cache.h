@@ -0,0 +1,35 @@
+/*
+ *  NanoRadio (Open source IoT hardware)
+ *
+ *  This project is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License(GPL)
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This project is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+#ifndef DNS_CACHE_H_
+#define DNS_CACHE_H_
+
+#include "portable.h"
+
+struct in_addr;
+
+typedef struct {
+  unsigned long queries;  /* lookups that went to the resolver */
+  unsigned long hits;     /* answered from the cache */
+  unsigned long stale;    /* answered with an expired address while it is looked up again */
+  unsigned long failed;   /* answered with a cached failure */
+} dns_cache_stats_t;
+
+int NC_P(dns_cache_init)(void);
+int NC_P(dns_cache_resolve)(const char *host, struct in_addr *addr);
+int NC_P(dns_cache_lookup)(const char *host, struct in_addr *addr);
+void NC_P(dns_cache_forget)(const char *host);
+void NC_P(dns_cache_flush)(void);
+void NC_P(dns_cache_get_stats)(dns_cache_stats_t *stats);
+
+#endif
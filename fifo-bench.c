@@ -0,0 +1,165 @@
+/*
+ *  NanoRadio (Open source IoT hardware)
+ *
+ *  This project is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License(GPL)
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This project is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+/*
+ * Audio FIFO benchmark. This file is built twice, once against the lock
+ * free FIFO of af-buffer.c and, with FIFO_BENCH_MUTEX and the
+ * audio_buffer_* names renamed, against its mutex one. For each, a writer
+ * task pushes 'MB' of a counting byte pattern in writes of 'write_bytes'
+ * as the HTTP task does, and the reader takes them in reads of
+ * 'read_bytes' as the decoder does, checking that every byte comes out
+ * in order. Reports MB/s and the overflow and underflow counts of each.
+ * Exits with 1 if a byte came out wrong.
+ *
+ *   fifo-bench [-s MB] [-w write_bytes] [-r read_bytes]
+ */
+
+#include "portable.h"
+#include "util-task.h"
+#include "af-buffer.h"
+#include "bench-util.h"
+
+#if defined(FIFO_BENCH_MUTEX)
+# define FIFO(name)  name##_mutex
+#else
+# define FIFO(name)  name##_spsc
+#endif
+
+typedef struct
+{
+  long bytes;
+  int write_len, read_len;
+  long overflow, underflow;
+  long wrong;
+  double seconds;
+} fifo_run_t;
+
+extern int fifo_run_spsc(fifo_run_t *run);
+extern int fifo_run_mutex(fifo_run_t *run);
+
+static fifo_run_t *writing;
+static util_semaphore_t writer_done;
+
+static void
+NC_P(task_writer)(void *opaque)
+{
+  fifo_run_t *run = writing;
+  char *buf = ws_malloc(run->write_len);
+  long sent = 0;
+  int n, i;
+
+  (void)opaque;
+  while( sent < run->bytes )
+    {
+      n = run->bytes - sent < run->write_len ? (int)(run->bytes - sent) : run->write_len;
+      for(i = 0; i < n; i++)
+        buf[i] = (char)(sent + i);
+      audio_buffer_write(buf, n);
+      sent += n;
+    }
+
+  ws_free(buf);
+  util_semaphore_give(writer_done);
+  util_task_exit();
+}
+
+/* Move run->bytes through the FIFO, reading on this task */
+int
+FIFO(fifo_run)(fifo_run_t *run)
+{
+  char *buf = ws_malloc(run->read_len);
+  long got = 0;
+  int n, i;
+
+  if( !buf || !audio_buffer_init() )
+    return -1;
+  writing = run;
+  writer_done = util_create_semaphore(0);
+
+  run->seconds = bench_now();
+  if( util_create_task(task_writer, "writer", 0, CORE_STREAM, NULL) )
+    return -1;
+  while( got < run->bytes )
+    {
+      n = run->bytes - got < run->read_len ? (int)(run->bytes - got) : run->read_len;
+      audio_buffer_read(buf, n);
+      for(i = 0; i < n; i++)
+        if( buf[i] != (char)(got + i) )
+          run->wrong++;
+      got += n;
+    }
+  util_semaphore_take(writer_done);
+  run->seconds = bench_now() - run->seconds;
+
+  run->overflow = audio_buffer_get_overflow();
+  run->underflow = audio_buffer_get_underflow();
+  util_destroy_semaphore(writer_done);
+  ws_free(buf);
+  return 0;
+}
+
+#if !defined(FIFO_BENCH_MUTEX)
+
+int
+main(int argc, char **argv)
+{
+  static const char *const names[2] = { "spsc", "mutex" };
+  fifo_run_t run[2];
+  long mb = 64;
+  int write_len = 1460, read_len = 2048, i;
+
+  for(i = 1; i < argc; i++)
+    {
+      if( !strcmp(argv[i], "-s") && i + 1 < argc )
+        mb = atol(argv[++i]);
+      else if( !strcmp(argv[i], "-w") && i + 1 < argc )
+        write_len = atoi(argv[++i]);
+      else if( !strcmp(argv[i], "-r") && i + 1 < argc )
+        read_len = atoi(argv[++i]);
+      else
+        {
+          fprintf(stderr, "usage: %s [-s MB] [-w write_bytes] [-r read_bytes]\n", argv[0]);
+          return 1;
+        }
+    }
+  if( mb < 1 || write_len < 1 || read_len < 1 )
+    return 1;
+
+  ws_bzero(run, sizeof(run));
+  for(i = 0; i < 2; i++)
+    {
+      run[i].bytes = mb << 20;
+      run[i].write_len = write_len;
+      run[i].read_len = read_len;
+    }
+  if( fifo_run_spsc(&run[0]) || fifo_run_mutex(&run[1]) )
+    {
+      fprintf(stderr, "cannot start the FIFO\n");
+      return 1;
+    }
+
+  printf("%ld MB in writes of %d bytes, reads of %d, through a %d byte FIFO\n",
+         mb, write_len, read_len, audio_buffer_size());
+  printf("%-6s %10s %10s %10s %8s\n", "", "MB/s", "overflows", "underflows", "wrong");
+  for(i = 0; i < 2; i++)
+    printf("%-6s %10.1f %10ld %10ld %8ld\n", names[i],
+           run[i].seconds > 0 ? mb / run[i].seconds : 0.0,
+           run[i].overflow, run[i].underflow, run[i].wrong);
+  printf("spsc %.2fx the mutex FIFO\n",
+         run[0].seconds > 0 ? run[1].seconds / run[0].seconds : 0.0);
+
+  return run[0].wrong || run[1].wrong;
+}
+
+#endif /* FIFO_BENCH_MUTEX */
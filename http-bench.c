@@ -0,0 +1,336 @@
+/*
+ *  NanoRadio (Open source IoT hardware)
+ *
+ *  This project is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License(GPL)
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This project is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+/*
+ * HTTP response parser benchmark. Builds a response around a random body,
+ * once with Content-Length and once chunked with random chunk sizes and
+ * extensions, and feeds it to http_read_response through a stand-in socket.
+ * The fuzz rounds cut the response into reads of random size, so chunk size
+ * lines and CRLFs fall across read boundaries, and check the body that
+ * comes out against the one that went in. The timed rounds then read as
+ * much as they can each time and report bytes per cycle and the reads
+ * taken per MB. -b sets the size of the http_t buffer, -z has the body read
+ * in place to a consumer buffer of the given size instead of passed through it.
+ * -k reads as on a connection kept alive, where a round also fails if the
+ * response does not end the body right at its last byte without waiting for
+ * the server to close.
+ * Exits with 1 if any round did not give back the body.
+ *
+ *   http-bench [-s body_bytes] [-c max_chunk] [-r max_read] [-n fuzz_rounds] [-t timed_rounds]
+ *              [-b buff_bytes] [-z dest_bytes] [-k]
+ */
+
+#include "portable.h"
+#include "http-protocol.h"
+#include "bench-util.h"
+
+#include <time.h>
+
+typedef struct
+{
+  const char *resp;      /* the response being read */
+  long resp_size;
+  long resp_pos;
+  int max_read;          /* reads are cut at random to 1..max_read, or not when 0 */
+  unsigned long seed;
+  long reads;
+
+  const char *body;      /* what event_body must hand on */
+  long body_size;
+  long body_pos;
+  long calls;
+  char mismatch;
+
+  char *dest;            /* the consumer's buffer in place mode */
+  int dest_size;
+  char keepalive;
+} bench_t;
+
+/* The HTTP events carry no context. */
+static bench_t bench;
+
+static unsigned long
+rnd(unsigned long *seed)
+{
+  *seed = (*seed * 1103515245UL + 12345UL) & 0xffffffffUL;
+  return *seed >> 8;
+}
+
+static unsigned long long
+clock_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  unsigned int lo, hi;
+
+  __asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+  return ((unsigned long long) hi << 32) | lo;
+#else
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+/*
+ * Stand-in socket, taking the place of tcp-socket.c.
+ */
+int
+NC_P(ws_socket_conn)(tcp_socket_t *socket, const char *host, int port, int retry)
+{ return 0; WS_UNUSED(socket); WS_UNUSED(host); WS_UNUSED(port); WS_UNUSED(retry); }
+
+int
+NC_P(ws_socket_send)(tcp_socket_t *socket, const char *buffer, size_t size, int flags)
+{ return (int)size; WS_UNUSED(socket); WS_UNUSED(buffer); WS_UNUSED(flags); }
+
+void
+NC_P(ws_socket_close)(tcp_socket_t *socket)
+{ WS_UNUSED(socket); }
+
+int
+NC_P(ws_socket_idle)(tcp_socket_t *socket)
+{ return 1; WS_UNUSED(socket); }
+
+int
+NC_P(ws_socket_recv)(tcp_socket_t *socket, char *buffer, size_t size, int flags)
+{
+  long n = bench.resp_size - bench.resp_pos;
+
+  if( n > (long)size )
+    n = (long)size;
+  if( !n && bench.keepalive )
+    {
+      bench.mismatch = 1; /* a server keeping the connection would not close it now */
+      return -WERR_FAILED;
+    }
+  if( bench.max_read && n > 1 )
+    {
+      long cut = 1 + (long)(rnd(&bench.seed) % bench.max_read);
+      if( n > cut )
+        n = cut;
+    }
+  memcpy(buffer, bench.resp + bench.resp_pos, n);
+  bench.resp_pos += n;
+  bench.reads++;
+  return (int)n;
+  WS_UNUSED(socket);
+  WS_UNUSED(flags);
+}
+
+static int
+NC_P(event_body)(char *at, int length)
+{
+  bench.calls++;
+  if( length <= 0 || bench.body_pos + length > bench.body_size ||
+      memcmp(at, bench.body + bench.body_pos, length) )
+    bench.mismatch = 1;
+  else
+    bench.body_pos += length;
+  return 0;
+}
+
+static char *
+NC_P(event_body_buffer)(int *length)
+{
+  *length = bench.dest_size;
+  return bench.dest;
+}
+
+static int
+NC_P(event_body_commit)(int length)
+{
+  return event_body(bench.dest, length);
+}
+
+/* Response with the body sent as it is, or in chunks of 1..max_chunk bytes */
+static char *
+NC_P(build_response)(const char *body, long size, int chunked, int max_chunk, unsigned long seed, long *resp_size)
+{
+  static const char plain[] = "HTTP/1.1 200 OK\r\nContent-Type: audio/mpeg\r\nContent-Length: %ld\r\n\r\n";
+  static const char chunks[] = "HTTP/1.1 200 OK\r\nContent-Type: audio/mpeg\r\nTransfer-Encoding: chunked\r\n\r\n";
+  char *resp = ws_malloc(size + size / 2 + 40 * (size / max_chunk + 2) + 256);
+  long pos, n, i;
+
+  if( !resp )
+    return NULL;
+  if( !chunked )
+    {
+      pos = sprintf(resp, plain, size);
+      memcpy(resp + pos, body, size);
+      *resp_size = pos + size;
+      return resp;
+    }
+
+  pos = sprintf(resp, "%s", chunks);
+  for(i = 0; i < size; i += n)
+    {
+      n = 1 + (long)(rnd(&seed) % max_chunk);
+      if( n > size - i )
+        n = size - i;
+      /* mixed case hex, sometimes with leading zeros or an extension */
+      switch( rnd(&seed) % 4 )
+        {
+        case 0: pos += sprintf(resp + pos, "%lX\r\n", n); break;
+        case 1: pos += sprintf(resp + pos, "%lx;name=value\r\n", n); break;
+        case 2: pos += sprintf(resp + pos, "00%lx \r\n", n); break;
+        default: pos += sprintf(resp + pos, "%lx\r\n", n); break;
+        }
+      memcpy(resp + pos, body + i, n);
+      pos += n;
+      pos += sprintf(resp + pos, "\r\n");
+    }
+  pos += sprintf(resp + pos, "0\r\nX-Trailer: 1\r\n\r\n");
+  *resp_size = pos;
+  return resp;
+}
+
+/* Read one response, return 0 if the body came out as it went in */
+static int
+NC_P(read_once)(http_t *http, const http_event_procs_t *procs, const char *resp, long resp_size, int max_read, unsigned long seed)
+{
+  int rc;
+
+  bench.resp = resp;
+  bench.resp_size = resp_size;
+  bench.resp_pos = 0;
+  bench.max_read = max_read;
+  bench.seed = seed;
+  bench.body_pos = 0;
+  bench.mismatch = 0;
+
+  http_reset(http);
+  http->keepalive = bench.keepalive;
+  rc = http_read_response(http, procs);
+  if( bench.keepalive && (!http->reusable || bench.resp_pos != bench.resp_size) )
+    return 1;
+  return rc || bench.mismatch || bench.body_pos != bench.body_size;
+}
+
+int
+main(int argc, char **argv)
+{
+  static const char *modes[] = { "plain", "chunked" };
+  long size = 1L << 20, resp_size, failed;
+  int max_chunk = 4096, max_read = 64, rounds = 200, timed = 20, chunked, i;
+  int buff_size = HTTP_BUFF_SIZE;
+  unsigned long seed = 1, long_seed;
+  unsigned long long cycles;
+  double t;
+  char *body, *resp, *buff;
+  http_t *http;
+  http_event_procs_t procs;
+
+  for(i = 1; i < argc; i++)
+    {
+      if( !strcmp(argv[i], "-s") && i + 1 < argc )
+        size = atol(argv[++i]);
+      else if( !strcmp(argv[i], "-c") && i + 1 < argc )
+        max_chunk = atoi(argv[++i]);
+      else if( !strcmp(argv[i], "-r") && i + 1 < argc )
+        max_read = atoi(argv[++i]);
+      else if( !strcmp(argv[i], "-n") && i + 1 < argc )
+        rounds = atoi(argv[++i]);
+      else if( !strcmp(argv[i], "-t") && i + 1 < argc )
+        timed = atoi(argv[++i]);
+      else if( !strcmp(argv[i], "-b") && i + 1 < argc )
+        buff_size = atoi(argv[++i]);
+      else if( !strcmp(argv[i], "-z") && i + 1 < argc )
+        bench.dest_size = atoi(argv[++i]);
+      else if( !strcmp(argv[i], "-k") )
+        bench.keepalive = 1;
+      else
+        {
+          fprintf(stderr, "usage: %s [-s body_bytes] [-c max_chunk] [-r max_read] [-n fuzz_rounds] [-t timed_rounds] [-b buff_bytes] [-z dest_bytes] [-k]\n", argv[0]);
+          return 1;
+        }
+    }
+  if( size <= 0 || max_chunk <= 0 || max_read < 0 || buff_size < 128 || bench.dest_size < 0 )
+    return 1;
+
+  if( !(body = ws_malloc(size)) || !(http = ws_malloc(sizeof(*http))) || !(buff = ws_malloc(buff_size)) ||
+      (bench.dest_size && !(bench.dest = ws_malloc(bench.dest_size))) )
+    return 1;
+  http_init(http, buff, buff_size);
+  /* any byte may turn up in the body, CR and LF included */
+  for(i = 0; i < size; i++)
+    body[i] = (char)rnd(&seed);
+  bench.body = body;
+  bench.body_size = size;
+
+  http_callbacks_init(&procs);
+  procs.event_body = event_body;
+  if( bench.dest_size )
+    {
+      procs.event_body_buffer = event_body_buffer;
+      procs.event_body_commit = event_body_commit;
+    }
+
+  printf("%ld bytes body, chunks of up to %d bytes, %d fuzz rounds with reads of up to %d bytes\n",
+         size, max_chunk, rounds, max_read);
+  printf("%d bytes buffer, ", buff_size);
+  if( bench.dest_size )
+    printf("body read in place to %d bytes\n", bench.dest_size);
+  else
+    printf("body passed through the buffer\n");
+  if( bench.keepalive )
+    printf("connection kept alive\n");
+  printf("%-8s %8s %12s %10s %12s %10s\n", "mode", "failed", "calls/KB", "reads/MB", "bytes/cycle", "MB/s");
+
+  for(chunked = 0; chunked < 2; chunked++)
+    {
+      failed = 0;
+      for(i = 0; i < rounds; i++)
+        {
+          long_seed = 1000 + i;
+          if( !(resp = build_response(body, size, chunked, 1 + (int)(rnd(&long_seed) % max_chunk), long_seed, &resp_size)) )
+            return 1;
+          if( read_once(http, &procs, resp, resp_size, max_read ? 1 + (int)(rnd(&long_seed) % max_read) : 0, long_seed) )
+            {
+              if( !failed )
+                fprintf(stderr, "%s: round %d failed at body byte %ld\n", modes[chunked], i, bench.body_pos);
+              failed++;
+            }
+          ws_free(resp);
+        }
+
+      if( !(resp = build_response(body, size, chunked, max_chunk, seed, &resp_size)) )
+        return 1;
+      bench.calls = 0;
+      bench.reads = 0;
+      cycles = 0;
+      t = bench_now();
+      for(i = 0; i < timed; i++)
+        {
+          unsigned long long c = clock_cycles();
+          failed += read_once(http, &procs, resp, resp_size, 0, seed);
+          cycles += clock_cycles() - c;
+        }
+      t = bench_now() - t;
+      ws_free(resp);
+
+      printf("%-8s %8ld %12.2f %10.0f %12.3f %10.1f\n", modes[chunked], failed,
+             timed ? bench.calls * 1024.0 / ((double)size * timed) : 0.0,
+             timed ? bench.reads * 1048576.0 / ((double)resp_size * timed) : 0.0,
+             cycles ? (double)resp_size * timed / cycles : 0.0,
+             t > 0 ? resp_size * (double)timed / t / 1e6 : 0.0);
+      if( failed )
+        return 1;
+    }
+
+  ws_free(bench.dest);
+  ws_free(buff);
+  ws_free(http);
+  ws_free(body);
+  return 0;
+}
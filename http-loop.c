@@ -0,0 +1,394 @@
+/*
+ *  NanoRadio (Open source IoT hardware)
+ *
+ *  This project is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License(GPL)
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This project is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+/*
+ * Event loop over many HTTP connections from one task. Each connection is
+ * made without waiting, sends its request once it is writable, and has its
+ * response fed to the parser of http-protocol.c read by read as the socket
+ * becomes readable. epoll waits on Linux, select() on lwIP and elsewhere.
+ * Connections are plain HTTP only, as the TLS handshake of tcp-socket.c
+ * waits. A host name the cache of dns-cache.c does not know yet is looked
+ * up by its worker, the connection is started once it is in.
+ */
+#define TRACE_UNIT "http-loop"
+
+#include "portable.h"
+
+#if PORT (SOCKET)
+# include <sys/select.h>
+# if defined(__linux__)
+#  include <sys/epoll.h>
+#  include <unistd.h>
+#  define HTTP_LOOP_EPOLL 1
+# endif
+#elif PORT (LWIP)
+# include "lwip/sockets.h"
+#endif
+
+#include "util-logtrace.h"
+#include "util-task.h"
+#include "tcp-socket.h"
+#include "http-protocol.h"
+
+#include "http-loop.h"
+
+#define HTTP_LOOP_BUFF_SIZE 1460
+#define HTTP_LOOP_EVENTS 16
+#define HTTP_LOOP_HOST 64
+#define HTTP_LOOP_RESOLVE_MS 20 /* how often names being looked up are checked */
+
+enum {
+  CONN_RESOLVING = 0,
+  CONN_CONNECTING,
+  CONN_SENDING,
+  CONN_READING
+};
+
+struct http_conn_s {
+  http_t http;
+  const http_conn_procs_t *procs;
+  void *opaque;
+  char state;
+  char dead;     /* over, freed at the end of this http_loop_run() */
+  int sent;      /* bytes of the request sent */
+  int req_len;
+  char host[HTTP_LOOP_HOST];
+  int port;
+  unsigned long deadline; /* util_task_get_ms() it times out at */
+  http_conn_t *next;
+  char buff[HTTP_LOOP_BUFF_SIZE];
+};
+
+/* The events of http_t carry no connection, the one being fed is here.
+ * So is http_loop_run() for one task at a time, see http-loop.h. */
+static http_conn_t *loop_current;
+
+static int
+NC_P(loop_event_body)(char *at, int length)
+{
+  return loop_current->procs->event_body(loop_current, loop_current->opaque, at, length);
+}
+
+static int
+NC_P(loop_event_redirect)(char *url)
+{
+  (void)url;
+  return 301; /* to event_done(), which may open the new location */
+}
+
+/* Have epoll wait on what the state of conn waits on. select() is set up
+ * for that at each wait. */
+static void
+NC_P(loop_watch)(http_loop_t *loop, http_conn_t *conn, int add)
+{
+#if HTTP_LOOP_EPOLL
+  struct epoll_event ev;
+  ev.events = conn->state == CONN_READING ? EPOLLIN : EPOLLOUT;
+  ev.data.ptr = conn;
+  epoll_ctl(loop->fd, add ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, conn->http.socket.fd, &ev);
+#else
+  (void)loop; (void)conn; (void)add;
+#endif
+}
+
+static void
+NC_P(loop_finish)(http_loop_t *loop, http_conn_t *conn, int rc)
+{
+  if( conn->dead )
+    return;
+  conn->dead = 1;
+  loop->count--;
+  conn->procs->event_done(conn, conn->opaque, rc);
+}
+
+/* The socket of conn is ready for what its state waits on */
+static void
+NC_P(loop_dispatch)(http_loop_t *loop, http_conn_t *conn)
+{
+  tcp_socket_t *sock = &conn->http.socket;
+  char *at;
+  int rc, len, size;
+
+  if( conn->state == CONN_CONNECTING )
+    {
+      if( (rc = ws_socket_conn_finish(sock)) < 0 )
+        {
+          loop_finish(loop, conn, rc);
+          return;
+        }
+      conn->state = CONN_SENDING;
+      if( conn->procs->event_connected )
+        conn->procs->event_connected(conn, conn->opaque);
+    }
+
+  if( conn->state == CONN_SENDING )
+    {
+      len = ws_socket_send(sock, conn->buff + conn->sent, conn->req_len - conn->sent, 0);
+      if( len == -WERR_AGAIN )
+        return;
+      if( len <= 0 )
+        {
+          loop_finish(loop, conn, -WERR_TCP_RECV);
+          return;
+        }
+      if( (conn->sent += len) < conn->req_len )
+        return;
+      http_response_begin(&conn->http);
+      conn->state = CONN_READING;
+      conn->deadline = util_task_get_ms() + loop->read_timeout;
+      loop_watch(loop, conn, 0);
+      return;
+    }
+
+  at = http_response_buffer(&conn->http, &loop->http_procs, &size);
+  if( (len = ws_socket_recv(sock, at, size, 0)) == -WERR_AGAIN )
+    return;
+  if( len < 0 )
+    len = 0;
+  loop_current = conn;
+  rc = http_response_feed(&conn->http, &loop->http_procs, len);
+  loop_current = NULL;
+  conn->deadline = util_task_get_ms() + loop->read_timeout;
+  if( rc || http_response_done(&conn->http) )
+    loop_finish(loop, conn, rc);
+}
+
+int
+NC_P(http_loop_init)(http_loop_t *loop)
+{
+  ws_bzero(loop, sizeof(*loop));
+  loop->fd = -1;
+  loop->connect_timeout = HTTP_LOOP_CONNECT_MS;
+  loop->read_timeout = HTTP_LOOP_READ_MS;
+
+  http_callbacks_init(&loop->http_procs);
+  loop->http_procs.event_body = loop_event_body;
+  loop->http_procs.event_redirect = loop_event_redirect;
+
+#if HTTP_LOOP_EPOLL
+  if( (loop->fd = epoll_create(HTTP_LOOP_EVENTS)) < 0 )
+    return -WERR_FAILED;
+#endif
+  return 0;
+}
+
+/* Close all connections, without event_done() */
+void
+NC_P(http_loop_deinit)(http_loop_t *loop)
+{
+  http_conn_t *conn, *next;
+  for(conn = loop->conns; conn; conn = next)
+    {
+      next = conn->next;
+      ws_socket_close(&conn->http.socket);
+      ws_free(conn);
+    }
+  loop->conns = NULL;
+  loop->count = 0;
+#if HTTP_LOOP_EPOLL
+  if( loop->fd >= 0 )
+    close(loop->fd);
+  loop->fd = -1;
+#endif
+}
+
+void
+NC_P(http_loop_set_timeouts)(http_loop_t *loop, int connect_ms, int read_ms)
+{
+  loop->connect_timeout = connect_ms;
+  loop->read_timeout = read_ms;
+}
+
+/* Start to GET 'file' from host:port, from 'start' bytes on if not -1.
+ * The events of 'procs' come from http_loop_run() with 'opaque'.
+ * Returns < 0 if the connection could not even be started.
+ */
+int
+NC_P(http_loop_open)(http_loop_t *loop, const char *host, const char *file, int port, int start,
+                     const http_conn_procs_t *procs, void *opaque, http_conn_t **pconn)
+{
+  http_conn_t *conn;
+  int rc;
+
+  if( strlen(host) >= HTTP_LOOP_HOST )
+    return -WERR_BUFFER_OVERFLOW;
+  if( !(conn = (http_conn_t *)ws_malloc(sizeof(*conn))) )
+    return -WERR_NO_MEMORY;
+  ws_bzero(conn, sizeof(*conn));
+  http_init(&conn->http, conn->buff, sizeof(conn->buff));
+
+  if( (rc = ws_socket_conn_start(&conn->http.socket, host, port)) < 0 && rc != -WERR_AGAIN )
+    {
+      ws_free(conn);
+      return rc;
+    }
+  http_format_request(&conn->http, host, file, start, -1);
+  conn->req_len = strlen(conn->buff);
+  strcpy(conn->host, host);
+  conn->port = port;
+  conn->procs = procs;
+  conn->opaque = opaque;
+  conn->deadline = util_task_get_ms() + loop->connect_timeout;
+  if( rc != -WERR_AGAIN )
+    {
+      conn->state = CONN_CONNECTING;
+      loop_watch(loop, conn, 1);
+    }
+
+  conn->next = loop->conns;
+  loop->conns = conn;
+  loop->count++;
+  if( pconn )
+    *pconn = conn;
+  return 0;
+}
+
+/* Give up on conn, without event_done(). It may be called from the events. */
+void
+NC_P(http_loop_close)(http_loop_t *loop, http_conn_t *conn)
+{
+  if( !conn->dead )
+    {
+      conn->dead = 1;
+      loop->count--;
+    }
+}
+
+/* Start the connections whose host names are in by now */
+static void
+NC_P(loop_resolved)(http_loop_t *loop)
+{
+  http_conn_t *conn;
+  int rc;
+
+  for(conn = loop->conns; conn; conn = conn->next)
+    {
+      if( conn->dead || conn->state != CONN_RESOLVING )
+        continue;
+      if( (rc = ws_socket_conn_start(&conn->http.socket, conn->host, conn->port)) == -WERR_AGAIN )
+        continue;
+      if( rc < 0 )
+        loop_finish(loop, conn, rc);
+      else
+        {
+          conn->state = CONN_CONNECTING;
+          loop_watch(loop, conn, 1);
+        }
+    }
+}
+
+/* Free the connections that are over */
+static void
+NC_P(loop_reap)(http_loop_t *loop)
+{
+  http_conn_t **link = &loop->conns, *conn;
+  while( (conn = *link) )
+    {
+      if( !conn->dead )
+        {
+          link = &conn->next;
+          continue;
+        }
+      *link = conn->next;
+#if HTTP_LOOP_EPOLL
+      if( conn->http.socket.fd >= 0 )
+        epoll_ctl(loop->fd, EPOLL_CTL_DEL, conn->http.socket.fd, NULL);
+#endif
+      ws_socket_close(&conn->http.socket);
+      ws_free(conn);
+    }
+}
+
+/* Wait up to 'timeout_ms' for any connection to be ready, and handle all
+ * that are, or have timed out. Returns the number of connections not over.
+ */
+int
+NC_P(http_loop_run)(http_loop_t *loop, int timeout_ms)
+{
+  unsigned long now = util_task_get_ms();
+  http_conn_t *conn;
+  long left;
+  int n;
+
+  /* wake for the first deadline */
+  for(conn = loop->conns; conn; conn = conn->next)
+    {
+      if( conn->dead )
+        continue;
+      left = (long)(conn->deadline - now);
+      if( conn->state == CONN_RESOLVING && left > HTTP_LOOP_RESOLVE_MS )
+        left = HTTP_LOOP_RESOLVE_MS;
+      if( left < timeout_ms )
+        timeout_ms = left < 0 ? 0 : (int)left;
+    }
+
+#if HTTP_LOOP_EPOLL
+  {
+    struct epoll_event events[HTTP_LOOP_EVENTS];
+    int i;
+    n = epoll_wait(loop->fd, events, HTTP_LOOP_EVENTS, timeout_ms);
+    for(i = 0; i < n; i++)
+      {
+        conn = (http_conn_t *)events[i].data.ptr;
+        if( !conn->dead )
+          loop_dispatch(loop, conn);
+      }
+  }
+#else
+  {
+    fd_set rfds, wfds;
+    struct timeval tv;
+    int maxfd = -1;
+
+    FD_ZERO(&rfds);
+    FD_ZERO(&wfds);
+    for(conn = loop->conns; conn; conn = conn->next)
+      {
+        if( conn->dead || conn->state == CONN_RESOLVING )
+          continue;
+        if( conn->http.socket.fd >= FD_SETSIZE ) /* FD_SET() would write past the set */
+          {
+            loop_finish(loop, conn, -WERR_FAILED);
+            continue;
+          }
+        FD_SET(conn->http.socket.fd, conn->state == CONN_READING ? &rfds : &wfds);
+        if( conn->http.socket.fd > maxfd )
+          maxfd = conn->http.socket.fd;
+      }
+    tv.tv_sec = timeout_ms / 1000;
+    tv.tv_usec = (timeout_ms % 1000) * 1000;
+    n = select(maxfd + 1, &rfds, &wfds, NULL, &tv);
+    for(conn = loop->conns; n > 0 && conn; conn = conn->next)
+      {
+        if( !conn->dead && conn->state != CONN_RESOLVING && (FD_ISSET(conn->http.socket.fd, &rfds) || FD_ISSET(conn->http.socket.fd, &wfds)) )
+          loop_dispatch(loop, conn);
+      }
+  }
+#endif
+
+  loop_resolved(loop);
+
+  now = util_task_get_ms();
+  for(conn = loop->conns; conn; conn = conn->next)
+    {
+      if( !conn->dead && (long)(conn->deadline - now) <= 0 )
+        {
+          trace_debug(("timed out\n"));
+          loop_finish(loop, conn, -WERR_CONN_TIMEOUT);
+        }
+    }
+
+  loop_reap(loop);
+  return loop->count;
+}
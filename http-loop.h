@@ -0,0 +1,54 @@
+/*
+ *  NanoRadio (Open source IoT hardware)
+ *
+ *  This project is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License(GPL)
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This project is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+#ifndef HTTP_LOOP_H_
+#define HTTP_LOOP_H_
+
+#include "http-protocol.h"
+
+/* Time a connection may take to be looked up and made, and a response may stay silent */
+#define HTTP_LOOP_CONNECT_MS 5000
+#define HTTP_LOOP_READ_MS 10000
+
+typedef struct http_conn_s http_conn_t;
+
+typedef struct {
+  /* Optional. The connection was made, the request goes out next */
+  void (*event_connected)(http_conn_t *conn, void *opaque);
+  /* Return non-zero to abort the response */
+  int (*event_body)(http_conn_t *conn, void *opaque, char *at, int length);
+  /* The response is over, 'rc' as http_read_response() returns, or
+   * -WERR_CONN_TIMEOUT. The connection is freed after this returns. */
+  void (*event_done)(http_conn_t *conn, void *opaque, int rc);
+} http_conn_procs_t;
+
+/* A task may run several loops, but only one task may be in
+ * http_loop_run() at a time: the responses are fed through one static. */
+typedef struct {
+  int fd;            /* epoll instance, -1 with select() */
+  http_conn_t *conns;
+  int count;         /* connections not over yet */
+  int connect_timeout;
+  int read_timeout;
+  http_event_procs_t http_procs;
+} http_loop_t;
+
+int NC_P(http_loop_init)(http_loop_t *loop);
+void NC_P(http_loop_deinit)(http_loop_t *loop);
+void NC_P(http_loop_set_timeouts)(http_loop_t *loop, int connect_ms, int read_ms);
+int NC_P(http_loop_open)(http_loop_t *loop, const char *host, const char *file, int port, int start,
+                         const http_conn_procs_t *procs, void *opaque, http_conn_t **pconn);
+void NC_P(http_loop_close)(http_loop_t *loop, http_conn_t *conn);
+int NC_P(http_loop_run)(http_loop_t *loop, int timeout_ms);
+
+#endif
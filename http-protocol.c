@@ -16,6 +16,7 @@
 #include "portable.h"
 #include "util-logtrace.h"
 #include "tcp-socket.h"
+#include "util-task.h"
 
 #include "http-protocol.h"
 
@@ -121,11 +122,12 @@ NC_P(parse_url)(char *url, const char **pproto, const char **phost, const char *
   return -WERR_FAILED;
 }
 
-/* start/end specified the requested range in bytes. start = -1 when range field is invalid, end = -1 read through */
-static int
-NC_P(http_send_request)(http_t *http, const char *host, const char *file, int start, int end)
+/* Put the request into the buffer of http.
+ * start/end specified the requested range in bytes. start = -1 when range field is invalid, end = -1 read through */
+void
+NC_P(http_format_request)(http_t *http, const char *host, const char *file, int start, int end)
 {
-  trace_assert( strlen(host) + strlen(file) < sizeof(http->buff) - 44 - 48 );
+  trace_assert( strlen(host) + strlen(file) < (size_t)http->buff_size - 44 - 48 );
 
   strcpy( http->buff, "GET " );
   strcat( http->buff, file );
@@ -148,18 +150,40 @@ NC_P(http_send_request)(http_t *http, const char *host, const char *file, int st
         }
       strcat( http->buff, "\r\n" );
     }
-  strcat( http->buff, "Connection: close\r\n\r\n" );
+  if( http->keepalive )
+    strcat( http->buff, "Connection: keep-alive\r\n\r\n" );
+  else
+    strcat( http->buff, "Connection: close\r\n\r\n" );
 
 #if DEBUG_HTTP > 1
-  trace_debug(("header: %s\n", http_buff));
+  trace_debug(("header: %s\n", http->buff));
 #endif
+}
+
+static int
+NC_P(http_send_request)(http_t *http, const char *host, const char *file, int start, int end)
+{
+  http_format_request(http, host, file, start, end);
   return ws_socket_send( &http->socket, http->buff, strlen(http->buff), 0 );
 }
 
+/* Set up a connection to read through 'buff' of 'size' bytes. The buffer
+ * has to hold the request and the whole response header, HTTP_BUFF_SIZE
+ * does for usual servers. A larger one takes more of a body per read.
+ */
 void
-NC_P(http_reset)(http_t *http)
+NC_P(http_init)(http_t *http, char *buff, int size)
 {
   ws_bzero(http, sizeof(*http));
+  http->buff = buff;
+  http->buff_size = size;
+}
+
+/* Clear the state of a connection, keeping its buffer */
+void
+NC_P(http_reset)(http_t *http)
+{
+  http_init(http, http->buff, http->buff_size);
 }
 
 int
@@ -175,23 +199,6 @@ NC_P(http_request)(http_t *http, const char *host, const char *file, int port, i
   return 0;
 }
 
-static char *
-NC_P(get_http_field)(const char *buff, char *field, char **end)
-{
-  char *pos = strstr( buff, field );
-  if( !pos )
-    return pos;
-  pos += strlen( field ) + 1;
-  while( isspace(*pos) )
-    pos++;
-  if( end )
-    {
-      if( !(*end = strstr(pos, "\r\n")) )
-        return NULL;
-    }
-  return pos;
-}
-
 static int
 dummy_event_at_length(char *at, int length)
 { return 0; WS_UNUSED(at); WS_UNUSED(length); }
@@ -205,223 +212,511 @@ NC_P(http_callbacks_init)(http_event_procs_t *procs)
   procs->event_body = &dummy_event_at_length;
   procs->event_redirect = &dummy_event_vstr;
   procs->event_content_type = &dummy_event_at_length;
+  procs->event_body_buffer = NULL;
+  procs->event_body_commit = NULL;
 }
 
 enum SMCODE
 {
-  SMCODE_BODY = 0,
-  SMCODE_TERMINATE_CHUNK,
-  SMCODE_CHUNK_SIZE
+  SMCODE_HEADER = 0,      /* the status line and the header fields */
+  SMCODE_BODY,            /* chunk data, or all of a body that is not chunked */
+  SMCODE_CHUNK_START,     /* the first digit of a chunk size line */
+  SMCODE_CHUNK_SIZE,      /* the rest of the hex digits */
+  SMCODE_CHUNK_EXT,       /* extensions and CR up to the LF of the size line */
+  SMCODE_TERMINATE_CHUNK, /* the CRLF after chunk data */
+  SMCODE_TRAILER,         /* the start of a line after the last chunk */
+  SMCODE_TRAILER_LINE,    /* the rest of a trailer field, which is ignored */
+  SMCODE_DONE             /* the end of the body */
 };
 
-/* Return 0 if succeeded.
- * Return value < 0 if failed
- * Return HTTP status code (> 0) if a server error occurred.
+/* Bytes of body that may follow in the current chunk, or up to the
+ * Content-Length on a connection kept alive. -1 for up to the end of
+ * the stream, which is all a server closing the connection has to get right.
  */
-int
-NC_P(http_read_response)(http_t *http, const http_event_procs_t *event_procs)
+static int
+NC_P(http_body_left)(const http_t *http)
 {
-  int status;
-  enum SMCODE smcode;
-  int len, pos = 0;
-  char *field_value = NULL;
-  const char *response = http->buff;
-  char *body;
-  char *at;
-  char trunc = 0;
-  int block_length = 0;
-  char stream_eof = 0;
+  if( http->chunked )
+    return http->chunked_size;
+  if( http->keepalive && http->content_lenght >= 0 )
+    return http->content_lenght - http->content_read_lenght;
+  return -1;
+}
+
+/* Hand the body in [p, end) on to event_body, in one call per span of chunk
+ * data rather than walking it byte by byte. Chunk size lines and the CRLF after
+ * the data may be split anywhere between two calls, smcode and chunked_size
+ * carry the state over.
+ */
+static int
+NC_P(http_parse_body)(http_t *http, const http_event_procs_t *event_procs, char *p, char *end)
+{
+  int status, len, left;
+  char *eol;
+
+  while( p < end )
+    {
+      switch( http->smcode )
+      {
+        case SMCODE_BODY:
+          len = (int)(end - p);
+          if( (left = http_body_left(http)) >= 0 && len > left )
+            len = left;
+          if( len && (status = event_procs->event_body(p, len)) )
+            return status;
+          http->content_read_lenght += len;
+          p += len;
+          if( http->chunked )
+            http->chunked_size -= len;
+          if( len == left )
+            http->smcode = http->chunked ? SMCODE_TERMINATE_CHUNK /* to start a new chunk */ : SMCODE_DONE;
+          break;
+
+        case SMCODE_CHUNK_START:
+          if( !http_isdigit(*p) )
+            {
+              trace_debug(("no chunk size, ch = %d\n", *p));
+              return -WERR_HTTP_HEADER;
+            }
+          http->chunked_size = 0;
+          http->smcode = SMCODE_CHUNK_SIZE;
+          break;
+
+        case SMCODE_CHUNK_SIZE:
+          for(; p < end && http_isdigit(*p); p++)
+            {
+              if( http->chunked_size > (0x7fffffff >> 4) )
+                return -WERR_HTTP_HEADER;
+              http->chunked_size = http->chunked_size * 16 + http_ctn(*p);
+            }
+          if( p < end )
+            http->smcode = SMCODE_CHUNK_EXT;
+          break;
+
+        case SMCODE_CHUNK_EXT:
+          if( !(eol = memchr(p, '\n', end - p)) )
+            return 0;
+          p = eol + 1;
+          http->smcode = http->chunked_size ? SMCODE_BODY /* to read the body of current chunk */ : SMCODE_TRAILER;
+          break;
+
+        case SMCODE_TERMINATE_CHUNK:
+          if( !(eol = memchr(p, '\n', end - p)) )
+            return 0;
+          p = eol + 1;
+          http->smcode = SMCODE_CHUNK_START;
+          break;
+
+        case SMCODE_TRAILER: /* up to the empty line that ends the message */
+          if( *p == '\n' )
+            {
+              http->smcode = SMCODE_DONE;
+              return 0;
+            }
+          if( *p++ != '\r' )
+            http->smcode = SMCODE_TRAILER_LINE;
+          break;
+
+        case SMCODE_TRAILER_LINE:
+          if( !(eol = memchr(p, '\n', end - p)) )
+            return 0;
+          p = eol + 1;
+          http->smcode = SMCODE_TRAILER;
+          break;
+
+        default:
+          return 0;
+      }
+    }
+  return 0;
+}
 
-  while( sizeof(http->buff) - pos > 0 && (len = ws_socket_recv( &http->socket, http->buff + pos, sizeof(http->buff) - pos, 0 )) )
+/* Case insensitive match of a header field name */
+static int
+NC_P(http_field_is)(const char *name, const char *field)
+{
+  while( *field && tolower((unsigned char)*name) == tolower((unsigned char)*field) )
     {
-      if( len <= 0 ) break;
-      pos += len;
+      name++;
+      field++;
     }
-  if(!pos) return -WERR_TCP_RECV;
-  
-  while(isspace(*response)) response++;
+  return !*name && !*field;
+}
+
+/* Parse the header that ends right before 'body' in place, each line cut into
+ * a NUL terminated field name and value in one pass over it. Returns the HTTP
+ * status code, or < 0 if it is not a response.
+ */
+static int
+NC_P(http_parse_header)(http_t *http, const http_event_procs_t *event_procs, char *body)
+{
+  int status = -1;
+  char *line, *eol, *value, *content_type = NULL;
 #if DEBUG_HTTP > 1
-  trace_debug(("response: %s\n", response));
+  trace_debug(("response: %.*s\n", (int)(body - http->buff), http->buff));
 #endif
-  if( 0 != strncmp(response, "HTTP/1.1", sizeof("HTTP/1.1")-1) )
-    return -WERR_HTTP_HEADER;
-  response += 8;
-  while(isspace(*response)) response++;
-
-  status = http_atoi(response, 10);
-  switch( status )
-  {
-    case 200: /* OK */
-    case 206: /* Partial Content */
-      break;
-    case 301: /* Redirect */
-      if( (field_value = get_http_field(http->buff, "Location", &at)) )
+
+  http->content_lenght = -1;
+  http->chunked = 0;
+  http->location = NULL;
+  for(line = http->buff; line < body && isspace(*line); line++);
+  for(; line < body - 2; line = eol + 1)
+    {
+      eol = memchr(line, '\n', body - line);
+      *eol = '\0';
+      if( eol > line && eol[-1] == '\r' )
+        eol[-1] = '\0';
+
+      if( status < 0 ) /* the status line */
         {
-          *at = '\0';
-          if( (status = event_procs->event_redirect(field_value)) )
-            return status;
+          if( 0 != strncmp(line, "HTTP/1.1", sizeof("HTTP/1.1")-1) )
+            return -WERR_HTTP_HEADER;
+          line += 8;
+          while(isspace(*line)) line++;
+          status = http_atoi(line, 10);
+          continue;
         }
-      return status;
-      break;
-    default:
-      return status;
-  }
-  
-  http->content_lenght = http_atoi( get_http_field(http->buff, "Content-Length:", &at), 10 );
-  field_value = get_http_field(http->buff, "Content-Type", &at);
-  event_procs->event_content_type(field_value, (int)(at - field_value));
-  
-  field_value = get_http_field(http->buff, "Transfer-Encoding", NULL);
-  if( field_value && 0 == strncmp(field_value, "chunked", sizeof("chunked")-1) )
-    http->chunked = 1;
-  else
-    http->chunked = 0;
-  http->chunked_size = 0;
-  
-  body = strstr(http->buff, "\r\n\r\n");
-  if(!body)
-    {
-      trace_debug(("http hdr trunc\n")); /* http header was truncated! */
-      return -WERR_HTTP_HEADER;
+
+      if( !(value = strchr(line, ':')) )
+        continue;
+      *value++ = '\0';
+      while(isspace(*value)) value++;
+
+      if( http_field_is(line, "Content-Length") )
+        http->content_lenght = http_atoi(value, 10);
+      else if( http_field_is(line, "Content-Type") )
+        content_type = value;
+      else if( http_field_is(line, "Transfer-Encoding") )
+        http->chunked = (0 == strncmp(value, "chunked", sizeof("chunked")-1));
+      else if( http_field_is(line, "Location") )
+        http->location = value;
+      else if( http_field_is(line, "Connection") )
+        http->server_close = (0 == strncmp(value, "close", sizeof("close")-1));
     }
-  body += 4;
-  
+
+  if( content_type && (status == 200 || status == 206) )
+    event_procs->event_content_type(content_type, (int)strlen(content_type));
+  return status;
+}
+
+/*
+ * A response is read in steps, so that a loop over many connections can
+ * drive it as well as http_read_response() on a single one:
+ * http_response_begin() once, then for every read, the read to the buffer
+ * http_response_buffer() tells, and its length to http_response_feed().
+ */
+void
+NC_P(http_response_begin)(http_t *http)
+{
+  http->smcode = SMCODE_HEADER;
   http->write_pos = 0;
-  smcode = SMCODE_BODY;
+  http->reusable = 0;
+  http->server_close = 0;
+  http->in_place = 0;
+}
 
-  if( http->chunked )
+/* Where the next read of the response goes, and the most it may be */
+char *
+NC_P(http_response_buffer)(http_t *http, const http_event_procs_t *event_procs, int *size)
+{
+  char *dest;
+  int left;
+
+  http->in_place = 0;
+  if( http->smcode == SMCODE_HEADER )
+    {
+      *size = http->buff_size - 1 - http->write_pos;
+      return http->buff + http->write_pos;
+    }
+
+  /* body data is read to where the consumer wants it, if it says so,
+   * only chunk size lines and CRLFs go through the buffer */
+  if( http->smcode == SMCODE_BODY && event_procs->event_body_buffer &&
+      (dest = event_procs->event_body_buffer(size)) && *size > 0 )
     {
-      trace_debug(("chunkd transfer\n"));
-      smcode = SMCODE_CHUNK_SIZE;
+      if( (left = http_body_left(http)) >= 0 && *size > left )
+        *size = left;
+      http->in_place = 1;
+      return dest;
     }
+  *size = http->buff_size;
+  return http->buff;
+}
 
-  len = sizeof(http->buff) - (int)(body - http->buff);
-  memmove(http->buff, body, len);
+/* Parse 'len' bytes read to http_response_buffer(), or 0 at the end of the
+ * stream. Returns as http_read_response() does, the response is over when
+ * that is not 0 or http_response_done() says so.
+ */
+int
+NC_P(http_response_feed)(http_t *http, const http_event_procs_t *event_procs, int len)
+{
+  int status, left, scan;
+  char *body;
 
-  http->write_pos = len;
-  http->content_read_lenght = 0;
-  at = http->buff;
+  if( http->smcode == SMCODE_DONE )
+    return 0;
 
-  for(;;)
+  if( len <= 0 ) /* the end of the stream */
     {
-      char *p = http->buff, *pend = http->buff + (http->write_pos - 1);
-     
-      while(p <= pend)
+      status = 0;
+      if( http->smcode == SMCODE_HEADER )
         {
-          switch(*p)
-          {
-            case '\r':
-              if(smcode != SMCODE_BODY)
-                {
-                  p++;
-                  continue;
-                }
-              break;
-            case '\n':
-              switch(smcode)
-              {
-                case SMCODE_CHUNK_SIZE:
-                  if( http->chunked_size )
-                    {
-                      at = ++p;
-                      
-                      block_length = 0;
-                      smcode = SMCODE_BODY; /* to read the body of current chunk */
-                      continue;
-                    }
-                  break;
-                  
-                case SMCODE_TERMINATE_CHUNK:
-                  http->chunked_size = 0;
-                  smcode = SMCODE_CHUNK_SIZE;
-                  p++;
-                  continue;
-                  
-                default:
-                  break;
-              }
-              break;
-          }
-          switch(smcode)
-          {
-            case SMCODE_BODY:
-              if(http->chunked)
-                {
-                  block_length++;
-                  if(p == pend || block_length == http->chunked_size )
-                    {
-                      if( (status = event_procs->event_body(at, block_length)) )
-                        return status;
-                      
-                      if( block_length == http->chunked_size )
-                        {
-                          smcode = SMCODE_TERMINATE_CHUNK; /* to start a new chunk */
-                        }
-                      else if( p == pend )
-                        {
-                          http->chunked_size -= block_length;
-                          goto next_sector;
-                        }
-                    }
-                }
-              else
-                {
-                  block_length++;
-                  if( p == pend )
-                    {
-                      if( (status = event_procs->event_body(at, block_length)) )
-                        return status;
-                      
-                      http->content_read_lenght += block_length;
-                      goto next_sector;
-                    }
-                }
-              break;
-              
-            case SMCODE_CHUNK_SIZE:
-              if( !http_isdigit(*p) )
-                {
-                  trace_debug(("no chunk size, ch = %d\n", *p));
-                  return -WERR_HTTP_HEADER;
-                }
-              
-              http->chunked_size = http->chunked_size * 16 + http_ctn(*p);
-              break;
-              
-            default:
-              break;
-          }
-          
-          p++;
+          if( http->write_pos )
+            trace_debug(("http hdr trunc\n")); /* http header was truncated! */
+          status = http->write_pos ? -WERR_HTTP_HEADER : -WERR_TCP_RECV;
         }
-        
-next_sector:
-      if( stream_eof ) break;
-      
-      http->write_pos = 0;
-      block_length = 0;
-      at = http->buff;
-      
-      /* fill in the buffer */
-      while( sizeof(http->buff) > http->write_pos )
+      http->smcode = SMCODE_DONE;
+      return status;
+    }
+
+  if( http->smcode == SMCODE_HEADER )
+    {
+      scan = http->write_pos > 3 ? http->write_pos - 3 : 0; /* the blank line may span two reads */
+      http->write_pos += len;
+      http->buff[http->write_pos] = '\0';
+      if( !(body = strstr(http->buff + scan, "\r\n\r\n")) )
+        {
+          if( http->write_pos < http->buff_size - 1 )
+            return 0;
+          trace_debug(("http hdr trunc\n")); /* http header was truncated! */
+          http->smcode = SMCODE_DONE;
+          return -WERR_HTTP_HEADER;
+        }
+      body += 4;
+
+      status = http_parse_header(http, event_procs, body);
+      switch( status )
       {
-        len = ws_socket_recv( &http->socket, http->buff + http->write_pos, sizeof(http->buff) - http->write_pos, 0 );
-        if( len <= 0 )
-          {
-            stream_eof = 1;
-            break;
-          }
-        http->write_pos += len;
+        case 200: /* OK */
+        case 206: /* Partial Content */
+          break;
+        case 301: /* Redirect */
+          if( http->location )
+            status = event_procs->event_redirect(http->location);
+          /* fall through */
+        default:
+          http->smcode = SMCODE_DONE;
+          return status;
       }
 
-    };
-  
+      http->chunked_size = 0;
+      http->content_read_lenght = 0;
+      http->smcode = SMCODE_BODY;
+      if( http->chunked )
+        {
+          trace_debug(("chunkd transfer\n"));
+          http->smcode = SMCODE_CHUNK_START;
+        }
+      else if( http_body_left(http) == 0 )
+        http->smcode = SMCODE_DONE; /* no body at all */
+
+      len = http->write_pos - (int)(body - http->buff);
+      http->write_pos = 0;
+    }
+  else if( http->in_place )
+    {
+      /* read to the consumer already */
+      http->in_place = 0;
+      left = http_body_left(http);
+      if( (status = event_procs->event_body_commit(len)) )
+        {
+          http->smcode = SMCODE_DONE;
+          return status;
+        }
+      http->content_read_lenght += len;
+      if( http->chunked )
+        http->chunked_size -= len;
+      if( len == left )
+        http->smcode = http->chunked ? SMCODE_TERMINATE_CHUNK /* to start a new chunk */ : SMCODE_DONE;
+      len = 0;
+      body = NULL;
+    }
+  else
+    body = http->buff;
+
+  if( len && (status = http_parse_body(http, event_procs, body, body + len)) )
+    {
+      http->smcode = SMCODE_DONE;
+      return status;
+    }
+
+  /* the next response starts right after this one */
+  if( http->smcode == SMCODE_DONE )
+    http->reusable = http->keepalive && !http->server_close;
+  return 0;
+}
+
+/* Whether the response was read to its end */
+int
+NC_P(http_response_done)(const http_t *http)
+{
+  return http->smcode == SMCODE_DONE;
+}
+
+/* Return 0 if succeeded.
+ * Return value < 0 if failed
+ * Return HTTP status code (> 0) if a server error occurred.
+ */
+int
+NC_P(http_read_response)(http_t *http, const http_event_procs_t *event_procs)
+{
+  int status, size, len;
+  char *at;
+
+  http_response_begin(http);
+  do
+    {
+      /* each read is parsed as soon as it is in, rather than when the buffer is full */
+      at = http_response_buffer(http, event_procs, &size);
+      if( (len = ws_socket_recv( &http->socket, at, size, 0 )) < 0 )
+        len = 0;
+      status = http_response_feed(http, event_procs, len);
+    }
+  while( !status && !http_response_done(http) );
+
 #if HTTP_VALIDATE_LENGTH /* some servers do not process the content lenght in right way */
-  if(http->content_lenght && http->content_lenght != http->content_read_lenght)
+  if(!status && http->content_lenght >= 0 && http->content_lenght != http->content_read_lenght)
     {
       return -WERR_TCP_RECV;
     }
 #endif
-  
-  return 0;
+  return status;
+}
+
+/*
+ * Keep-alive connection pool. A request to a host with an idle connection
+ * in the pool goes over that connection, rather than over a new one with a
+ * TLS handshake of its own. A connection goes back to the pool once its
+ * response was read to the Content-Length or the last chunk. It is closed
+ * after HTTP_POOL_IDLE_MS idle, when the server closed it, or to make room
+ * for another host. Used by one task at a time.
+ */
+#define HTTP_POOL_SIZE 2
+#define HTTP_POOL_IDLE_MS 20000
+#define HTTP_POOL_HOST 64
+
+typedef struct {
+  http_t http;
+  char buff[HTTP_BUFF_SIZE];
+  char host[HTTP_POOL_HOST];
+  int port;
+  char connected;
+  unsigned long idle_since; /* util_task_get_ms() when it was last used */
+} http_pool_entry_t;
+
+static http_pool_entry_t http_pool[HTTP_POOL_SIZE];
+static http_pool_stats_t http_pool_stats;
+
+static void
+NC_P(http_pool_drop)(http_pool_entry_t *entry)
+{
+  if( entry->connected )
+    ws_socket_close(&entry->http.socket);
+  entry->connected = 0;
+}
+
+/* The entry to request host:port over, connected already if it can be reused */
+static http_pool_entry_t *
+NC_P(http_pool_acquire)(const char *host, int port)
+{
+  unsigned long now = util_task_get_ms();
+  http_pool_entry_t *entry, *pick = NULL;
+  int i;
+
+  for(i = 0; i < HTTP_POOL_SIZE; i++)
+    {
+      entry = &http_pool[i];
+      if( !entry->connected )
+        continue;
+      if( now - entry->idle_since > HTTP_POOL_IDLE_MS )
+        {
+          http_pool_drop(entry);
+          http_pool_stats.evictions++;
+        }
+      else if( entry->port == port && !strcmp(entry->host, host) )
+        {
+          if( ws_socket_idle(&entry->http.socket) )
+            return entry;
+          http_pool_drop(entry); /* closed by the server */
+        }
+    }
+
+  /* a free entry, or else the one idle for longest */
+  for(i = 0; i < HTTP_POOL_SIZE; i++)
+    {
+      entry = &http_pool[i];
+      if( !entry->connected )
+        return entry;
+      if( !pick || now - entry->idle_since > now - pick->idle_since )
+        pick = entry;
+    }
+  http_pool_drop(pick);
+  http_pool_stats.evictions++;
+  return pick;
+}
+
+/* GET 'file' from host:port over a connection of the pool. Returns as
+ * http_read_response() does.
+ */
+int
+NC_P(http_pool_request)(const char *host, const char *file, int port, const http_event_procs_t *event_procs)
+{
+  http_pool_entry_t *entry;
+  int rc, reused;
+
+  if( strlen(host) >= HTTP_POOL_HOST )
+    return -WERR_BUFFER_OVERFLOW;
+
+  entry = http_pool_acquire(host, port);
+  for(;;)
+    {
+      if( (reused = entry->connected) )
+        http_pool_stats.reuses++;
+      else
+        {
+          http_init(&entry->http, entry->buff, sizeof(entry->buff));
+          if( (rc = ws_socket_conn(&entry->http.socket, host, port, 1)) < 0 )
+            return rc;
+          strcpy(entry->host, host);
+          entry->port = port;
+          entry->connected = 1;
+          http_pool_stats.connects++;
+        }
+
+      entry->http.keepalive = 1;
+      if( http_send_request(&entry->http, host, file, -1, -1) > 0 )
+        {
+          rc = http_read_response(&entry->http, event_procs);
+          if( !reused || rc != -WERR_TCP_RECV )
+            break;
+        }
+      else if( !reused )
+        {
+          rc = -WERR_TCP_RECV;
+          break;
+        }
+      /* the server closed it while idle, before any of the response came */
+      http_pool_drop(entry);
+    }
+
+  if( !rc && entry->http.reusable )
+    entry->idle_since = util_task_get_ms();
+  else
+    http_pool_drop(entry);
+  return rc;
+}
+
+/* Close all connections of the pool, as when the network went away */
+void
+NC_P(http_pool_flush)(void)
+{
+  int i;
+  for(i = 0; i < HTTP_POOL_SIZE; i++)
+    http_pool_drop(&http_pool[i]);
+}
+
+void
+NC_P(http_pool_get_stats)(http_pool_stats_t *stats)
+{
+  *stats = http_pool_stats;
 }
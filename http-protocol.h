@@ -16,13 +16,23 @@
 
 #include "tcp-socket.h"
 
+/* Buffer size that holds a request and the response header of a usual server */
+#define HTTP_BUFF_SIZE 512
+
 typedef struct {
-  char buff[512]; /* a frame of HTTP header */
+  char *buff; /* the HTTP header, then reads of the body not done in place */
+  int buff_size;
   int content_lenght;
   int content_read_lenght;
   char chunked;
   int chunked_size;
   int write_pos;
+  char keepalive; /* ask to keep the connection, and read bodies to their end only */
+  char reusable;  /* the last response left the connection ready for another request */
+  char server_close;
+  char in_place;  /* the last read went to the consumer's buffer */
+  int smcode;     /* state of the response parser */
+  char *location; /* of a redirect, in the buffer */
   tcp_socket_t socket;
 } http_t;
 
@@ -30,13 +40,37 @@ typedef struct {
   int (*event_body)(char *at, int length);
   int (*event_redirect)(char *url);
   int (*event_content_type)(char *at, int length);
+  /* Optional. Where up to *length bytes of the body may be read to in place,
+   * or NULL to have them read to the buffer of http_t and passed to event_body.
+   * event_body_commit() is then told how many bytes were read there. */
+  char *(*event_body_buffer)(int *length);
+  int (*event_body_commit)(int length);
 } http_event_procs_t;
 
 void NC_P(http_callbacks_init)(http_event_procs_t *procs);
+void NC_P(http_init)(http_t *http, char *buff, int size);
 void NC_P(http_reset)(http_t *http);
 int NC_P(http_request)(http_t *http, const char *host, const char *file, int port, int start, int end);
+void NC_P(http_format_request)(http_t *http, const char *host, const char *file, int start, int end);
 int NC_P(http_read_response)(http_t *http, const http_event_procs_t *event_procs);
 
+/* A response read in steps, see http-protocol.c */
+void NC_P(http_response_begin)(http_t *http);
+char *NC_P(http_response_buffer)(http_t *http, const http_event_procs_t *event_procs, int *size);
+int NC_P(http_response_feed)(http_t *http, const http_event_procs_t *event_procs, int len);
+int NC_P(http_response_done)(const http_t *http);
+
+/* Keep-alive connection pool, see http-protocol.c */
+typedef struct {
+  unsigned long connects;  /* new connections, with a handshake each for TLS */
+  unsigned long reuses;    /* requests over a connection from the pool */
+  unsigned long evictions; /* idle connections closed for age or room */
+} http_pool_stats_t;
+
+int NC_P(http_pool_request)(const char *host, const char *file, int port, const http_event_procs_t *event_procs);
+void NC_P(http_pool_flush)(void);
+void NC_P(http_pool_get_stats)(http_pool_stats_t *stats);
+
 int NC_P(parse_url)(char *url, const char **pproto, const char **phost, const char **pfile, int *pport);
 
 #endif
@@ -0,0 +1,236 @@
+/*
+ *  NanoRadio (Open source IoT hardware)
+ *
+ *  This project is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License(GPL)
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This project is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+/*
+ * HTTP event loop benchmark. One task streams from 'streams' stations of a
+ * local stand-in server at once over http-loop.c. The stand-in sends each
+ * 'rate' bytes/s for 'secs' seconds and closes, as a station ends a stream.
+ * 'stalled' more connections are answered never, to run into the read
+ * timeout, and one goes to a port nobody listens on. Reports what each got,
+ * and the CPU time of the task driving the loop.
+ *
+ *   loop-bench [-n streams] [-k stalled] [-r rate_bytes] [-t secs] [-o read_timeout_ms]
+ */
+
+#include "portable.h"
+#include "util-task.h"
+#include "http-protocol.h"
+#include "http-loop.h"
+#include "dns-cache.h"
+#include "bench-util.h"
+
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define TICK_MS 50
+
+typedef struct
+{
+  long bytes;
+  int rc;
+  char done;
+} station_t;
+
+typedef struct
+{
+  int rate;               /* bytes/s of a stream */
+  int secs;
+  int listen_fd;
+  int connected;
+  station_t *stations;
+} bench_t;
+
+static bench_t bench;
+
+static double
+thread_cpu(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Stand-in station, a task for each connection */
+static void
+NC_P(task_conn)(void *opaque)
+{
+  static const char header[] = "HTTP/1.1 200 OK\r\nContent-Type: audio/mpeg\r\n\r\n";
+  int fd = (int)(intptr_t)opaque;
+  char req[1024], *data;
+  int pos, len, tick = bench.rate * TICK_MS / 1000, i;
+
+  for(pos = 0; pos < (int)sizeof(req) - 1; pos += len)
+    {
+      if( (len = recv(fd, req + pos, sizeof(req) - 1 - pos, 0)) <= 0 )
+        break;
+      req[pos + len] = '\0';
+      if( strstr(req, "\r\n\r\n") )
+        break;
+    }
+
+  if( len > 0 && !strncmp(req, "GET /stall", 10) )
+    {
+      while( recv(fd, req, sizeof(req), 0) > 0 ) /* until the client gives up */
+        ;
+    }
+  else if( len > 0 && (data = ws_malloc(tick)) )
+    {
+      memset(data, 'x', tick);
+      send(fd, header, sizeof(header) - 1, 0);
+      for(i = 0; i < bench.secs * 1000 / TICK_MS; i++)
+        {
+          util_task_sleep(TICK_MS);
+          send(fd, data, tick, 0);
+        }
+      ws_free(data);
+    }
+  close(fd);
+  util_task_exit();
+}
+
+static void
+NC_P(event_connected)(http_conn_t *conn, void *opaque)
+{
+  bench.connected++;
+  WS_UNUSED(conn); WS_UNUSED(opaque);
+}
+
+static int
+NC_P(event_body)(http_conn_t *conn, void *opaque, char *at, int length)
+{
+  ((station_t *)opaque)->bytes += length;
+  return 0;
+  WS_UNUSED(conn); WS_UNUSED(at);
+}
+
+static void
+NC_P(event_done)(http_conn_t *conn, void *opaque, int rc)
+{
+  ((station_t *)opaque)->rc = rc;
+  ((station_t *)opaque)->done = 1;
+  WS_UNUSED(conn);
+}
+
+int
+main(int argc, char **argv)
+{
+  static const http_conn_procs_t procs = { event_connected, event_body, event_done };
+  int streams = 32, stalled = 2, read_timeout = 1000, port, dead_port, fd, i, total, runs = 0;
+  int ok = 0, timeouts = 0, refused = 0, failed = 0;
+  long expect, least = -1, most = 0;
+  double t, cpu;
+  http_loop_t loop;
+  station_t *st;
+
+  bench.rate = 16000; /* 128 kbit/s */
+  bench.secs = 3;
+
+  for(i = 1; i < argc; i++)
+    {
+      if( !strcmp(argv[i], "-n") && i + 1 < argc )
+        streams = atoi(argv[++i]);
+      else if( !strcmp(argv[i], "-k") && i + 1 < argc )
+        stalled = atoi(argv[++i]);
+      else if( !strcmp(argv[i], "-r") && i + 1 < argc )
+        bench.rate = atoi(argv[++i]);
+      else if( !strcmp(argv[i], "-t") && i + 1 < argc )
+        bench.secs = atoi(argv[++i]);
+      else if( !strcmp(argv[i], "-o") && i + 1 < argc )
+        read_timeout = atoi(argv[++i]);
+      else
+        {
+          fprintf(stderr, "usage: %s [-n streams] [-k stalled] [-r rate_bytes] [-t secs] [-o read_timeout_ms]\n", argv[0]);
+          return 1;
+        }
+    }
+  total = streams + stalled + 1;
+  if( streams < 0 || stalled < 0 || bench.rate * TICK_MS / 1000 <= 0 || bench.secs <= 0 || read_timeout <= 0 ||
+      !(bench.stations = ws_malloc(total * sizeof(station_t))) )
+    return 1;
+  ws_bzero(bench.stations, total * sizeof(station_t));
+  expect = (long)(bench.rate * TICK_MS / 1000) * (bench.secs * 1000 / TICK_MS);
+
+  /* a port that refuses connections, free again right away */
+  if( (fd = bench_listen_local(&dead_port, 1)) < 0 )
+    return 1;
+  close(fd);
+
+  dns_cache_init();
+  if( (bench.listen_fd = bench_listen_local(&port, total)) < 0 ||
+      bench_serve(bench.listen_fd, task_conn) )
+    {
+      fprintf(stderr, "cannot serve on the loopback interface\n");
+      return 1;
+    }
+
+  if( http_loop_init(&loop) )
+    return 1;
+  http_loop_set_timeouts(&loop, HTTP_LOOP_CONNECT_MS, read_timeout);
+
+  t = bench_now();
+  cpu = thread_cpu();
+  for(i = 0; i < total; i++)
+    {
+      st = &bench.stations[i];
+      st->rc = http_loop_open(&loop, "127.0.0.1", i < streams ? "/stream" : "/stall", i < total - 1 ? port : dead_port,
+                              -1, &procs, st, NULL);
+      st->done = st->rc < 0;
+    }
+  while( http_loop_run(&loop, 1000) )
+    runs++;
+  cpu = thread_cpu() - cpu;
+  t = bench_now() - t;
+
+  for(i = 0; i < total; i++)
+    {
+      st = &bench.stations[i];
+      if( i < streams )
+        {
+          if( st->done && !st->rc && st->bytes == expect )
+            ok++;
+          else
+            failed++;
+          if( least < 0 || st->bytes < least )
+            least = st->bytes;
+          if( st->bytes > most )
+            most = st->bytes;
+        }
+      else if( i < total - 1 )
+        {
+          if( st->rc == -WERR_CONN_TIMEOUT )
+            timeouts++;
+          else
+            failed++;
+        }
+      else if( st->rc < 0 && st->rc != -WERR_CONN_TIMEOUT )
+        refused++;
+      else
+        failed++;
+    }
+
+  printf("1 task for %d streams of %d bytes/s over %d s, %d stalled (%d ms read timeout), 1 refused\n",
+         streams, bench.rate, bench.secs, stalled, read_timeout);
+  printf("%d connected, streams: %d ok of %ld bytes (%ld..%ld got), stalled: %d timed out, refused: %d\n",
+         bench.connected, ok, expect, least < 0 ? 0 : least, most, timeouts, refused);
+  printf("loop: %d runs in %.2f s, %.0f ms CPU (%.1f%% of a core), %d failed\n",
+         runs, t, cpu * 1000, cpu * 100 / t, failed);
+
+  http_loop_deinit(&loop);
+  close(bench.listen_fd);
+  ws_free(bench.stations);
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,668 @@
+/*
+ *  NanoRadio (Open source IoT hardware)
+ *
+ *  This project is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License(GPL)
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This project is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+/*
+ * Offline MPEG decoder benchmark. Decodes a file or stdin without network
+ * or sound hardware, to a null sink or a WAV file, and reports throughput.
+ * Built with MAD_PROFILE it also reports the cycles of each decoding stage.
+ * With -c it damages a burst of bytes about every 'interval' bytes of the
+ * input, from a fixed seed, and reports how the decoder resynchronized
+ * and concealed the frames it lost.
+ * With -s it seeks to 'ms' after the first block, as the radio does with
+ * a ranged request, through the seek index of the stream.
+ * With -i it only builds the frame index of the input, from the frame
+ * headers, and reports the duration and average bitrate it gives. With
+ * -s as well it decodes, and seeks through the frame index instead.
+ * With -H it synthesizes at half the sample rate and with -m it outputs
+ * one channel of stereo streams, the left or right one or both mixed, as
+ * the decoder does for sinks that take no more.
+ * With -v it decodes the input twice, with the SIMD IMDCT and synthesis
+ * the host selected and with the scalar ones, and compares the output
+ * sample by sample. Built with FPM_64BIT the two must be the same.
+ * With -d it only times 'rounds' granules of random subband samples
+ * through the per-slot and the batched DCT of the synthesis, and checks
+ * that they agree.
+ * With -a it hands the output to a null audio device, in blocks through
+ * adif_write_block() or two bytes at a time through adif_write(), as the
+ * radio rendered it before the blocks, and reports the CPU time taken per
+ * second of audio.
+ *
+ *   mpeg-bench [-o out.wav] [-n repeat] [-c interval] [-s ms] [-H] [-m left|right|mix] [-i] [-v] [-d rounds]
+ *              [-a block|sample] [file | -]
+ */
+
+#include "portable.h"
+#include "util-task.h"
+#include "af-interface.h"
+#include "af-codec.h"
+#include "codec-mpeg/codec-mpeg.h"
+#include "codec-mpeg/index.h"
+#include "codec-mpeg/profile.h"
+#include "bench-util.h"
+
+#include <time.h>
+
+/* The radio's default decoder I/O is never used here, but links against these.
+ * -a points adif_instance at the null device below. */
+const adif_t *adif_instance;
+volatile audio_status_t audio_status;
+volatile char audio_running;
+
+typedef struct
+{
+  const char *data;
+  long size, pos;
+  unsigned long input;     /* bytes returned by bench_read(), the decoder's input position */
+
+  mpeg_decoder_t *dec;
+  const struct mad_index *index; /* frame index to seek by, or NULL */
+  long seek;              /* position to seek to after the first block, or -1 */
+  int half;               /* output at half the stream's sample rate */
+  mpeg_channels_t mode;
+  unsigned long offset;   /* where the seek went */
+  char seeked;
+
+  FILE *wav;
+  long wav_bytes;
+  adif_format_t fmt;      /* format of the WAV file, from the first block */
+  int rate;               /* current stream format */
+  unsigned channels;
+
+  double seconds;         /* audio decoded */
+  double frames;          /* MPEG frames decoded */
+
+  int render;             /* 0 none, 1 blocks to the null device, 2 samples to it */
+  int scalar;             /* decode without the SIMD paths */
+  int verify;             /* 1 records the output into ref, 2 compares it with ref */
+  short *ref;
+  unsigned long ref_len, ref_cap, ref_pos;
+  unsigned long mismatches;
+  int maxdiff;
+} bench_t;
+
+/* The null audio device of -a, takes everything at once */
+static int
+null_init(int opaque)
+{ return 0; }
+
+static void
+null_uninit(int opaque)
+{ }
+
+static int
+null_config(const adif_format_t *format, int opaque)
+{ return 0; }
+
+static unsigned
+null_write(const void *buff, unsigned size, int opaque)
+{ return size; }
+
+static unsigned
+null_write_block(const short *pcm, unsigned frames, unsigned channels, int opaque)
+{ return frames; }
+
+static const adif_t null_adif =
+  { 0, null_init, null_uninit, null_config, null_write, null_write_block, { 0, 0, 0 } };
+
+static int
+NC_P(bench_read)(void *opaque, char *buf, int len)
+{
+  bench_t *b = (bench_t *)opaque;
+  if( len > b->size - b->pos )
+    len = (int)(b->size - b->pos);
+  memcpy(buf, b->data + b->pos, len);
+  b->pos += len;
+  b->input += len;
+  return len;
+}
+
+static void
+put_le(FILE *f, unsigned long v, int n)
+{
+  while( n-- )
+    {
+      fputc((int)(v & 0xff), f);
+      v >>= 8;
+    }
+}
+
+static void
+NC_P(wav_header)(bench_t *b)
+{
+  unsigned block = b->fmt.channels * 2;
+
+  fwrite("RIFF", 1, 4, b->wav);
+  put_le(b->wav, 36 + b->wav_bytes, 4);
+  fwrite("WAVEfmt ", 1, 8, b->wav);
+  put_le(b->wav, 16, 4);
+  put_le(b->wav, 1, 2);                           /* PCM */
+  put_le(b->wav, b->fmt.channels, 2);
+  put_le(b->wav, b->fmt.sample_rate, 4);
+  put_le(b->wav, b->fmt.sample_rate * block, 4);
+  put_le(b->wav, block, 2);
+  put_le(b->wav, 16, 2);
+  fwrite("data", 1, 4, b->wav);
+  put_le(b->wav, b->wav_bytes, 4);
+}
+
+static void
+NC_P(bench_config)(void *opaque, const adif_format_t *format)
+{
+  bench_t *b = (bench_t *)opaque;
+
+  b->rate = format->sample_rate;
+  b->channels = format->channels;
+  if( b->render == 1 )
+    adif_config(adif_instance, format);
+
+  if( b->wav && !b->fmt.sample_rate )
+    {
+      b->fmt = *format;
+      wav_header(b);
+    }
+}
+
+/* Hand the output to the null device, in one block or as the radio did
+ * before: the format every 32 frames and each sample on its own */
+static void
+NC_P(render)(bench_t *b, const short *pcm, unsigned frames, unsigned channels)
+{
+  adif_format_t fmt;
+  unsigned i, c;
+  int len;
+
+  if( b->render == 1 )
+    {
+      adif_write_block(adif_instance, pcm, frames, channels);
+      return;
+    }
+
+  fmt.sample_rate = b->rate;
+  fmt.bit_depth = 16;
+  fmt.channels = (short)channels;
+  for(i = 0; i < frames; i++)
+    {
+      if( !(i & 31) )
+        adif_config(adif_instance, &fmt);
+      for(c = 0; c < channels; c++, pcm++)
+        for(len = sizeof(*pcm); len; )
+          len -= adif_write(adif_instance, pcm, sizeof(*pcm));
+    }
+}
+
+/* Record the samples of the first pass, or compare those of the second */
+static void
+NC_P(verify_pcm)(bench_t *b, const short *pcm, unsigned long n)
+{
+  unsigned long i;
+  short *p;
+  int d;
+
+  if( b->verify == 1 )
+    {
+      if( b->ref_len + n > b->ref_cap )
+        {
+          unsigned long cap = b->ref_cap ? b->ref_cap : 1 << 20;
+          while( cap < b->ref_len + n )
+            cap *= 2;
+          if( !(p = ws_realloc(b->ref, cap * sizeof(short))) )
+            {
+              b->mismatches += n; /* told as a failure */
+              return;
+            }
+          b->ref = p;
+          b->ref_cap = cap;
+        }
+      memcpy(b->ref + b->ref_len, pcm, n * sizeof(short));
+      b->ref_len += n;
+      return;
+    }
+
+  for(i = 0; i < n; i++, b->ref_pos++)
+    {
+      if( b->ref_pos >= b->ref_len )
+        {
+          b->mismatches += n - i;
+          return;
+        }
+      d = abs(pcm[i] - b->ref[b->ref_pos]);
+      if( d )
+        {
+          b->mismatches++;
+          if( d > b->maxdiff )
+            b->maxdiff = d;
+        }
+    }
+}
+
+static void
+NC_P(bench_write)(void *opaque, const short *pcm, unsigned frames, unsigned channels)
+{
+  bench_t *b = (bench_t *)opaque;
+  unsigned i;
+  short s[2];
+
+  b->seconds += (double)frames / b->rate;
+  b->frames += (double)frames / (b->rate << b->half < 32000 ? 576 : 1152) * (1 << b->half);
+
+  if( b->seek >= 0 )
+    {
+      mad_timer_t pos;
+
+      /* the ranged request: the input goes on from the offset */
+      mad_timer_set(&pos, 0, b->seek, 1000);
+      if( !mpeg_decoder_seek_offset(b->dec, &pos, &b->offset) && (long)b->offset < b->size )
+        {
+          mpeg_decoder_resync(b->dec, b->input, b->offset);
+          b->pos = (long)b->offset;
+          b->seeked = 1;
+        }
+      b->seek = -1;
+    }
+
+  if( b->verify )
+    verify_pcm(b, pcm, (unsigned long)frames * channels);
+  if( b->render )
+    render(b, pcm, frames, channels);
+
+  if( !b->wav )
+    return;
+
+  /* a WAV file has one format, fold later channel changes into it */
+  for(i = 0; i < frames; i++, pcm += channels)
+    {
+      if( channels == b->fmt.channels )
+        {
+          s[0] = pcm[0];
+          s[1] = channels > 1 ? pcm[1] : 0;
+        }
+      else if( channels == 1 )
+        s[0] = s[1] = pcm[0];
+      else
+        s[0] = s[1] = (short)((pcm[0] + pcm[1]) / 2);
+      put_le(b->wav, (unsigned short)s[0], 2);
+      if( b->fmt.channels > 1 )
+        put_le(b->wav, (unsigned short)s[1], 2);
+    }
+  b->wav_bytes += frames * b->fmt.channels * 2;
+}
+
+static char *
+NC_P(load)(const char *path, long *size)
+{
+  FILE *f = strcmp(path, "-") ? fopen(path, "rb") : stdin;
+  char *data = NULL, *p;
+  long cap = 0, n;
+
+  if( !f )
+    return NULL;
+
+  *size = 0;
+  for(;;)
+    {
+      if( *size == cap )
+        {
+          cap = cap ? cap * 2 : 1 << 20;
+          if( !(p = ws_realloc(data, cap)) )
+            {
+              ws_free(data);
+              data = NULL;
+              break;
+            }
+          data = p;
+        }
+      if( (n = (long)fread(data + *size, 1, cap - *size, f)) <= 0 )
+        break;
+      *size += n;
+    }
+
+  if( f != stdin )
+    fclose(f);
+  return data;
+}
+
+static unsigned long
+rnd(unsigned long *seed)
+{
+  *seed = (*seed * 1103515245UL + 12345UL) & 0xffffffffUL;
+  return *seed >> 8;
+}
+
+/* Overwrite bursts of 1 to 64 random bytes, one per 'interval' bytes on average */
+static long
+NC_P(corrupt)(char *data, long size, long interval)
+{
+  unsigned long seed = 1;
+  long pos = 0, len, bursts = 0;
+
+  for(;;)
+    {
+      pos += interval / 2 + (long)(rnd(&seed) % interval);
+      if( pos >= size )
+        break;
+      for(len = 1 + (long)(rnd(&seed) % 64); len && pos < size; len--)
+        data[pos++] = (char)rnd(&seed);
+      bursts++;
+    }
+  return bursts;
+}
+
+static int
+NC_P(decode)(const mpeg_io_t *io, bench_t *b, mpeg_sync_stats_t *stats,
+             mpeg_conceal_stats_t *conceal, long seek)
+{
+  mpeg_decoder_t *dec;
+  adif_format_t caps = { 1, 16, 2 }; /* a sink that takes no full rate */
+
+  b->pos = 0;
+  b->input = 0;
+  b->seek = seek;
+  b->seeked = 0;
+  if( !(b->dec = dec = mpeg_decoder_open(io)) )
+    return -1;
+  if( b->half )
+    mpeg_decoder_set_caps(dec, &caps);
+  mpeg_decoder_set_channels(dec, b->mode);
+  mpeg_decoder_set_scalar(dec, b->scalar);
+  if( b->index )
+    mpeg_decoder_set_index(dec, b->index);
+  mpeg_decoder_run(dec);
+  mpeg_decoder_sync_stats(dec, stats);
+  mpeg_decoder_conceal_stats(dec, conceal);
+  mpeg_decoder_close(dec);
+  return 0;
+}
+
+/* mpeg_channels_t of a -m argument, or -1 */
+static int
+channels_mode(const char *name)
+{
+  static const char *const modes[] = { "both", "left", "right", "mix" };
+  int i;
+
+  for(i = 0; i < 4; i++)
+    if( !strcmp(name, modes[i]) )
+      return i;
+  return -1;
+}
+
+/* CPU time of the process */
+static double
+cpu_now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int
+NC_P(bench_index)(const bench_t *b, int repeat)
+{
+  struct mad_index index;
+  mad_timer_t duration;
+  double t;
+  int i;
+
+  mad_index_init(&index);
+
+  t = bench_now();
+  for(i = 0; i < repeat; i++)
+    {
+      mad_index_finish(&index);
+      mad_index_init(&index);
+      if( mad_index_build(&index, (const unsigned char *)b->data, b->size) )
+        {
+          fprintf(stderr, "out of memory\n");
+          return 1;
+        }
+    }
+  t = bench_now() - t;
+
+  if( mad_index_duration(&index, &duration) )
+    printf("no frames\n");
+  else
+    printf("%lu frames, %lu ms, %lu bps average%s\n", index.count,
+           mad_timer_count(duration, MAD_UNITS_MILLISECONDS), mad_index_bitrate(&index),
+           index.xing.flags ? ", first frame a tag" : "");
+  printf("indexed %ld bytes %d times in %.3f s: %.0f MB/s\n",
+         b->size, repeat, t, t > 0 ? (double)b->size * repeat / t / 1e6 : 0.0);
+
+  mad_index_finish(&index);
+  return 0;
+}
+
+static int
+NC_P(bench_dct32)(int rounds)
+{
+  static mad_fixed_t sbsample[36][32];
+  unsigned long long cycles[2];
+  unsigned long seed = 1;
+  double slots = 36.0 * rounds;
+  int s, i, differ;
+
+  for(s = 0; s < 36; s++)
+    for(i = 0; i < 32; i++)
+      sbsample[s][i] = mad_f_tofixed(((double)(rnd(&seed) & 0xffff) - 32768) / 32768);
+
+  if( (differ = mad_profile_dct32(sbsample, rounds, cycles)) < 0 )
+    {
+      printf("no batched dct32 on this host\n");
+      return 0;
+    }
+
+  printf("dct32 of %.0f slots: %.1f cycles/slot one by one, %.1f batched, %.2fx\n",
+         slots, cycles[0] / slots, cycles[1] / slots,
+         cycles[1] ? (double)cycles[0] / cycles[1] : 0.0);
+  printf("%d of %d outputs differ\n", differ, 36 * 32);
+  return differ != 0;
+}
+
+static int
+NC_P(bench_verify)(const mpeg_io_t *io, bench_t *b, long seek)
+{
+  mpeg_sync_stats_t sync;
+  mpeg_conceal_stats_t conceal;
+  int failed;
+
+  b->verify = 1;
+  b->scalar = 0;
+  if( decode(io, b, &sync, &conceal, seek) )
+    return 1;
+  b->verify = 2;
+  b->scalar = 1;
+  if( decode(io, b, &sync, &conceal, seek) )
+    return 1;
+  if( b->ref_pos < b->ref_len )
+    b->mismatches += b->ref_len - b->ref_pos;
+
+  printf("%lu samples: %lu differ from the scalar output, by at most %d\n",
+         b->ref_len, b->mismatches, b->maxdiff);
+#if defined(FPM_64BIT)
+  failed = b->mismatches != 0;
+#else
+  failed = b->mismatches != 0 && b->maxdiff > 1; /* the float sums round apart */
+#endif
+  if( failed )
+    printf("SIMD output does not conform\n");
+
+  ws_free(b->ref);
+  return failed;
+}
+
+int
+main(int argc, char **argv)
+{
+  const char *in = "-", *out = NULL;
+  int repeat = 1, index = 0, half = 0, mode = 0, verify = 0, dct = 0, render = 0, i;
+  long interval = 0, bursts = 0, seek = -1;
+  mpeg_io_t io;
+  mpeg_sync_stats_t sync;
+  mpeg_conceal_stats_t conceal;
+  bench_t b;
+  struct mad_index frames;
+  double t, cpu, clean = 0;
+#if defined(MAD_PROFILE)
+  static const char *const stages[MAD_STAGE_COUNT] =
+    { "header", "sideinfo", "huffman", "stereo", "imdct", "synth" };
+  unsigned long long total = 0;
+#endif
+
+  for(i = 1; i < argc; i++)
+    {
+      if( !strcmp(argv[i], "-o") && i + 1 < argc )
+        out = argv[++i];
+      else if( !strcmp(argv[i], "-n") && i + 1 < argc )
+        repeat = atoi(argv[++i]);
+      else if( !strcmp(argv[i], "-c") && i + 1 < argc )
+        interval = atol(argv[++i]);
+      else if( !strcmp(argv[i], "-s") && i + 1 < argc )
+        seek = atol(argv[++i]);
+      else if( !strcmp(argv[i], "-H") )
+        half = 1;
+      else if( !strcmp(argv[i], "-m") && i + 1 < argc && (mode = channels_mode(argv[i + 1])) >= 0 )
+        i++;
+      else if( !strcmp(argv[i], "-i") )
+        index = 1;
+      else if( !strcmp(argv[i], "-v") )
+        verify = 1;
+      else if( !strcmp(argv[i], "-d") && i + 1 < argc )
+        dct = atoi(argv[++i]);
+      else if( !strcmp(argv[i], "-a") && i + 1 < argc &&
+               (!strcmp(argv[i + 1], "block") || !strcmp(argv[i + 1], "sample")) )
+        render = strcmp(argv[++i], "block") ? 2 : 1;
+      else if( argv[i][0] == '-' && argv[i][1] )
+        {
+          fprintf(stderr, "usage: %s [-o out.wav] [-n repeat] [-c interval] [-s ms] [-H] [-m left|right|mix] [-i] [-v] [-d rounds] [-a block|sample] [file | -]\n", argv[0]);
+          return strcmp(argv[i], "-h") != 0; /* -h asks for the usage */
+        }
+      else
+        in = argv[i];
+    }
+
+  if( dct > 0 )
+    return bench_dct32(dct);
+
+  ws_bzero(&b, sizeof(b));
+  b.half = half;
+  b.mode = (mpeg_channels_t)mode;
+  b.render = render;
+  if( render )
+    adif_instance = &null_adif;
+  if( !(b.data = load(in, &b.size)) )
+    {
+      fprintf(stderr, "cannot read %s\n", in);
+      return 1;
+    }
+
+  if( index && seek < 0 )
+    {
+      i = bench_index(&b, repeat > 0 ? repeat : 1);
+      ws_free((void *)b.data);
+      return i;
+    }
+
+  mad_index_init(&frames);
+  if( index )
+    {
+      if( mad_index_build(&frames, (const unsigned char *)b.data, b.size) )
+        {
+          fprintf(stderr, "out of memory\n");
+          return 1;
+        }
+      b.index = &frames;
+    }
+
+  io.read = bench_read;
+  io.config = bench_config;
+  io.write = bench_write;
+  io.opaque = &b;
+  io.avail = NULL; /* the whole input is at hand, never late */
+
+  if( verify )
+    {
+      i = bench_verify(&io, &b, seek);
+      mad_index_finish(&frames);
+      ws_free((void *)b.data);
+      return i;
+    }
+
+  if( interval > 0 )
+    {
+      /* decode the intact stream once, to tell how much audio the damage costs */
+      if( decode(&io, &b, &sync, &conceal, -1) )
+        return 1;
+      clean = b.frames;
+      b.frames = b.seconds = 0;
+#if defined(MAD_PROFILE)
+      ws_bzero(mad_stage_cycles, sizeof(mad_stage_cycles));
+#endif
+      bursts = corrupt((char *)b.data, b.size, interval);
+    }
+
+  if( out && !(b.wav = fopen(out, "wb")) )
+    {
+      fprintf(stderr, "cannot create %s\n", out);
+      return 1;
+    }
+
+  t = bench_now();
+  cpu = cpu_now();
+  for(i = 0; i < (repeat > 0 ? repeat : 1); i++)
+    if( decode(&io, &b, &sync, &conceal, seek) )
+      return 1;
+  cpu = cpu_now() - cpu;
+  t = bench_now() - t;
+
+  if( b.wav )
+    {
+      if( b.fmt.sample_rate && !fseek(b.wav, 0, SEEK_SET) )
+        wav_header(&b); /* the sizes are known now */
+      fclose(b.wav);
+    }
+
+  printf("%.0f frames, %.1f s of audio in %.3f s: %.0f frames/s, %.1fx realtime\n",
+         b.frames, b.seconds, t, t > 0 ? b.frames / t : 0.0, t > 0 ? b.seconds / t : 0.0);
+  printf("%.2f ms of CPU per second of audio\n", b.seconds > 0 ? cpu * 1000 / b.seconds : 0.0);
+
+  if( seek >= 0 && b.seeked )
+    printf("seek to %ld ms: offset %lu%s\n", seek, b.offset, b.index ? " by the frame index" : "");
+  else if( seek >= 0 )
+    printf("seek to %ld ms: not in the stream\n", seek);
+
+  if( interval > 0 )
+    {
+      /* counters and losses are those of one pass */
+      double lost = clean - b.frames / (repeat > 0 ? repeat : 1);
+
+      printf("%ld bursts: %lu resyncs, %lu bytes skipped, %lu candidates rejected\n",
+             bursts, sync.resyncs, sync.skipped, sync.rejected);
+      printf("%.0f of %.0f frames lost, %.2f per burst\n",
+             lost, clean, bursts ? lost / bursts : 0.0);
+      printf("%lu frames dropped, %lu concealed\n", conceal.dropped, conceal.concealed);
+    }
+
+#if defined(MAD_PROFILE)
+  for(i = 0; i < MAD_STAGE_COUNT; i++)
+    total += mad_stage_cycles[i];
+  printf("%-10s %14s %12s %7s\n", "stage", "cycles", "cycles/frame", "share");
+  for(i = 0; i < MAD_STAGE_COUNT; i++)
+    printf("%-10s %14llu %12.0f %6.1f%%\n", stages[i], mad_stage_cycles[i],
+           b.frames > 0 ? mad_stage_cycles[i] / b.frames : 0.0,
+           total ? 100.0 * mad_stage_cycles[i] / total : 0.0);
+#endif
+
+  mad_index_finish(&frames);
+  ws_free((void *)b.data);
+  return 0;
+}
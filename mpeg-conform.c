@@ -0,0 +1,290 @@
+/*
+ *  NanoRadio (Open source IoT hardware)
+ *
+ *  This project is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License(GPL)
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This project is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+/*
+ * Bit-exactness check of the fixed-point decoder, the arithmetic of the
+ * ESP8266 build. Synthesizes a fixed MPEG-1 Layer III stream: random
+ * main data behind valid side info, with long, start, short, mixed and
+ * stop blocks, M/S and intensity stereo and the bit reservoir in use.
+ * Decodes it with the SIMD IMDCT and synthesis the host selected and with
+ * the scalar ones, both channels at full rate and mixed down at half
+ * rate, and checks the FNV-1a hash of each output against the reference.
+ * Built with codec-mpeg in FPM_64BIT by "make -f Makefile.unix check",
+ * whatever FPM the other targets use.
+ * With -p it prints the hashes, to take over as the reference after a
+ * change that alters the output on purpose.
+ * Exits with 1 if any output differs.
+ *
+ *   mpeg-conform [-p]
+ */
+
+#include "portable.h"
+#include "util-task.h"
+#include "af-interface.h"
+#include "af-codec.h"
+#include "codec-mpeg/codec-mpeg.h"
+
+/* The radio's default decoder I/O is never used here, but links against these. */
+const adif_t *adif_instance;
+volatile audio_status_t audio_status;
+volatile char audio_running;
+
+#define FRAMES 400
+#define FRAME_SIZE 417  /* 128 kbps at 44.1 kHz, unpadded */
+#define SIDE_INFO 32    /* two channels */
+#define MAIN_DATA (FRAME_SIZE - 4 - SIDE_INFO)
+#define RESERVOIR 400   /* most main data left over for the next frame */
+#define MIN_LENGTH 240  /* least main data of a frame, its big values fit in */
+
+/* of the outputs of the two passes, in the order of passes[] */
+static const unsigned long long reference[2] =
+  { 0xbd3157c588d583dcULL, 0x07151045a48c9aa2ULL };
+
+typedef struct
+{
+  const char *name;
+  mpeg_channels_t channels;
+  int half;
+} pass_t;
+
+static const pass_t passes[2] =
+  {
+    { "stereo, full rate", MPEG_CHANNELS_BOTH, 0 },
+    { "mixed, half rate", MPEG_CHANNELS_MIX, 1 }
+  };
+
+typedef struct
+{
+  const unsigned char *data;
+  long size, pos;
+  unsigned long long hash;
+  unsigned long samples;
+} conform_t;
+
+static unsigned long rnd_state;
+
+/* The same pseudo-random sequence on every host, 0 to n - 1 */
+static unsigned
+NC_P(rnd)(unsigned n)
+{
+  rnd_state = (rnd_state * 1103515245UL + 12345UL) & 0xffffffffUL;
+  return (unsigned)(rnd_state >> 8) % n;
+}
+
+/* Write the 'n' low bits of 'v' at bit '*at' of 'p', cleared before */
+static void
+NC_P(put_bits)(unsigned char *p, unsigned long *at, unsigned v, int n)
+{
+  while( n-- )
+    {
+      if( (v >> n) & 1 )
+        p[*at >> 3] |= 0x80 >> (*at & 7);
+      (*at)++;
+    }
+}
+
+/* Side info of one granule of one channel. 'block' is 0 for a long block
+ * without window switching, else block_type, plus 4 if it is mixed. */
+static void
+NC_P(put_granule)(unsigned char *p, unsigned long *at, unsigned part2_3_length, int block)
+{
+  static const unsigned char tables[] =
+    { 1, 2, 3, 5, 6, 7, 8, 9, 10, 11, 12, 13, 15, 16, 17, 20, 24, 28 };
+  int i;
+
+  put_bits(p, at, part2_3_length, 12);
+  put_bits(p, at, 8 + rnd(32), 9);          /* big_values */
+  put_bits(p, at, 140 + rnd(30), 8);        /* global_gain, loud but for a few clips */
+  put_bits(p, at, rnd(16), 4);              /* scalefac_compress */
+  put_bits(p, at, block != 0, 1);           /* window_switching_flag */
+  if( block )
+    {
+      put_bits(p, at, block & 3, 2);
+      put_bits(p, at, block >> 2, 1);
+      for(i = 0; i < 2; i++)
+        put_bits(p, at, tables[rnd(sizeof(tables))], 5);
+      for(i = 0; i < 3; i++)
+        put_bits(p, at, rnd(8), 3);         /* subblock_gain */
+    }
+  else
+    {
+      for(i = 0; i < 3; i++)
+        put_bits(p, at, tables[rnd(sizeof(tables))], 5);
+      put_bits(p, at, rnd(16), 4);          /* region0_count */
+      put_bits(p, at, rnd(8), 3);           /* region1_count */
+    }
+  put_bits(p, at, rnd(2), 1);               /* preflag */
+  put_bits(p, at, rnd(2), 1);               /* scalefac_scale */
+  put_bits(p, at, rnd(2), 1);               /* count1table_select */
+}
+
+/* The stream to decode, FRAMES frames of FRAME_SIZE bytes */
+static unsigned char *
+NC_P(make_stream)(void)
+{
+  unsigned char *stream = (unsigned char *)ws_malloc(FRAMES * FRAME_SIZE), *p;
+  unsigned long used = 0, at;  /* main data bytes taken by the frames so far */
+  unsigned long begin, avail, lo, len;
+  int block[2], joint, ext, gr, ch, i, f;
+
+  if( !stream )
+    return NULL;
+  ws_bzero(stream, FRAMES * FRAME_SIZE);
+  rnd_state = 1;
+
+  for(f = 0; f < FRAMES; f++)
+    {
+      p = stream + f * FRAME_SIZE;
+
+      /* leave the next frame at most RESERVOIR bytes of this one's main data */
+      begin = (unsigned long)f * MAIN_DATA - used;
+      avail = begin + MAIN_DATA;
+      lo = avail > RESERVOIR + MIN_LENGTH ? avail - RESERVOIR : MIN_LENGTH;
+      len = avail < lo ? avail : lo + rnd(avail - lo + 1);
+
+      for(gr = 0; gr < 2; gr++)
+        {
+          i = rnd(6);
+          block[gr] = i < 3 ? 0 : i - 2;
+          if( block[gr] == 2 && rnd(2) )
+            block[gr] |= 4;
+        }
+      joint = rnd(4) != 0;
+      ext = joint ? rnd(4) : 0;
+
+      p[0] = 0xff;
+      p[1] = 0xfb;
+      p[2] = 0x90;
+      p[3] = (joint << 6) | (ext << 4);
+
+      at = 0;
+      put_bits(p + 4, &at, begin, 9);
+      put_bits(p + 4, &at, 0, 3);
+      for(ch = 0; ch < 2; ch++)
+        put_bits(p + 4, &at, (block[0] & 3) == 2 || (block[1] & 3) == 2 ? 0 : rnd(16), 4);
+      for(gr = 0; gr < 2; gr++)
+        for(ch = 0; ch < 2; ch++)
+          put_granule(p + 4, &at, len * 2, block[gr]); /* len * 8 bits in four */
+
+      for(i = 4 + SIDE_INFO; i < FRAME_SIZE; i++)
+        p[i] = (unsigned char)rnd(256);
+      used += len;
+    }
+  return stream;
+}
+
+static int
+NC_P(conform_read)(void *opaque, char *buf, int len)
+{
+  conform_t *c = (conform_t *)opaque;
+  if( len > c->size - c->pos )
+    len = (int)(c->size - c->pos);
+  memcpy(buf, c->data + c->pos, len);
+  c->pos += len;
+  return len;
+}
+
+static void
+NC_P(conform_config)(void *opaque, const adif_format_t *format)
+{
+  (void)opaque; (void)format;
+}
+
+/* FNV-1a over the samples */
+static void
+NC_P(conform_write)(void *opaque, const short *pcm, unsigned frames, unsigned channels)
+{
+  conform_t *c = (conform_t *)opaque;
+  unsigned long n = (unsigned long)frames * channels;
+  unsigned long long h = c->hash;
+  unsigned short s;
+
+  c->samples += n;
+  while( n-- )
+    {
+      s = (unsigned short)*pcm++; /* low byte first on every host */
+      h = (h ^ (s & 0xff)) * 1099511628211ULL;
+      h = (h ^ (s >> 8)) * 1099511628211ULL;
+    }
+  c->hash = h;
+}
+
+/* Decode the stream in 'c' as 'pass' says, return the hash of the output */
+static unsigned long long
+NC_P(decode)(conform_t *c, const pass_t *pass, int scalar)
+{
+  mpeg_io_t io;
+  mpeg_decoder_t *dec;
+  adif_format_t caps = { 1, 16, 2 }; /* a sink that takes no full rate */
+
+  io.read = conform_read;
+  io.config = conform_config;
+  io.write = conform_write;
+  io.opaque = c;
+  io.avail = NULL;
+
+  c->pos = 0;
+  c->samples = 0;
+  c->hash = 14695981039346656037ULL;
+  if( !(dec = mpeg_decoder_open(&io)) )
+    return 0;
+  if( pass->half )
+    mpeg_decoder_set_caps(dec, &caps);
+  mpeg_decoder_set_channels(dec, pass->channels);
+  mpeg_decoder_set_scalar(dec, scalar);
+  mpeg_decoder_run(dec);
+  mpeg_decoder_close(dec);
+  return c->hash;
+}
+
+int
+main(int argc, char **argv)
+{
+  conform_t c;
+  unsigned long long hash;
+  int print = 0, failed = 0, i, scalar;
+
+  if( argc > 1 && !strcmp(argv[1], "-p") )
+    print = 1;
+  else if( argc > 1 )
+    {
+      fprintf(stderr, "usage: %s [-p]\n", argv[0]);
+      return strcmp(argv[1], "-h") != 0;
+    }
+
+  ws_bzero(&c, sizeof(c));
+  if( !(c.data = make_stream()) )
+    return 1;
+  c.size = FRAMES * FRAME_SIZE;
+
+  for(i = 0; i < 2; i++)
+    for(scalar = 0; scalar < 2; scalar++)
+      {
+        hash = decode(&c, &passes[i], scalar);
+        if( print )
+          printf("%s, %s: 0x%016llxULL, %lu samples\n", passes[i].name,
+                 scalar ? "scalar" : "selected", hash, c.samples);
+        else if( hash != reference[i] )
+          {
+            printf("%s, %s: 0x%016llx differs from 0x%016llx\n", passes[i].name,
+                   scalar ? "scalar" : "selected", hash, reference[i]);
+            failed = 1;
+          }
+      }
+  if( !print && !failed )
+    printf("%d frames decoded bit-exact in %d passes\n", FRAMES, 4);
+
+  ws_free((void *)c.data);
+  return failed;
+}
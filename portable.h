@@ -18,6 +18,11 @@
 /*
  * Configuration definitions
  */
+#if defined(NANORADIO_HOST)
+/* host builds of Makefile.unix bring their own, see bsp-host */
+# include "portable-config.h"
+#else
+
 /* #define USING_PORT_POSIX 1 */
 #undef USING_PORT_POSIX
 
@@ -45,22 +50,58 @@
 #define USING_ADIF_ESP_I2S_DSM 1
 /* #undef USING_ADIF_ESP_I2S_DSM */
 
+#endif /* NANORADIO_HOST */
+
 
 #define ENABLE_INNER_SRAM_BUFF 1
 /* #undef ENABLE_INNER_SRAM_BUFF */
 
+/* Lock-free single-producer/single-consumer audio FIFO */
+#ifndef ENABLE_AF_BUFFER_SPSC
+#define ENABLE_AF_BUFFER_SPSC 1
+#endif
+/* #undef ENABLE_AF_BUFFER_SPSC */
+
 #define SPIREADSIZE 64
 
 #define SPIRAMSIZE 8 * 1024 * 1024
 
 #define CHUNK_SIZE 8192
 
+/* Audio buffered in complete, valid frames before a stream starts playing, in ms.
+ * 0 plays from the first bytes received. */
+#define AUDIO_PREROLL_MS 200
+
 #ifdef USING_PORT_ESP8266
 # define ENABLE_BSS_ALIGN 1
 #else
 # undef ENABLE_BSS_ALIGN
 #endif
 
+/* Direct lookup Huffman tables for Layer III, too large for ESP8266 flash */
+#ifdef USING_PORT_ESP8266
+# undef ENABLE_HUFF_LUT
+#elif !defined(ENABLE_HUFF_LUT)
+# define ENABLE_HUFF_LUT 1
+#endif
+
+/* Word-at-a-time bitstream reads, need cheap unaligned loads */
+#ifdef USING_PORT_ESP8266
+# undef ENABLE_BIT_WORD_READ
+#elif !defined(ENABLE_BIT_WORD_READ)
+# define ENABLE_BIT_WORD_READ 1
+#endif
+
+/* Decode and synthesize MPEG frames on two tasks, no gain on a single core */
+#ifdef USING_PORT_ESP8266
+# undef ENABLE_MPEG_PIPELINE
+#else
+# define ENABLE_MPEG_PIPELINE 1
+#endif
+
+/* Stand in for MPEG frames lost to errors or late input, keeping the output paced */
+#define ENABLE_MPEG_CONCEAL 1
+
 #define PORT(type)  (defined USING_PORT_##type && USING_PORT_##type)
 
 #define ENABLE(type)  (defined ENABLE_##type && ENABLE_##type)
@@ -148,6 +189,7 @@ static inline char *ws_strndup( const char *src, size_t len )
 #define WERR_BUSY         (11)
 #define WERR_UNKNOW_TYPE  (12)
 #define WERR_BUFFER_OVERFLOW (13)
+#define WERR_AGAIN        (14)    /* a non-blocking socket has nothing for now */
 
 #endif //!defined(PORTABLE_H_)
 
@@ -0,0 +1,361 @@
+/*
+ *  NanoRadio (Open source IoT hardware)
+ *
+ *  This project is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License(GPL)
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This project is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+/*
+ * Stream startup benchmark. A local HTTP stand-in server sends a file the
+ * way a radio station does, an optional burst on connect and then the rest
+ * at the average bitrate of the stream, held back for up to 'jitter' ms at
+ * random to mimic a bad link. The radio's own HTTP client, audio
+ * FIFO and decoder play it into a sink paced like the audio device.
+ * Reports the time from the request to the first byte and to the first
+ * sample, and the underruns of the sink after that, for a given pre-roll,
+ * as well as the frames the decoder concealed for input that came late and
+ * how the jitter buffer of the audio FIFO adapted.
+ *
+ *   stream-bench [-p preroll_ms] [-b burst_bytes] [-r rate_percent] [-j jitter_ms] [-t seconds] file
+ */
+
+#include "portable.h"
+#include "util-task.h"
+#include "af-interface.h"
+#include "af-codec.h"
+#include "af-buffer.h"
+#include "http-protocol.h"
+#include "dns-cache.h"
+#include "codec-mpeg/codec-mpeg.h"
+#include "codec-mpeg/index.h"
+#include "bench-util.h"
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+/* The decoder's default input links against these, as in the radio. */
+const adif_t *adif_instance;
+volatile audio_status_t audio_status;
+volatile char audio_running;
+
+/* Audio the sink takes ahead of playing it, as the device's DMA buffers do */
+#define SINK_DEPTH_MS 100
+
+/* Interval the server sends what is due in */
+#define SERVE_SLICE_MS 10
+
+typedef struct
+{
+  const char *data;
+  long size;
+  double rate;            /* bytes per second the server sends at */
+  long burst;             /* bytes sent at once on connect */
+  int jitter;             /* ms the server may hold back each send for */
+  double seconds;         /* the server closes the stream after this */
+  int listen_fd;
+
+  http_t http;
+  char http_buff[HTTP_BUFF_SIZE];
+  mpeg_decoder_t *dec;
+  util_semaphore_t done;
+
+  double t0;              /* when the request was made */
+  double first_byte;      /* after t0, or < 0 till it happens */
+  double first_sample;
+  double sink_end;        /* when the audio written so far has played */
+  int sample_rate;
+  double played;          /* seconds of audio written */
+  long underruns;
+  double silent, longest; /* seconds the sink ran dry */
+} bench_t;
+
+/* The HTTP events carry no context. */
+static bench_t bench;
+
+static unsigned long
+rnd(unsigned long *seed)
+{
+  *seed = (*seed * 1103515245UL + 12345UL) & 0xffffffffUL;
+  return *seed >> 8;
+}
+
+/*
+ * Stand-in server, for a single request whatever it asks for.
+ */
+static void
+NC_P(task_serve)(void *opaque)
+{
+  static const char header[] =
+    "HTTP/1.1 200 OK\r\nContent-Type: audio/mpeg\r\nConnection: close\r\n\r\n";
+  bench_t *b = (bench_t *)opaque;
+  char request[512];
+  double start, t;
+  long pos = 0, n;
+  unsigned long seed = 1;
+  int fd;
+
+  if( (fd = accept(b->listen_fd, NULL, NULL)) >= 0 )
+    {
+      recv(fd, request, sizeof(request), 0);
+      send(fd, header, sizeof(header) - 1, 0);
+
+      start = bench_now();
+      while( pos < b->size && (t = bench_now() - start) < b->seconds )
+        {
+          n = b->burst + (long)(t * b->rate) - pos; /* what is due by now */
+          if( n > b->size - pos )
+            n = b->size - pos;
+          if( n > 0 )
+            {
+              if( (n = send(fd, b->data + pos, n, 0)) <= 0 )
+                break;
+              pos += n;
+            }
+          util_task_sleep(SERVE_SLICE_MS + (b->jitter ? (int)(rnd(&seed) % b->jitter) : 0));
+        }
+      close(fd);
+    }
+  util_task_exit();
+}
+
+/*
+ * Radio side, set up as in task-af.c.
+ */
+static void
+NC_P(task_decode)(void *opaque)
+{
+  mpeg_decoder_run(bench.dec);
+  util_semaphore_give(bench.done);
+  util_task_exit();
+  WS_UNUSED(opaque);
+}
+
+static int
+NC_P(body_arrived)(void)
+{
+  if( bench.first_byte < 0 )
+    {
+      bench.first_byte = bench_now() - bench.t0;
+      if( util_create_task(task_decode, "aud_dec", 2100, CORE_CODEC, NULL) )
+        return -WERR_FAILED;
+    }
+  return 0;
+}
+
+static int
+NC_P(event_body)(char *at, int length)
+{
+  audio_buffer_write(at, length);
+  return body_arrived();
+}
+
+#if defined(AF_BUFFER_ZEROCOPY)
+static char *
+NC_P(event_body_buffer)(int *length)
+{
+  return audio_buffer_reserve_write(length);
+}
+
+static int
+NC_P(event_body_commit)(int length)
+{
+  audio_buffer_commit_write(length);
+  return body_arrived();
+}
+#endif
+
+static void
+NC_P(task_connect)(void *opaque)
+{
+  static const char pad[64];
+  http_event_procs_t procs;
+
+  http_callbacks_init(&procs);
+  procs.event_body = event_body;
+#if defined(AF_BUFFER_ZEROCOPY)
+  procs.event_body_buffer = event_body_buffer;
+  procs.event_body_commit = event_body_commit;
+#endif
+
+  http_read_response(&bench.http, &procs);
+  ws_socket_close(&bench.http.socket);
+
+  /* end the decoder's input, waking it up if it waits on the FIFO */
+  util_atomic_store(&audio_running, 0);
+  if( bench.first_byte < 0 )
+    util_semaphore_give(bench.done);
+  else
+    audio_buffer_write(pad, sizeof(pad));
+  util_task_exit();
+  WS_UNUSED(opaque);
+}
+
+static void
+NC_P(sink_config)(void *opaque, const adif_format_t *format)
+{
+  bench.sample_rate = format->sample_rate;
+  WS_UNUSED(opaque);
+}
+
+/* Play out in real time, taking up to SINK_DEPTH_MS ahead */
+static void
+NC_P(sink_write)(void *opaque, const short *pcm, unsigned frames, unsigned channels)
+{
+  double t = bench_now(), ahead;
+
+  if( bench.first_sample < 0 )
+    {
+      bench.first_sample = t - bench.t0;
+      bench.sink_end = t;
+    }
+  else if( t > bench.sink_end )
+    {
+      bench.underruns++;
+      bench.silent += t - bench.sink_end;
+      if( t - bench.sink_end > bench.longest )
+        bench.longest = t - bench.sink_end;
+      bench.sink_end = t;
+    }
+
+  bench.sink_end += (double)frames / bench.sample_rate;
+  bench.played += (double)frames / bench.sample_rate;
+
+  ahead = bench.sink_end - t - SINK_DEPTH_MS / 1000.0;
+  if( ahead > 0 )
+    util_task_sleep((int)(ahead * 1000));
+  WS_UNUSED(opaque);
+  WS_UNUSED(pcm);
+  WS_UNUSED(channels);
+}
+
+static char *
+NC_P(load)(const char *path, long *size)
+{
+  FILE *f = fopen(path, "rb");
+  char *data = NULL;
+
+  if( !f )
+    return NULL;
+  if( !fseek(f, 0, SEEK_END) && (*size = ftell(f)) > 0 && !fseek(f, 0, SEEK_SET) &&
+      (data = ws_malloc(*size)) && (long)fread(data, 1, *size, f) != *size )
+    {
+      ws_free(data);
+      data = NULL;
+    }
+  fclose(f);
+  return data;
+}
+
+int
+main(int argc, char **argv)
+{
+  const char *in = NULL;
+  unsigned preroll = AUDIO_PREROLL_MS;
+  int percent = 100, port, i;
+  struct mad_index index;
+  unsigned long bitrate;
+  mpeg_io_t io;
+  mpeg_conceal_stats_t conceal;
+
+  ws_bzero(&bench, sizeof(bench));
+  bench.seconds = 10;
+
+  for(i = 1; i < argc; i++)
+    {
+      if( !strcmp(argv[i], "-p") && i + 1 < argc )
+        preroll = (unsigned)atoi(argv[++i]);
+      else if( !strcmp(argv[i], "-b") && i + 1 < argc )
+        bench.burst = atol(argv[++i]);
+      else if( !strcmp(argv[i], "-r") && i + 1 < argc )
+        percent = atoi(argv[++i]);
+      else if( !strcmp(argv[i], "-j") && i + 1 < argc )
+        bench.jitter = atoi(argv[++i]);
+      else if( !strcmp(argv[i], "-t") && i + 1 < argc )
+        bench.seconds = atof(argv[++i]);
+      else if( argv[i][0] == '-' || in )
+        {
+          fprintf(stderr, "usage: %s [-p preroll_ms] [-b burst_bytes] [-r rate_percent] [-j jitter_ms] [-t seconds] file\n", argv[0]);
+          return 1;
+        }
+      else
+        in = argv[i];
+    }
+
+  if( !in || !(bench.data = load(in, &bench.size)) )
+    {
+      fprintf(stderr, "cannot read %s\n", in ? in : "(none)");
+      return 1;
+    }
+
+  /* the server sends at the average bitrate of the stream */
+  mad_index_init(&index);
+  mad_index_build(&index, (const unsigned char *)bench.data, bench.size);
+  bitrate = mad_index_bitrate(&index);
+  mad_index_finish(&index);
+  if( !bitrate )
+    {
+      fprintf(stderr, "no MPEG frames in %s\n", in);
+      return 1;
+    }
+  bench.rate = bitrate / 8.0 * percent / 100;
+
+  audio_buffer_init();
+  dns_cache_init(); /* as task_audio_init() does */
+  audio_status = AUDIO_DECODING;
+  audio_running = 1;
+
+  io.read = NULL; /* the audio FIFO, as in the radio */
+  io.config = sink_config;
+  io.write = sink_write;
+  io.opaque = NULL;
+  io.avail = NULL;
+  if( !(bench.dec = mpeg_decoder_open(&io)) || !(bench.done = util_create_semaphore(0)) )
+    return 1;
+  mpeg_decoder_set_preroll(bench.dec, preroll);
+
+  if( (bench.listen_fd = bench_listen_local(&port, 1)) < 0 ||
+      util_create_task(task_serve, "srv", 0, CORE_STREAM, &bench) )
+    {
+      fprintf(stderr, "cannot serve on the loopback interface\n");
+      return 1;
+    }
+
+  http_init(&bench.http, bench.http_buff, sizeof(bench.http_buff));
+  bench.first_byte = bench.first_sample = -1;
+  bench.t0 = bench_now();
+  if( http_request(&bench.http, "127.0.0.1", "/stream.mp3", port, -1, -1) ||
+      util_create_task(task_connect, "aud_conn", 200, CORE_STREAM, NULL) )
+    {
+      fprintf(stderr, "cannot connect to the server\n");
+      return 1;
+    }
+  util_semaphore_take(bench.done);
+
+  printf("pre-roll %u ms, %ld bytes burst, sent at %d%% of %lu bps\n",
+         preroll, bench.burst, percent, bitrate);
+  if( bench.first_sample < 0 )
+    printf("first byte %.1f ms, no audio\n", bench.first_byte * 1000);
+  else
+    printf("first byte %.1f ms, first sample %.1f ms\n",
+           bench.first_byte * 1000, bench.first_sample * 1000);
+  printf("%.1f s played, %ld underruns, %.0f ms silent, longest %.0f ms\n",
+         bench.played, bench.underruns, bench.silent * 1000, bench.longest * 1000);
+  mpeg_decoder_conceal_stats(bench.dec, &conceal);
+  printf("%lu frames concealed for late input\n", conceal.late);
+  printf("FIFO %d bytes, target %d bytes, jitter %d ms, %ld rebuffers\n", audio_buffer_fill(),
+         audio_buffer_get_target(), audio_buffer_get_jitter(), audio_buffer_get_rebuffers());
+
+  mpeg_decoder_close(bench.dec);
+  close(bench.listen_fd);
+  ws_free((void *)bench.data);
+  return 0;
+}
@@ -0,0 +1,230 @@
+/*
+ *  NanoRadio (Open source IoT hardware)
+ *
+ *  This project is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License(GPL)
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This project is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+/*
+ * Concurrent decoder stress test. Decodes each file once on its own for a
+ * reference hash of its output, then decodes 'streams' of them at once,
+ * stream i the file i modulo the count of files, each on a task of its own
+ * with a decoder of its own, 'repeat' times over, and checks the output
+ * of every pass against the reference. Reports the frames/s of all the
+ * streams together against one stream on its own.
+ * Exits with 1 if any output differs.
+ *
+ *   stress-bench [-t streams] [-n repeat] file...
+ */
+
+#include "portable.h"
+#include "util-task.h"
+#include "af-interface.h"
+#include "af-codec.h"
+#include "codec-mpeg/codec-mpeg.h"
+#include "bench-util.h"
+
+/* The radio's default decoder I/O is never used here, but links against these. */
+const adif_t *adif_instance;
+volatile audio_status_t audio_status;
+volatile char audio_running;
+
+#define MAX_FILES 16
+
+typedef struct
+{
+  const char *data;
+  long size;
+  unsigned long long hash; /* of the output decoded on its own */
+  double frames;
+} file_t;
+
+typedef struct
+{
+  const file_t *file;
+  long pos;
+  int repeat;
+  unsigned long long hash;
+  double frames;
+  int rate;
+  long mismatches;         /* passes whose output differed */
+  util_semaphore_t *done;
+} stream_t;
+
+static int
+NC_P(stream_read)(void *opaque, char *buf, int len)
+{
+  stream_t *s = (stream_t *)opaque;
+  if( len > s->file->size - s->pos )
+    len = (int)(s->file->size - s->pos);
+  memcpy(buf, s->file->data + s->pos, len);
+  s->pos += len;
+  return len;
+}
+
+static void
+NC_P(stream_config)(void *opaque, const adif_format_t *format)
+{
+  ((stream_t *)opaque)->rate = format->sample_rate;
+}
+
+/* FNV-1a over the samples */
+static void
+NC_P(stream_write)(void *opaque, const short *pcm, unsigned frames, unsigned channels)
+{
+  stream_t *s = (stream_t *)opaque;
+  const unsigned char *p = (const unsigned char *)pcm;
+  unsigned long n = (unsigned long)frames * channels * sizeof(*pcm);
+  unsigned long long h = s->hash;
+
+  while( n-- )
+    h = (h ^ *p++) * 1099511628211ULL;
+  s->hash = h;
+  s->frames += (double)frames / (s->rate < 32000 ? 576 : 1152);
+}
+
+/* Decode the file of 's' once, return the hash of its output */
+static unsigned long long
+NC_P(decode)(stream_t *s)
+{
+  mpeg_io_t io;
+  mpeg_decoder_t *dec;
+
+  io.read = stream_read;
+  io.config = stream_config;
+  io.write = stream_write;
+  io.opaque = s;
+  io.avail = NULL;
+
+  s->pos = 0;
+  s->hash = 14695981039346656037ULL;
+  if( !(dec = mpeg_decoder_open(&io)) )
+    return 0;
+  mpeg_decoder_run(dec);
+  mpeg_decoder_close(dec);
+  return s->hash;
+}
+
+static void
+NC_P(task_stream)(void *opaque)
+{
+  stream_t *s = (stream_t *)opaque;
+  int i;
+
+  for(i = 0; i < s->repeat; i++)
+    if( decode(s) != s->file->hash )
+      s->mismatches++;
+
+  util_semaphore_give(*s->done);
+  util_task_exit();
+}
+
+static char *
+NC_P(load)(const char *path, long *size)
+{
+  FILE *f = fopen(path, "rb");
+  char *data = NULL;
+
+  if( !f )
+    return NULL;
+  if( !fseek(f, 0, SEEK_END) && (*size = ftell(f)) > 0 && !fseek(f, 0, SEEK_SET) &&
+      (data = ws_malloc(*size)) && fread(data, 1, *size, f) != (size_t)*size )
+    {
+      ws_free(data);
+      data = NULL;
+    }
+  fclose(f);
+  return data;
+}
+
+int
+main(int argc, char **argv)
+{
+  file_t files[MAX_FILES];
+  stream_t *streams, one;
+  util_semaphore_t done;
+  int nstreams = 8, repeat = 1, nfiles = 0, i;
+  long mismatches = 0;
+  double t, t_one = 0, frames = 0, frames_one = 0;
+
+  for(i = 1; i < argc; i++)
+    {
+      if( !strcmp(argv[i], "-t") && i + 1 < argc )
+        nstreams = atoi(argv[++i]);
+      else if( !strcmp(argv[i], "-n") && i + 1 < argc )
+        repeat = atoi(argv[++i]);
+      else if( argv[i][0] == '-' || nfiles == MAX_FILES )
+        break;
+      else
+        {
+          if( !(files[nfiles].data = load(argv[i], &files[nfiles].size)) )
+            {
+              fprintf(stderr, "cannot read %s\n", argv[i]);
+              return 1;
+            }
+          nfiles++;
+        }
+    }
+  if( i < argc || !nfiles || nstreams < 1 || repeat < 1 )
+    {
+      fprintf(stderr, "usage: %s [-t streams] [-n repeat] file...\n", argv[0]);
+      return 1;
+    }
+
+  /* the references, one stream at a time */
+  for(i = 0; i < nfiles; i++)
+    {
+      ws_bzero(&one, sizeof(one));
+      one.file = &files[i];
+      t = bench_now();
+      files[i].hash = decode(&one);
+      t_one += bench_now() - t;
+      files[i].frames = one.frames;
+      frames_one += one.frames;
+    }
+
+  if( !(streams = ws_malloc(nstreams * sizeof(*streams))) )
+    return 1;
+  done = util_create_semaphore(0);
+
+  t = bench_now();
+  for(i = 0; i < nstreams; i++)
+    {
+      ws_bzero(&streams[i], sizeof(streams[i]));
+      streams[i].file = &files[i % nfiles];
+      streams[i].repeat = repeat;
+      streams[i].done = &done;
+      if( util_create_task(task_stream, "stream", 0, CORE_CODEC, &streams[i]) )
+        {
+          fprintf(stderr, "cannot start stream %d\n", i);
+          return 1;
+        }
+    }
+  for(i = 0; i < nstreams; i++)
+    util_semaphore_take(done);
+  t = bench_now() - t;
+
+  for(i = 0; i < nstreams; i++)
+    {
+      mismatches += streams[i].mismatches;
+      frames += streams[i].frames;
+    }
+
+  printf("%d streams x %d passes of %d file(s) on %d cores: %ld of %ld outputs differ\n",
+         nstreams, repeat, nfiles, util_task_get_num_cores(), mismatches, (long)nstreams * repeat);
+  printf("%.0f frames in %.3f s: %.0f frames/s, one stream alone %.0f frames/s\n",
+         frames, t, t > 0 ? frames / t : 0.0, t_one > 0 ? frames_one / t_one : 0.0);
+
+  util_destroy_semaphore(done);
+  ws_free(streams);
+  for(i = 0; i < nfiles; i++)
+    ws_free((void *)files[i].data);
+  return mismatches != 0;
+}
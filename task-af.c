@@ -16,33 +16,77 @@
 #include "af-buffer.h"
 #include "af-interface.h"
 #include "af-codec.h"
+#include "codec-mpeg/codec-mpeg.h"
 
 #include "http-protocol.h"
 #include "tcp-socket.h"
+#include "dns-cache.h"
 #include "util-task.h"
 #include "tasks.h"
 
 #define TRACE_UNIT "task-af"
 #include "util-logtrace.h"
 
+/* One TCP segment, the reads of a chunked stream that go through the buffer */
+#define STREAM_HTTP_BUFF_SIZE 1460
+/* How long a seek waits for the connection it drops to end */
+#define STREAM_ABORT_TIMEOUT 3000
+
 const adif_t *adif_instance;
 volatile audio_status_t audio_status;
 volatile char audio_running;
 static http_t stream_http;
+static char stream_http_buff[STREAM_HTTP_BUFF_SIZE];
 static volatile int audio_error; /* non-atomic, not for accurate controling */
 static volatile stream_type_t stream_type;
 
+/* What a seek needs to fetch the stream again from another offset */
+static char stream_host[64];
+static char stream_file[320];
+static int stream_port;
+static mpeg_decoder_t *stream_decoder; /* under decoder_mux, the decoder task frees it */
+static util_mutex_t decoder_mux;
+static volatile unsigned long stream_written; /* bytes put into the FIFO, the decoder's input position */
+static volatile char stream_connected, stream_abort;
+
+/* Drop the stream decoder, so that a seek no longer finds it, and free it. */
+static void
+NC_P(stream_decoder_close)(void)
+{
+  mpeg_decoder_t *dec;
+
+  util_mutex_take(decoder_mux);
+  dec = stream_decoder;
+  stream_decoder = NULL;
+  util_mutex_give(decoder_mux);
+
+  if( dec )
+    mpeg_decoder_close(dec);
+}
+
+static void
+NC_P(task_audio_mpeg)(void *opaque)
+{
+  mpeg_decoder_run((mpeg_decoder_t *)opaque);
+  stream_decoder_close();
+  util_task_exit();
+}
+
 static int
 NC_P(create_audio_mainloop_task)(void)
 {
   pfn_util_task_callback task_func;
   uint16_t stack_depth;
+  void *opaque = NULL;
 
   switch(stream_type)
     {
       case STREAM_MPEG:
-        task_func = task_mpeg_decode;
+        task_func = task_audio_mpeg;
         stack_depth = 2100;
+        if( !(opaque = stream_decoder = mpeg_decoder_open(NULL)) )
+          return -WERR_NO_MEMORY;
+        mpeg_decoder_set_preroll(stream_decoder, AUDIO_PREROLL_MS);
         break;
 #if 0
       case STREAM_MP4:
@@ -62,9 +106,12 @@ NC_P(create_audio_mainloop_task)(void)
 
   audio_running = 1;
   audio_status = AUDIO_DECODING;
-  if( util_create_task(task_func, "aud_dec", stack_depth, CORE_CODEC, NULL) )
+  if( util_create_task(task_func, "aud_dec", stack_depth, CORE_CODEC, opaque) )
     {
       trace_error(("creating decoder task\n"));
+      stream_decoder_close();
+      audio_running = 0;
+      audio_status = AUDIO_IDLE;
       return -WERR_FAILED;
     }
 
@@ -99,14 +146,44 @@ NC_P(event_content_type)(char *at, int length)
 static int
 NC_P(event_body)(char *at, int length)
 {
+  if( stream_abort )
+    return -WERR_FAILED; /* a seek replaces this connection */
+
   audio_buffer_write( at, length );
+  stream_written += length;
   if( audio_status == AUDIO_IDLE )
     {
-      return create_audio_mainloop_task(); /* run mainloop after buffer pre-filled */
+      return create_audio_mainloop_task(); /* the decoder pre-rolls AUDIO_PREROLL_MS itself */
     }
   return 0;
 }
 
+#if defined(AF_BUFFER_ZEROCOPY)
+/* The body is read straight into the FIFO */
+static char *
+NC_P(event_body_buffer)(int *length)
+{
+  if( stream_abort )
+    return NULL;
+  return audio_buffer_reserve_write(length);
+}
+
+static int
+NC_P(event_body_commit)(int length)
+{
+  if( stream_abort )
+    return -WERR_FAILED; /* a seek replaces this connection */
+
+  audio_buffer_commit_write(length);
+  stream_written += length;
+  if( audio_status == AUDIO_IDLE )
+    {
+      return create_audio_mainloop_task();
+    }
+  return 0;
+}
+#endif
+
 static void
 NC_P(task_audio_http_connect)(void *opaque)
 {
@@ -114,43 +191,115 @@ NC_P(task_audio_http_connect)(void *opaque)
     {
       .event_body = event_body,
       .event_redirect = event_redirect,
-      .event_content_type = event_content_type
+      .event_content_type = event_content_type,
+#if defined(AF_BUFFER_ZEROCOPY)
+      .event_body_buffer = event_body_buffer,
+      .event_body_commit = event_body_commit
+#endif
     };
 
   audio_error = http_read_response(&stream_http, &procs);
+  ws_socket_close(&stream_http.socket);
 
+  util_atomic_store(&stream_connected, 0);
   util_task_exit();
   WS_UNUSED(opaque);
 }
 
+/* Request the stream from byte 'start' on (-1 for all of it) and start the
+ * task feeding the FIFO with it. */
+static int
+NC_P(stream_connect)(int start)
+{
+  int rc;
+
+  http_init(&stream_http, stream_http_buff, sizeof(stream_http_buff));
+  for(;;)
+    {
+      rc = http_request(&stream_http, stream_host, stream_file, stream_port, start, -1);
+      if(rc == -WERR_CONN_FATAL)
+        {
+          trace_debug(("retry\n"));
+          util_task_sleep(500);
+          continue;
+        }
+      else if (!rc)
+        break;
+      else
+        return rc;
+    }
+
+  util_atomic_store(&stream_connected, 1);
+  if( (rc = util_create_task(task_audio_http_connect, "aud_conn", 200, CORE_STREAM, NULL)) )
+    util_atomic_store(&stream_connected, 0);
+  return rc;
+}
+
 int
 NC_P(task_audio_open)(const char *host, const char *file, int port)
 {
   if( audio_status == AUDIO_IDLE )
     {
-      for(;;)
-        {
-          int rc = http_request(&stream_http, host, file, port, -1, -1);
-          if(rc == -WERR_CONN_FATAL)
-            {
-              trace_debug(("retry\n"));
-              util_task_sleep(500);
-              continue;
-            }
-          else if (!rc)
-            break;
-          else
-            return rc;
-        }
-      return util_create_task(task_audio_http_connect, "aud_conn", 200, CORE_STREAM, NULL);
+      if( strlen(host) >= sizeof(stream_host) || strlen(file) >= sizeof(stream_file) )
+        return -WERR_BUFFER_OVERFLOW;
+      strcpy(stream_host, host);
+      strcpy(stream_file, file);
+      stream_port = port;
+      stream_written = 0;
+      stream_abort = 0;
+
+      return stream_connect(-1);
     }
   return -WERR_BUSY;
 }
 
+/* Continue playing at 'ms' into the stream. The offset comes from the seek
+ * index of the stream and is fetched with a ranged request, so only MPEG
+ * streams served with Range support can seek. */
+int
+NC_P(task_audio_seek)(unsigned long ms)
+{
+  mad_timer_t pos;
+  unsigned long offset, start;
+  int rc;
+
+  if( audio_status == AUDIO_IDLE )
+    return -WERR_FAILED;
+
+  mad_timer_set(&pos, 0, ms, 1000);
+  util_mutex_take(decoder_mux);
+  rc = stream_decoder ? mpeg_decoder_seek_offset(stream_decoder, &pos, &offset) : -WERR_FAILED;
+  util_mutex_give(decoder_mux);
+  if( rc )
+    return -WERR_FAILED;
+
+  /* stop feeding the FIFO, then have the decoder skip what is left in it.
+   * A connection stuck in recv() keeps playing, the seek gives up. */
+  stream_abort = 1;
+  for( start = util_task_get_ms(); util_atomic_load(&stream_connected); util_task_sleep(10) )
+    if( util_task_get_ms() - start >= STREAM_ABORT_TIMEOUT )
+      {
+        stream_abort = 0;
+        return -WERR_CONN_TIMEOUT;
+      }
+  stream_abort = 0;
+
+  util_mutex_take(decoder_mux);
+  if( stream_decoder )
+    mpeg_decoder_resync(stream_decoder, stream_written, offset);
+  else
+    rc = -WERR_FAILED;
+  util_mutex_give(decoder_mux);
+
+  return rc ? rc : stream_connect((int)offset);
+}
+
 int
 NC_P(task_audio_init)(void)
 {
-  if( (adif_instance = adif_init(ADIF_RT)) )
+  dns_cache_init(); /* names go uncached without it */
+  if( (decoder_mux || (decoder_mux = util_create_mutex())) &&
+      (adif_instance = adif_init(ADIF_RT)) )
     {
       int rc = audio_buffer_init();
       
@@ -22,6 +22,9 @@
 # include <sys/socket.h>
 # include <arpa/inet.h>
 # include <unistd.h>
+# include <errno.h>
+# include <fcntl.h>
+# include <poll.h>
 # define closesocket close
 
 #elif PORT (LWIP)
@@ -42,33 +45,26 @@
 # include <mbedtls/debug.h>
 #endif
 
+#include "dns-cache.h"
 #include "tcp-socket.h"
 
 #define DEBUG_TCP_SOCKET 0
 
+/* Time a connection may take to be made */
+#define WS_SOCKET_CONN_TIMEOUT_MS 5000
+
 static const unsigned char entropy[4] = {1};
 static size_t entropy_len = sizeof(entropy);
 
+/* Resolve host through the cache of dns-cache.c. Without 'wait', returns
+ * -WERR_AGAIN while the name is being looked up. */
 static int
-NC_P(parsehost)(const char *host, struct sockaddr_in *ip)
+NC_P(parsehost)(const char *host, struct sockaddr_in *ip, int wait)
 {
-  struct hostent *hp;
-  struct in_addr **addr_list;
-
-  hp = gethostbyname (host);
-  if (!hp)
-    {
-      trace_error (("failed to parse host IP address\n"));
-      return -1;
-    }
-  addr_list = (struct in_addr **)hp->h_addr_list;
-  if (addr_list[0])
-    {
-      ip->sin_family = AF_INET;
-      ws_memcpy (&ip->sin_addr, addr_list[0], sizeof(ip->sin_addr));
-      return 0;
-    }
-  return -WERR_CONN_FATAL;
+  int rc = wait ? dns_cache_resolve(host, &ip->sin_addr) : dns_cache_lookup(host, &ip->sin_addr);
+  if( !rc )
+    ip->sin_family = AF_INET;
+  return rc;
 }
 
 static void
@@ -79,6 +75,83 @@ NC_P(tcp_socket_reset)(tcp_socket_t *socket)
   socket->sslconn = 0;
 }
 
+static void
+NC_P(socket_set_nonblock)(int fd, int on)
+{
+#if PORT (LWIP) || PORT (WINSOCK2)
+  unsigned long arg = on;
+  ioctlsocket(fd, FIONBIO, &arg);
+#else
+  int flags = fcntl(fd, F_GETFL, 0);
+  fcntl(fd, F_SETFL, on ? flags | O_NONBLOCK : flags & ~O_NONBLOCK);
+#endif
+}
+
+/* Resolve 'host' and start connecting to it without waiting.
+ * Returns 0 when connected, 1 while it is underway, < 0 if it failed. */
+static int
+NC_P(connect_start)(tcp_socket_t *tsock, const char *host, int port, int wait)
+{
+  struct sockaddr_in remote_ip;
+  int rc;
+
+  ws_bzero (&remote_ip, sizeof(struct sockaddr_in));
+  if ((rc = parsehost (host, &remote_ip, wait)))
+    return rc;
+  remote_ip.sin_port = htons (port);
+
+  if ((tsock->fd = socket(PF_INET, SOCK_STREAM, 0)) < 0)
+    {
+      trace_error (("create a socket\n"));
+      tsock->fd = -1;
+      return -WERR_FAILED;
+    }
+  socket_set_nonblock (tsock->fd, 1);
+
+  if (!connect(tsock->fd, (struct sockaddr *)(&remote_ip), sizeof(struct sockaddr)))
+    return 0;
+  if (errno == EINPROGRESS || errno == EWOULDBLOCK)
+    return 1;
+  closesocket(tsock->fd);
+  tsock->fd = -1;
+  trace_info (("connection failed\n"));
+  return -WERR_PORT;
+}
+
+/* Wait up to 'ms' for a connection underway. poll() takes any fd, where
+ * FD_SET() would write past an fd_set for one of FD_SETSIZE or more. lwIP
+ * sockets are numbered below its FD_SETSIZE. */
+static int
+NC_P(connect_wait)(tcp_socket_t *tsock, int ms)
+{
+#if PORT (SOCKET)
+  struct pollfd pfd;
+  int rc;
+
+  pfd.fd = tsock->fd;
+  pfd.events = POLLOUT;
+  rc = poll(&pfd, 1, ms);
+#else
+  fd_set wfds;
+  struct timeval tv;
+  int rc;
+
+  FD_ZERO(&wfds);
+  FD_SET(tsock->fd, &wfds);
+  tv.tv_sec = ms / 1000;
+  tv.tv_usec = (ms % 1000) * 1000;
+  rc = select(tsock->fd + 1, NULL, &wfds, NULL, &tv);
+#endif
+  if (rc <= 0)
+    {
+      closesocket(tsock->fd);
+      tsock->fd = -1;
+      trace_info (("connection timed out\n"));
+      return -WERR_CONN_TIMEOUT;
+    }
+  return ws_socket_conn_finish(tsock);
+}
+
 static void
 NC_P(ssl_debug)(void *ctx, int level, const char *file, int line, const char *str )
 {
@@ -98,8 +171,6 @@ int
 NC_P(ws_socket_conn)(tcp_socket_t *tsock, const char *host, int port, int retry)
 {
   int rc;
-  struct sockaddr_in remote_ip;
-  const char *host_dispname;
   
   static char inited = 0;
   if (!inited)
@@ -122,6 +193,17 @@ NC_P(ws_socket_conn)(tcp_socket_t *tsock, const char *host, int port, int retry)
       if( tsock->sslconn )
         {
 #if USING(MBEDTLS)
+          struct sockaddr_in remote_ip;
+          char ip_str[16];
+
+          /* mbedtls_net_connect() would look the name up once more */
+          if( parsehost(host, &remote_ip, 1) )
+            {
+              retry--;
+              continue;
+            }
+          inet_ntop(AF_INET, &remote_ip.sin_addr, ip_str, sizeof(ip_str));
+
           mbedtls_net_init(&(tsock->net));
           mbedtls_ssl_init(&(tsock->ssl));
           mbedtls_ssl_config_init(&tsock->conf);
@@ -130,8 +212,9 @@ NC_P(ws_socket_conn)(tcp_socket_t *tsock, const char *host, int port, int retry)
           mbedtls_ctr_drbg_seed(&tsock->ctr_drbg, mbedtls_entropy_func, &tsock->entropy, entropy, entropy_len);
           
           /* Create SSL for data transmission */
-          if( ( rc = mbedtls_net_connect( &tsock->net, host, "443", MBEDTLS_NET_PROTO_TCP ) ) )
+          if( ( rc = mbedtls_net_connect( &tsock->net, ip_str, "443", MBEDTLS_NET_PROTO_TCP ) ) )
             {
+              dns_cache_forget(host);
               closesocket(tsock->fd);
               trace_info (("ssl connection failed rc = %d\n", rc));
               retry--;
@@ -172,50 +255,67 @@ NC_P(ws_socket_conn)(tcp_socket_t *tsock, const char *host, int port, int retry)
         }
       else
         {
-          ws_bzero (&remote_ip, sizeof(struct sockaddr_in));
-          if (parsehost (host, &remote_ip))
+          /* connect() alone may wait for minutes on a host that does not answer */
+          if( (rc = connect_start(tsock, host, port, 1)) > 0 )
+            rc = connect_wait(tsock, WS_SOCKET_CONN_TIMEOUT_MS);
+          if( rc < 0 )
             {
+              if( rc != -WERR_CONN_FATAL )
+                dns_cache_forget(host); /* the host may have moved */
               retry--;
               continue;
             }
-          tsock->fd = socket(PF_INET, SOCK_STREAM, 0);
-          if (tsock->fd == -1)
-            {
-              trace_error (("create a socket\n"));
-              continue;
-            }
-
-          remote_ip.sin_port = htons (port);
-
-    #if PORT (LWIP)
-          host_dispname = ipaddr_ntoa((const ip_addr_t*)&remote_ip.sin_addr.s_addr);
-    #else
-          host_dispname = host;
-    #endif
-
-          //trace_info (("connecting to server %s...\n", host_dispname));
-          if( connect(tsock->fd, (struct sockaddr *)(&remote_ip), sizeof(struct sockaddr))!=0 )
-            {
-              closesocket(tsock->fd);
-              trace_info (("connection failed\n"));
-              retry--;
-              continue;
-            }
+          socket_set_nonblock(tsock->fd, 0);
         }
       return 0;
     }
   return -WERR_CONN_FATAL;
 }
 
+/* Start a plain TCP connection without waiting for it, on a socket that stays
+ * non-blocking. Returns 0 when connected, or 1 while it is underway, for
+ * ws_socket_conn_finish() once the socket is writable. -WERR_AGAIN while
+ * the host name is being looked up, to be started again later. < 0 if it
+ * failed. TLS connections need the blocking ws_socket_conn().
+ */
+int
+NC_P(ws_socket_conn_start)(tcp_socket_t *tsock, const char *host, int port)
+{
+  tcp_socket_reset(tsock);
+  if( port == 443 )
+    return -WERR_FAILED;
+  tsock->nonblock = 1;
+  return connect_start(tsock, host, port, 0);
+}
+
+/* The outcome of a connection that was underway */
+int
+NC_P(ws_socket_conn_finish)(tcp_socket_t *tsock)
+{
+  int err = 0;
+  socklen_t len = sizeof(err);
+
+  if( getsockopt(tsock->fd, SOL_SOCKET, SO_ERROR, (void *)&err, &len) || err )
+    {
+      closesocket(tsock->fd);
+      tsock->fd = -1;
+      trace_info (("connection failed\n"));
+      return -WERR_PORT;
+    }
+  return 0;
+}
+
 int
 NC_P(ws_socket_recv)(tcp_socket_t *tsock, char *buffer, size_t size, int flags)
 {
+  int rc;
+
   if( tsock->sslconn )
     {
 #if USING(MBEDTLS)
       for(;;)
         {
-          int rc = mbedtls_ssl_read(&tsock->ssl, (unsigned char *)buffer, size);
+          rc = mbedtls_ssl_read(&tsock->ssl, (unsigned char *)buffer, size);
           if( rc == MBEDTLS_ERR_SSL_WANT_READ || rc == MBEDTLS_ERR_SSL_WANT_WRITE )  /* retry when required */
             continue;
           else if( rc == MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY )
@@ -240,17 +340,20 @@ NC_P(ws_socket_recv)(tcp_socket_t *tsock, char *buffer, size_t size, int flags)
       return -WERR_FAILED;
 #endif
     }
-  else
-    return recv(tsock->fd, buffer, size, flags);
+  rc = recv(tsock->fd, buffer, size, flags);
+  if( rc < 0 && tsock->nonblock && (errno == EAGAIN || errno == EWOULDBLOCK) )
+    return -WERR_AGAIN;
+  return rc;
 }
 
 int
 NC_P(ws_socket_send)(tcp_socket_t *tsock, const char *buffer, size_t size, int flags)
 {
+  int rc;
+
   if( tsock->sslconn )
     {
 #if USING(MBEDTLS)
-      int rc;
       while( ( rc = mbedtls_ssl_write( &tsock->ssl, (unsigned char *)buffer, size ) ) <= 0 ) /* retry when required */
         {
           if( rc != MBEDTLS_ERR_SSL_WANT_READ && rc != MBEDTLS_ERR_SSL_WANT_WRITE )
@@ -267,8 +370,28 @@ NC_P(ws_socket_send)(tcp_socket_t *tsock, const char *buffer, size_t size, int f
       return -WERR_FAILED;
 #endif
     }
-  else
-    return send(tsock->fd, buffer, size, flags);
+  rc = send(tsock->fd, buffer, size, flags);
+  if( rc < 0 && tsock->nonblock && (errno == EAGAIN || errno == EWOULDBLOCK) )
+    return -WERR_AGAIN;
+  return rc;
+}
+
+/* Whether a connection left idle is still open and quiet, without waiting.
+ * Data or the end of the stream waiting on it mean the server is done with it,
+ * for TLS that is its close notify. */
+int
+NC_P(ws_socket_idle)(tcp_socket_t *tsock)
+{
+  char ch;
+  int fd = tsock->fd;
+
+#if USING(MBEDTLS)
+  if( tsock->sslconn )
+    fd = tsock->net.fd;
+#endif
+  if( fd < 0 )
+    return 0;
+  return recv(fd, &ch, 1, MSG_PEEK | MSG_DONTWAIT) < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
 }
 
 void
@@ -13,6 +13,7 @@
 typedef struct tcp_socket_s {
   int fd;
   char sslconn;
+  char nonblock; /* recv and send return -WERR_AGAIN rather than wait */
 #if USING(MBEDTLS)
   mbedtls_net_context net;
   mbedtls_ssl_config conf;
@@ -23,8 +24,11 @@ typedef struct tcp_socket_s {
 } tcp_socket_t;
 
 int NC_P(ws_socket_conn) (tcp_socket_t *socket, const char *host, int port, int retry);
+int NC_P(ws_socket_conn_start) (tcp_socket_t *socket, const char *host, int port);
+int NC_P(ws_socket_conn_finish) (tcp_socket_t *socket);
 int NC_P(ws_socket_recv) (tcp_socket_t *socket,  char *buffer, size_t size, int flags);
 int NC_P(ws_socket_send) (tcp_socket_t *socket,  const char *buffer, size_t size, int flags);
 void NC_P(ws_socket_close) (tcp_socket_t *socket);
+int NC_P(ws_socket_idle) (tcp_socket_t *socket);
 
 #endif //!defined(TCP_SOCKET_H_)
@@ -19,6 +19,8 @@
 
 #include <pthread.h>
 #include <semaphore.h>
+#include <unistd.h>
+#include <time.h>
 
 typedef struct
 {
@@ -57,7 +59,12 @@ NC_P(util_create_task)(pfn_util_task_callback callback, const char *name, int st
   param->coreid = coreid;
   param->opaque = opaque;
   
-  return pthread_create(&tid, NULL, thread_entry, param);
+  if( pthread_create(&tid, NULL, thread_entry, param) )
+    {
+      ws_free(param);
+      return -WERR_FAILED;
+    }
+  pthread_detach(tid); /* tasks are never joined */
 #elif PORT(FREE_RTOS)
   int priority = 1;
   int rc;
@@ -90,13 +97,20 @@ util_semaphore_t
 util_create_semaphore(int value)
 {
 #if PORT(POSIX)
-  sem_t sem;
-  if( sem_init(&sem, 0, value) )
+  sem_t *sem = (sem_t *)ws_malloc(sizeof(*sem));
+  if( !sem )
     return 0;
+  if( sem_init(sem, 0, value) )
+    {
+      ws_free(sem);
+      return 0;
+    }
   return (util_semaphore_t)sem;
 #elif PORT(FREE_RTOS)
   xSemaphoreHandle sem;
   vSemaphoreCreateBinary(sem);
+  if( sem && !value )
+    xSemaphoreTake(sem, 0); /* binary semaphores are created given */
   return (util_semaphore_t)sem;
 #endif
   return 0;
@@ -106,7 +120,8 @@ void
 util_destroy_semaphore(util_semaphore_t sem)
 {
 #if PORT(POSIX)
-  sem_destroy((sem_t*)(&sem));
+  sem_destroy((sem_t *)sem);
+  ws_free((sem_t *)sem);
 #elif PORT(FREE_RTOS)
   xSemaphoreHandle xSem = (xSemaphoreHandle)sem;
   vSemaphoreDelete(xSem);
@@ -117,7 +132,7 @@ int
 util_semaphore_take(util_semaphore_t sem)
 {
 #if PORT(POSIX)
-  return sem_wait((sem_t*)(&sem));
+  return sem_wait((sem_t *)sem);
 #elif PORT(FREE_RTOS)
   xSemaphoreHandle xSem = (xSemaphoreHandle)sem;
   return xSemaphoreTake(xSem, portMAX_DELAY);
@@ -128,7 +143,7 @@ int
 util_semaphore_give(util_semaphore_t sem)
 {
 #if PORT(POSIX)
-  return sem_post((sem_t*)(&sem));
+  return sem_post((sem_t *)sem);
 #elif PORT(FREE_RTOS)
   xSemaphoreHandle xSem = (xSemaphoreHandle)sem;
   return xSemaphoreGive(xSem);
@@ -139,9 +154,14 @@ util_mutex_t
 util_create_mutex(void)
 {
 #if PORT(POSIX)
-  pthread_mutex_t mutex;
-  if( pthread_mutex_init(&mutex, NULL) )
+  pthread_mutex_t *mutex = (pthread_mutex_t *)ws_malloc(sizeof(*mutex));
+  if( !mutex )
     return 0;
+  if( pthread_mutex_init(mutex, NULL) )
+    {
+      ws_free(mutex);
+      return 0;
+    }
   return (util_mutex_t)mutex;
 #elif PORT(FREE_RTOS)
   xSemaphoreHandle mutex = xSemaphoreCreateMutex();
@@ -154,7 +174,7 @@ void
 util_mutex_take(util_mutex_t mutex)
 {
 #if PORT(POSIX)
-  pthread_mutex_lock((pthread_mutex_t *)(&mutex));
+  pthread_mutex_lock((pthread_mutex_t *)mutex);
 #elif PORT(FREE_RTOS)
   xSemaphoreHandle xSem = (xSemaphoreHandle)mutex;
   xSemaphoreTake(xSem, portMAX_DELAY);
@@ -165,7 +185,7 @@ void
 util_mutex_give(util_mutex_t mutex)
 {
 #if PORT(POSIX)
-  pthread_mutex_unlock((pthread_mutex_t *)(&mutex));
+  pthread_mutex_unlock((pthread_mutex_t *)mutex);
 #elif PORT(FREE_RTOS)
   xSemaphoreHandle xSem = (xSemaphoreHandle)mutex;
   xSemaphoreGive(xSem);
@@ -176,13 +196,36 @@ void
 util_mutex_destroy(util_mutex_t mutex)
 {
 #if PORT(POSIX)
-  pthread_mutex_destroy((pthread_mutex_t *)(&mutex));
+  pthread_mutex_destroy((pthread_mutex_t *)mutex);
+  ws_free((pthread_mutex_t *)mutex);
 #elif PORT(FREE_RTOS)
   xSemaphoreHandle xSem = (xSemaphoreHandle)mutex;
   vSemaphoreDelete(xSem);
 #endif
 }
 
+/* Sleep on 'sem' until the index owned by the other task moves away from 'idle'.
+ * The waiting flag is published before the index is re-checked, so a wakeup
+ * from the other task can never be lost between the check and the sleep. */
+void
+NC_P(util_index_wait)(int *waiting, const unsigned int *idx, unsigned int idle, util_semaphore_t sem)
+{
+  util_atomic_store(waiting, 1);
+  util_atomic_fence();
+  if (util_atomic_load(idx) == idle)
+    util_semaphore_take(sem);
+  util_atomic_store(waiting, 0);
+}
+
+/* Wake the other task if it sleeps in util_index_wait() */
+void
+NC_P(util_index_wake)(int *waiting, util_semaphore_t sem)
+{
+  util_atomic_fence();
+  if (util_atomic_load(waiting))
+    util_semaphore_give(sem);
+}
+
 void
 NC_P(util_task_yield)(void)
 {
@@ -194,13 +237,44 @@ NC_P(util_task_yield)(void)
 void
 NC_P(util_task_sleep)(int ms)
 {
-#if PORT(FREE_RTOS)
+#if PORT(POSIX)
+  usleep(ms * 1000);
+#elif PORT(FREE_RTOS)
   vTaskDelay(ms / portTICK_RATE_MS);
 #endif
 }
 
+/* monotonic time in milliseconds, wrapping */
+unsigned long
+NC_P(util_task_get_ms)(void)
+{
+#if PORT(POSIX)
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#elif PORT(FREE_RTOS)
+  return xTaskGetTickCount() * portTICK_RATE_MS;
+#endif
+}
+
+/* number of processors tasks can run on in parallel */
+int
+NC_P(util_task_get_num_cores)(void)
+{
+#if PORT(POSIX)
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n > 1 ? (int)n : 1;
+#else
+  return 1;
+#endif
+}
+
 int
 NC_P(util_task_get_free_heap)(void)
 {
+#if PORT(FREE_RTOS)
   return xPortGetFreeHeapSize();
+#else
+  return 0; /* not tracked by the host allocator */
+#endif
 }
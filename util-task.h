@@ -18,7 +18,9 @@ extern int NC_P(util_create_task)(pfn_util_task_callback callback, const char *n
 extern void NC_P(util_task_exit)(void);
 extern void NC_P(util_task_yield)(void);
 extern void NC_P(util_task_sleep)(int ms);
+extern unsigned long NC_P(util_task_get_ms)(void);
 extern int NC_P(util_task_get_free_heap)(void);
+extern int NC_P(util_task_get_num_cores)(void);
 
 extern util_semaphore_t util_create_semaphore(int value);
 extern int util_semaphore_take(util_semaphore_t sem);
@@ -30,4 +32,26 @@ extern void util_mutex_take(util_mutex_t mutex);
 extern void util_mutex_give(util_mutex_t mutex);
 extern void util_mutex_destroy(util_mutex_t mutex);
 
+/*
+ * Atomic access to a word shared between exactly two tasks.
+ * Loads acquire and stores release, so data written before a store is
+ * visible to the task which observes the stored value.
+ */
+#if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7))
+# define util_atomic_load(p)      __atomic_load_n((p), __ATOMIC_ACQUIRE)
+# define util_atomic_store(p, v)  __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+# define util_atomic_fence()      __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#else
+# define util_atomic_load(p)      (*(volatile __typeof__(*(p)) *)(p))
+# define util_atomic_store(p, v)  (__sync_synchronize(), *(volatile __typeof__(*(p)) *)(p) = (v))
+# define util_atomic_fence()      __sync_synchronize()
+#endif
+
+/*
+ * Blocking handshake for an index shared between exactly two tasks, each
+ * index advanced by one task only. The waiter passes the value it last saw.
+ */
+extern void NC_P(util_index_wait)(int *waiting, const unsigned int *idx, unsigned int idle, util_semaphore_t sem);
+extern void NC_P(util_index_wake)(int *waiting, util_semaphore_t sem);
+
 #endif
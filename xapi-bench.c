@@ -0,0 +1,238 @@
+/*
+ *  NanoRadio (Open source IoT hardware)
+ *
+ *  This project is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License(GPL)
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This project is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+/*
+ * Catalog navigation benchmark. Browses catalog -> channel -> server ->
+ * program the way xapi-nanoradio.c does, four requests back to back, against
+ * a local stand-in for the API server. The stand-in holds back the first
+ * response on each new connection for 'handshake' ms, for the TLS handshake
+ * the real server takes, and every response for 'rtt' ms. It closes
+ * connections idle for 'keepalive' ms, as servers do. Navigations are
+ * 'pause' ms apart. Reports the time each navigation took and the
+ * connections made, over the keep-alive pool or, with -c, over a new
+ * connection for every request as before.
+ *
+ *   xapi-bench [-c] [-n navigations] [-d handshake_ms] [-l rtt_ms] [-x keepalive_ms] [-p pause_ms] [-s body_bytes]
+ */
+
+#include "portable.h"
+#include "util-task.h"
+#include "http-protocol.h"
+#include "dns-cache.h"
+#include "bench-util.h"
+
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+typedef struct
+{
+  int handshake;          /* ms the first response on a connection is held back */
+  int rtt;                /* ms each response is held back */
+  int keepalive;          /* ms the server keeps an idle connection */
+  int body_size;
+  int listen_fd;
+  volatile int connections;
+  volatile long served;
+  long body_read;
+} bench_t;
+
+/* The HTTP events carry no context. */
+static bench_t bench;
+
+/*
+ * Stand-in server, a task for each connection. Bodies go with a
+ * Content-Length and chunked in turns.
+ */
+static void
+NC_P(task_conn)(void *opaque)
+{
+  int fd = (int)(intptr_t)opaque;
+  char req[1024], *resp;
+  int pos, len, keep, first = 1;
+  long n;
+  struct pollfd pfd;
+
+  util_atomic_store(&bench.connections, bench.connections + 1);
+
+  /* each response goes in one send, as a server's does */
+  if( !(resp = ws_malloc(bench.body_size + 160)) )
+    {
+      close(fd);
+      util_task_exit();
+      return;
+    }
+
+  for(;;)
+    {
+      /* the next request, or the end of the connection */
+      pfd.fd = fd;
+      pfd.events = POLLIN;
+      if( poll(&pfd, 1, bench.keepalive) <= 0 )
+        break;
+      for(pos = 0; pos < (int)sizeof(req) - 1; pos += len)
+        {
+          if( (len = recv(fd, req + pos, sizeof(req) - 1 - pos, 0)) <= 0 )
+            break;
+          req[pos + len] = '\0';
+          if( strstr(req, "\r\n\r\n") )
+            {
+              pos += len;
+              break;
+            }
+        }
+      if( len <= 0 )
+        break;
+      keep = strstr(req, "Connection: keep-alive") != NULL;
+
+      util_task_sleep(bench.rtt + (first ? bench.handshake : 0));
+      first = 0;
+      n = util_atomic_load(&bench.served);
+      util_atomic_store(&bench.served, n + 1);
+      if( n & 1 )
+        len = sprintf(resp, "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nTransfer-Encoding: chunked\r\n\r\n%x\r\n",
+                      bench.body_size);
+      else
+        len = sprintf(resp, "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: %d\r\n\r\n",
+                      bench.body_size);
+      memset(resp + len, 'x', bench.body_size);
+      len += bench.body_size;
+      if( n & 1 )
+        len += sprintf(resp + len, "\r\n0\r\n\r\n");
+      send(fd, resp, len, 0);
+      if( !keep )
+        break;
+    }
+  close(fd);
+  ws_free(resp);
+  util_task_exit();
+}
+
+static int
+NC_P(event_body)(char *at, int length)
+{
+  bench.body_read += length;
+  return 0;
+  WS_UNUSED(at);
+}
+
+/* One request the way xapi-nanoradio.c makes it */
+static int
+NC_P(api_request)(int pooled, const char *file, int port, const http_event_procs_t *procs)
+{
+  static http_t http;
+  static char buff[HTTP_BUFF_SIZE];
+  int rc;
+
+  if( pooled )
+    return http_pool_request("127.0.0.1", file, port, procs);
+
+  http_init(&http, buff, sizeof(buff));
+  if( !(rc = http_request(&http, "127.0.0.1", file, port, -1, -1)) )
+    rc = http_read_response(&http, procs);
+  ws_socket_close(&http.socket);
+  return rc;
+}
+
+int
+main(int argc, char **argv)
+{
+  static const char *api_files[] =
+    { "/api/catalog/root", "/api/catalog/entry.%d", "/api/channel/entry.%d.0", "/api/program/list.%d.0.0" };
+  int pooled = 1, navigations = 10, pause = 0, port, i, j, failed = 0;
+  char file[64];
+  double t, total = 0, longest = 0, first = 0;
+  http_event_procs_t procs;
+  http_pool_stats_t stats;
+
+  bench.handshake = 300;
+  bench.rtt = 30;
+  bench.keepalive = 5000;
+  bench.body_size = 2048;
+
+  for(i = 1; i < argc; i++)
+    {
+      if( !strcmp(argv[i], "-c") )
+        pooled = 0;
+      else if( !strcmp(argv[i], "-n") && i + 1 < argc )
+        navigations = atoi(argv[++i]);
+      else if( !strcmp(argv[i], "-d") && i + 1 < argc )
+        bench.handshake = atoi(argv[++i]);
+      else if( !strcmp(argv[i], "-l") && i + 1 < argc )
+        bench.rtt = atoi(argv[++i]);
+      else if( !strcmp(argv[i], "-x") && i + 1 < argc )
+        bench.keepalive = atoi(argv[++i]);
+      else if( !strcmp(argv[i], "-p") && i + 1 < argc )
+        pause = atoi(argv[++i]);
+      else if( !strcmp(argv[i], "-s") && i + 1 < argc )
+        bench.body_size = atoi(argv[++i]);
+      else
+        {
+          fprintf(stderr, "usage: %s [-c] [-n navigations] [-d handshake_ms] [-l rtt_ms] [-x keepalive_ms] [-p pause_ms] [-s body_bytes]\n", argv[0]);
+          return 1;
+        }
+    }
+  if( navigations <= 0 || bench.body_size <= 0 )
+    return 1;
+
+  dns_cache_init(); /* the radio resolves through the cache too */
+  if( (bench.listen_fd = bench_listen_local(&port, 4)) < 0 ||
+      bench_serve(bench.listen_fd, task_conn) )
+    {
+      fprintf(stderr, "cannot serve on the loopback interface\n");
+      return 1;
+    }
+
+  http_callbacks_init(&procs);
+  procs.event_body = event_body;
+
+  for(i = 0; i < navigations; i++)
+    {
+      if( i && pause )
+        util_task_sleep(pause);
+      t = bench_now();
+      for(j = 0; j < 4; j++)
+        {
+          bench.body_read = 0;
+          sprintf(file, api_files[j], i);
+          if( api_request(pooled, file, port, &procs) || bench.body_read != bench.body_size )
+            failed++;
+        }
+      t = bench_now() - t;
+      if( !i )
+        first = t;
+      total += t;
+      if( t > longest )
+        longest = t;
+    }
+
+  printf("%s, %d ms handshake, %d ms rtt, server keeps idle connections %d ms, %d ms between navigations\n",
+         pooled ? "keep-alive pool" : "a connection per request", bench.handshake, bench.rtt, bench.keepalive, pause);
+  printf("%d navigations of 4 requests, %d failed\n", navigations, failed);
+  printf("navigation %.0f ms mean, %.0f ms first, %.0f ms longest\n",
+         total * 1000 / navigations, first * 1000, longest * 1000);
+  printf("%d connections to the server", bench.connections);
+  if( pooled )
+    {
+      http_pool_get_stats(&stats);
+      printf(", pool: %lu connects, %lu reuses, %lu evictions", stats.connects, stats.reuses, stats.evictions);
+    }
+  printf("\n");
+
+  http_pool_flush();
+  close(bench.listen_fd);
+  return failed ? 1 : 0;
+}
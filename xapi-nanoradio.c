@@ -64,7 +64,6 @@ static int
 NC_P(api_request_chunk)(const char *api_file, enum CURRENT_API current)
 {
   int rc;
-  http_t http;
   http_event_procs_t procs;
   http_callbacks_init(&procs);
   procs.event_body = event_body;
@@ -72,10 +71,8 @@ NC_P(api_request_chunk)(const char *api_file, enum CURRENT_API current)
   api_chunk_write_pos = 0;
   api_current = current;
   
-  if( (rc = http_request(&http, api_host, api_file, 443, -1, -1) ) )
-    return rc;
-  
-  if( (rc = http_read_response(&http, &procs)) )
+  /* browsing issues requests back to back, they share one TLS connection */
+  if( (rc = http_pool_request(api_host, api_file, 443, &procs)) )
     return rc;
   
   api_chunk[api_chunk_write_pos] = '\0';